@@ -13,16 +13,122 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <crud/crud.hpp>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <limits>
 
 using namespace bzn;
 
 namespace
 {
     const std::string PERMISSION_UUID{"PERMS"};
+    const std::string EXPIRY_UUID{"TTL"};
+    const size_t MAX_KEYS_PER_RESPONSE{1000};
+    const size_t MAX_RECORDS_PER_RESPONSE{100};
+    const std::chrono::seconds DEFAULT_EXPIRY_CHECK{5};
+
+
+    // expiry records are keyed by the uuid's size, the uuid and the key so they can be split apart again...
+    bzn::key_t
+    expiry_key(const bzn::uuid_t& uuid, const bzn::key_t& key)
+    {
+        return std::to_string(uuid.size()) + ':' + uuid + key;
+    }
+
+
+    bzn::key_t
+    expiry_prefix(const bzn::uuid_t& uuid)
+    {
+        return expiry_key(uuid, "");
+    }
+
+
+    bool
+    parse_expiry_key(const bzn::key_t& expiry_key, bzn::uuid_t& uuid, bzn::key_t& key)
+    {
+        const auto separator = expiry_key.find(':');
+
+        if (separator == std::string::npos || separator == 0)
+        {
+            return false;
+        }
+
+        try
+        {
+            const auto uuid_size = std::stoull(expiry_key.substr(0, separator));
+
+            if (uuid_size > expiry_key.size() - separator - 1)
+            {
+                return false;
+            }
+
+            uuid = expiry_key.substr(separator + 1, uuid_size);
+            key = expiry_key.substr(separator + 1 + uuid_size);
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    std::vector<bzn::key_value_t>
+    to_records(const google::protobuf::RepeatedPtrField<database_key_value>& records)
+    {
+        std::vector<bzn::key_value_t> result;
+        result.reserve(records.size());
+
+        for (const auto& record : records)
+        {
+            result.emplace_back(record.key(), record.value());
+        }
+
+        return result;
+    }
+
+
+    // serialized database_response for a read, up to (but not including) the value bytes...
+    std::string
+    encode_read_response_prefix(const database_header& header, const bzn::key_t& key, size_t value_size)
+    {
+        using google::protobuf::internal::WireFormatLite;
+        using google::protobuf::io::CodedOutputStream;
+
+        const auto header_size = header.ByteSizeLong();
+        const auto key_tag = WireFormatLite::MakeTag(database_read_response::kKeyFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+        const auto value_tag = WireFormatLite::MakeTag(database_read_response::kValueFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+        const auto read_size = CodedOutputStream::VarintSize32(key_tag) + CodedOutputStream::VarintSize64(key.size()) + key.size()
+            + CodedOutputStream::VarintSize32(value_tag) + CodedOutputStream::VarintSize64(value_size) + value_size;
+
+        std::string prefix;
+        {
+            google::protobuf::io::StringOutputStream string_stream(&prefix);
+            CodedOutputStream stream(&string_stream);
+
+            stream.WriteTag(WireFormatLite::MakeTag(database_response::kHeaderFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+            stream.WriteVarint64(header_size);
+            header.SerializeWithCachedSizes(&stream);
+
+            stream.WriteTag(WireFormatLite::MakeTag(database_response::kReadFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+            stream.WriteVarint64(read_size);
+
+            stream.WriteTag(key_tag);
+            stream.WriteVarint64(key.size());
+            stream.WriteString(key);
+
+            stream.WriteTag(value_tag);
+            stream.WriteVarint64(value_size);
+        }
+
+        return prefix;
+    }
 }
 
 
-crud::crud(std::shared_ptr<bzn::storage_base> storage, std::shared_ptr<bzn::subscription_manager_base> subscription_manager)
+crud::crud(std::shared_ptr<bzn::asio::io_context_base> io_context, std::shared_ptr<bzn::storage_base> storage,
+    std::shared_ptr<bzn::subscription_manager_base> subscription_manager)
            : storage(std::move(storage))
            , subscription_manager(std::move(subscription_manager))
            , message_handlers{{database_msg::kCreate, std::bind(&crud::handle_create, this, std::placeholders::_1, std::placeholders::_2)},
@@ -36,7 +142,14 @@ crud::crud(std::shared_ptr<bzn::storage_base> storage, std::shared_ptr<bzn::subs
                               {database_msg::kUnsubscribe, std::bind(&crud::handle_unsubscribe, this, std::placeholders::_1, std::placeholders::_2)},
                               {database_msg::kCreateDb,    std::bind(&crud::handle_create_db,   this, std::placeholders::_1, std::placeholders::_2)},
                               {database_msg::kDeleteDb,    std::bind(&crud::handle_delete_db,   this, std::placeholders::_1, std::placeholders::_2)},
-                              {database_msg::kHasDb,       std::bind(&crud::handle_has_db,      this, std::placeholders::_1, std::placeholders::_2)}}
+                              {database_msg::kHasDb,       std::bind(&crud::handle_has_db,      this, std::placeholders::_1, std::placeholders::_2)},
+                              {database_msg::kMultiCreate, std::bind(&crud::handle_multi_create, this, std::placeholders::_1, std::placeholders::_2)},
+                              {database_msg::kMultiRead,   std::bind(&crud::handle_multi_read,   this, std::placeholders::_1, std::placeholders::_2)},
+                              {database_msg::kMultiUpdate, std::bind(&crud::handle_multi_update, this, std::placeholders::_1, std::placeholders::_2)},
+                              {database_msg::kMultiDelete, std::bind(&crud::handle_multi_delete, this, std::placeholders::_1, std::placeholders::_2)},
+                              {database_msg::kRange,       std::bind(&crud::handle_range,        this, std::placeholders::_1, std::placeholders::_2)},
+                              {database_msg::kPrefix,      std::bind(&crud::handle_prefix,       this, std::placeholders::_1, std::placeholders::_2)}}
+           , expiry_timer(io_context->make_unique_steady_timer())
 {
 }
 
@@ -48,6 +161,11 @@ crud::start()
         [this]()
         {
             this->subscription_manager->start();
+
+            this->load_expirations();
+
+            this->expiry_timer->expires_from_now(DEFAULT_EXPIRY_CHECK);
+            this->expiry_timer->async_wait(std::bind(&crud::handle_expiry_timer, shared_from_this(), std::placeholders::_1));
         });
 }
 
@@ -59,6 +177,14 @@ crud::handle_request(const database_msg& request, const std::shared_ptr<bzn::ses
     {
         LOG(debug) << "processing message: " << uint32_t(request.msg_case());
 
+        // the clock only moves forward, whichever request gets here first...
+        for (uint64_t now = this->now; now < request.header().timestamp() && !this->now.compare_exchange_weak(now, request.header().timestamp());)
+        {
+        }
+
+        // whatever has expired by now is gone before the request sees the database...
+        this->expire_records(request.header().db_uuid());
+
         it->second(request, session);
 
         return;
@@ -114,6 +240,11 @@ crud::handle_create(const database_msg& request, std::shared_ptr<bzn::session_ba
     if (this->storage->has(PERMISSION_UUID, request.header().db_uuid()))
     {
         result = this->storage->create(request.header().db_uuid(), request.create().key(), request.create().value());
+
+        if (result == storage_base::result::ok && request.create().expire())
+        {
+            this->set_expiry(request.header().db_uuid(), request.create().key(), request.create().expire());
+        }
     }
 
     if (session)
@@ -132,18 +263,22 @@ crud::handle_read(const database_msg& request, std::shared_ptr<bzn::session_base
 {
     if (session)
     {
-        auto result = this->storage->read(request.header().db_uuid(), request.read().key());
-
-        database_response response;
+        auto view = this->storage->read_view(request.header().db_uuid(), request.read().key());
 
-        if (result)
+        if (!view)
         {
-            response.mutable_read()->set_key(request.read().key());
-            response.mutable_read()->set_value(*result);
+            this->send_response(request, bzn::storage_base::result::not_found, database_response(), session);
+
+            return;
         }
 
-        this->send_response(request, (result) ? bzn::storage_base::result::ok : bzn::storage_base::result::not_found,
-            std::move(response), session);
+        // send the value straight from the storage engine's buffer instead of copying it into a response message...
+        auto prefix = std::make_shared<const std::string>(
+            encode_read_response_prefix(request.header(), request.read().key(), view->data.size()));
+
+        session->send_buffers({boost::asio::buffer(*prefix), boost::asio::buffer(view->data.data(), view->data.size())},
+            std::make_shared<std::pair<std::shared_ptr<const std::string>, std::shared_ptr<const void>>>(prefix, view->owner),
+            false);
 
         return;
     }
@@ -157,6 +292,19 @@ crud::handle_update(const database_msg& request, std::shared_ptr<bzn::session_ba
 {
     auto result = this->storage->update(request.header().db_uuid(), request.update().key(), request.update().value());
 
+    // an update replaces the expiry along with the value...
+    if (result == storage_base::result::ok)
+    {
+        if (request.update().expire())
+        {
+            this->set_expiry(request.header().db_uuid(), request.update().key(), request.update().expire());
+        }
+        else
+        {
+            this->clear_expiry(request.header().db_uuid(), request.update().key());
+        }
+    }
+
     if (session)
     {
         this->send_response(request, result, database_response(), session);
@@ -173,6 +321,11 @@ crud::handle_delete(const database_msg& request, std::shared_ptr<bzn::session_ba
 {
     auto result = this->storage->remove(request.header().db_uuid(), request.delete_().key());
 
+    if (result == storage_base::result::ok)
+    {
+        this->clear_expiry(request.header().db_uuid(), request.delete_().key());
+    }
+
     if (session)
     {
         this->send_response(request, result, database_response(), session);
@@ -206,14 +359,22 @@ crud::handle_keys(const database_msg& request, std::shared_ptr<bzn::session_base
 {
     if (session)
     {
-        const auto keys = this->storage->get_keys(request.header().db_uuid());
+        const auto& keys_request = request.keys();
+
+        const size_t limit = (keys_request.limit() && keys_request.limit() < MAX_KEYS_PER_RESPONSE)
+            ? keys_request.limit() : MAX_KEYS_PER_RESPONSE;
+
+        // ask for one more than the page to learn if the client has to come back...
+        auto keys = this->storage->get_keys(request.header().db_uuid(), keys_request.start_after(), limit + 1, keys_request.prefix());
 
         database_response response;
-        response.mutable_keys();
+        response.mutable_keys()->set_more(keys.size() > limit);
 
-        for (const auto& key : keys)
+        keys.resize(std::min(keys.size(), limit));
+
+        for (auto& key : keys)
         {
-            response.mutable_keys()->add_keys(key);
+            response.mutable_keys()->add_keys(std::move(key));
         }
 
         this->send_response(request, storage_base::result::ok, std::move(response), session);
@@ -285,12 +446,171 @@ crud::handle_unsubscribe(const database_msg& request, std::shared_ptr<bzn::sessi
 }
 
 
+void
+crud::handle_multi_create(const database_msg& request, std::shared_ptr<bzn::session_base> session)
+{
+    storage_base::result result{storage_base::result::db_not_found};
+
+    if (this->storage->has(PERMISSION_UUID, request.header().db_uuid()))
+    {
+        result = this->storage->multi_create(request.header().db_uuid(), to_records(request.multi_create().records()));
+    }
+
+    if (session)
+    {
+        this->send_response(request, result, database_response(), session);
+
+        return;
+    }
+
+    LOG(warning) << "session no longer available. MULTI CREATE response not sent.";
+}
+
+
+void
+crud::handle_multi_read(const database_msg& request, std::shared_ptr<bzn::session_base> session)
+{
+    if (session)
+    {
+        const std::vector<bzn::key_t> keys(request.multi_read().keys().begin(), request.multi_read().keys().end());
+
+        const auto values = this->storage->multi_read(request.header().db_uuid(), keys);
+
+        database_response response;
+        response.mutable_multi_read();
+
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (values[i])
+            {
+                auto record = response.mutable_multi_read()->add_records();
+                record->set_key(keys[i]);
+                record->set_value(*values[i]);
+            }
+        }
+
+        this->send_response(request, storage_base::result::ok, std::move(response), session);
+
+        return;
+    }
+
+    LOG(warning) << "session no longer available. MULTI READ not executed.";
+}
+
+
+void
+crud::handle_multi_update(const database_msg& request, std::shared_ptr<bzn::session_base> session)
+{
+    auto result = this->storage->multi_update(request.header().db_uuid(), to_records(request.multi_update().records()));
+
+    if (result == storage_base::result::ok)
+    {
+        for (const auto& record : request.multi_update().records())
+        {
+            this->clear_expiry(request.header().db_uuid(), record.key());
+        }
+    }
+
+    if (session)
+    {
+        this->send_response(request, result, database_response(), session);
+
+        return;
+    }
+
+    LOG(warning) << "session no longer available. MULTI UPDATE response not sent.";
+}
+
+
+void
+crud::handle_multi_delete(const database_msg& request, std::shared_ptr<bzn::session_base> session)
+{
+    const std::vector<bzn::key_t> keys(request.multi_delete().keys().begin(), request.multi_delete().keys().end());
+
+    auto result = this->storage->multi_remove(request.header().db_uuid(), keys);
+
+    if (result == storage_base::result::ok)
+    {
+        for (const auto& key : keys)
+        {
+            this->clear_expiry(request.header().db_uuid(), key);
+        }
+    }
+
+    if (session)
+    {
+        this->send_response(request, result, database_response(), session);
+
+        return;
+    }
+
+    LOG(warning) << "session no longer available. MULTI DELETE response not sent.";
+}
+
+
+void
+crud::handle_range(const database_msg& request, std::shared_ptr<bzn::session_base> session)
+{
+    if (session)
+    {
+        this->send_range(request, request.range().start(), request.range().end(), request.range().limit(),
+            request.range().reverse(), session);
+
+        return;
+    }
+
+    LOG(warning) << "session no longer available. RANGE not executed.";
+}
+
+
+void
+crud::handle_prefix(const database_msg& request, std::shared_ptr<bzn::session_base> session)
+{
+    if (session)
+    {
+        this->send_range(request, request.prefix().prefix(), storage_base::prefix_end(request.prefix().prefix()),
+            request.prefix().limit(), request.prefix().reverse(), session);
+
+        return;
+    }
+
+    LOG(warning) << "session no longer available. PREFIX not executed.";
+}
+
+
+void
+crud::send_range(const database_msg& request, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse,
+    std::shared_ptr<bzn::session_base>& session)
+{
+    limit = (limit && limit < MAX_RECORDS_PER_RESPONSE) ? limit : MAX_RECORDS_PER_RESPONSE;
+
+    // ask for one more than the page to learn if the client has to come back...
+    auto records = this->storage->get_range(request.header().db_uuid(), start, end, limit + 1, reverse);
+
+    database_response response;
+    response.mutable_range()->set_more(records.size() > limit);
+
+    records.resize(std::min(records.size(), limit));
+
+    for (auto& record : records)
+    {
+        auto key_value = response.mutable_range()->add_records();
+        key_value->set_key(std::move(record.first));
+        key_value->set_value(std::move(record.second));
+    }
+
+    this->send_response(request, storage_base::result::ok, std::move(response), session);
+}
+
+
 void
 crud::handle_create_db(const database_msg& request, std::shared_ptr<bzn::session_base> session)
 {
     storage_base::result result;
 
-    if (this->storage->has(PERMISSION_UUID, request.header().db_uuid()))
+    // the node keeps its own bookkeeping in these, so clients cannot have them...
+    if (request.header().db_uuid() == PERMISSION_UUID || request.header().db_uuid() == EXPIRY_UUID ||
+        this->storage->has(PERMISSION_UUID, request.header().db_uuid()))
     {
         result = storage_base::result::exists;
     }
@@ -324,6 +644,8 @@ crud::handle_delete_db(const database_msg& request, std::shared_ptr<bzn::session
         result = this->storage->remove(PERMISSION_UUID, request.header().db_uuid());
 
         this->storage->remove(request.header().db_uuid());
+
+        this->clear_expiries(request.header().db_uuid());
     }
 
     if (session)
@@ -352,3 +674,188 @@ crud::handle_has_db(const database_msg& request, std::shared_ptr<bzn::session_ba
 
     LOG(warning) << "session no longer available. HAS DB not executed.";
 }
+
+
+void
+crud::load_expirations()
+{
+    std::lock_guard<std::mutex> lock(this->expiry_lock);
+
+    for (const auto& record : this->storage->get_range(EXPIRY_UUID, "", "", 0, false))
+    {
+        bzn::uuid_t uuid;
+        bzn::key_t key;
+
+        try
+        {
+            if (parse_expiry_key(record.first, uuid, key))
+            {
+                const uint64_t expires = std::stoull(record.second);
+
+                this->expiring[uuid].by_time.emplace(expires, key);
+                this->expiring[uuid].by_key[key] = expires;
+
+                continue;
+            }
+        }
+        catch (const std::exception&)
+        {
+        }
+
+        LOG(error) << "ignoring malformed expiry record: " << record.first;
+    }
+
+    LOG(info) << "loaded record expiries for " << this->expiring.size() << " databases";
+}
+
+
+void
+crud::set_expiry(const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t expire)
+{
+    // seconds from the agreed time to a time in milliseconds, saturating rather than wrapping...
+    const uint64_t max_time = std::numeric_limits<uint64_t>::max();
+    const uint64_t now = this->now;
+    const uint64_t expires = (expire > (max_time - now) / 1000) ? max_time : now + expire * 1000;
+
+    std::lock_guard<std::mutex> lock(this->expiry_lock);
+
+    auto& db = this->expiring[uuid];
+
+    if (auto found = db.by_key.find(key); found != db.by_key.end())
+    {
+        db.by_time.erase({found->second, key});
+
+        found->second = expires;
+
+        this->storage->update(EXPIRY_UUID, expiry_key(uuid, key), std::to_string(expires));
+    }
+    else
+    {
+        db.by_key.emplace(key, expires);
+
+        this->storage->create(EXPIRY_UUID, expiry_key(uuid, key), std::to_string(expires));
+    }
+
+    db.by_time.emplace(expires, key);
+}
+
+
+void
+crud::clear_expiry(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    std::lock_guard<std::mutex> lock(this->expiry_lock);
+
+    auto db = this->expiring.find(uuid);
+
+    if (db == this->expiring.end())
+    {
+        return;
+    }
+
+    if (auto found = db->second.by_key.find(key); found != db->second.by_key.end())
+    {
+        db->second.by_time.erase({found->second, key});
+        db->second.by_key.erase(found);
+
+        this->storage->remove(EXPIRY_UUID, expiry_key(uuid, key));
+
+        if (db->second.by_key.empty())
+        {
+            this->expiring.erase(db);
+        }
+    }
+}
+
+
+void
+crud::clear_expiries(const bzn::uuid_t& uuid)
+{
+    std::lock_guard<std::mutex> lock(this->expiry_lock);
+
+    if (this->expiring.erase(uuid))
+    {
+        this->storage->multi_remove(EXPIRY_UUID, this->storage->get_keys(EXPIRY_UUID, "", 0, expiry_prefix(uuid)));
+    }
+}
+
+
+void
+crud::expire_records(const bzn::uuid_t& uuid)
+{
+    const uint64_t now = this->now;
+
+    std::lock_guard<std::mutex> lock(this->expiry_lock);
+
+    auto db = this->expiring.find(uuid);
+
+    if (db == this->expiring.end() || db->second.by_time.begin()->first > now)
+    {
+        return;
+    }
+
+    std::vector<bzn::key_t> keys;
+    std::vector<bzn::key_t> expiry_keys;
+
+    auto& by_time = db->second.by_time;
+
+    for (auto it = by_time.begin(); it != by_time.end() && it->first <= now; it = by_time.erase(it))
+    {
+        db->second.by_key.erase(it->second);
+
+        keys.emplace_back(it->second);
+        expiry_keys.emplace_back(expiry_key(uuid, it->second));
+    }
+
+    // a batch is refused whole if any record is already gone, so fall back to removing them one at a time...
+    if (this->storage->multi_remove(uuid, keys) != storage_base::result::ok)
+    {
+        for (const auto& key : keys)
+        {
+            this->storage->remove(uuid, key);
+        }
+    }
+
+    if (this->storage->multi_remove(EXPIRY_UUID, expiry_keys) != storage_base::result::ok)
+    {
+        for (const auto& key : expiry_keys)
+        {
+            this->storage->remove(EXPIRY_UUID, key);
+        }
+    }
+
+    if (by_time.empty())
+    {
+        this->expiring.erase(db);
+    }
+
+    LOG(debug) << "expired " << keys.size() << " records from database: " << uuid;
+}
+
+
+void
+crud::handle_expiry_timer(const boost::system::error_code& ec)
+{
+    if (!ec)
+    {
+        std::vector<bzn::uuid_t> uuids;
+
+        {
+            std::lock_guard<std::mutex> lock(this->expiry_lock);
+
+            for (const auto& db : this->expiring)
+            {
+                uuids.emplace_back(db.first);
+            }
+        }
+
+        // only what has expired by the latest agreed request time, the local clock may be ahead of requests still to come...
+        for (const auto& uuid : uuids)
+        {
+            this->expire_records(uuid);
+        }
+
+        // reschedule...
+        this->expiry_timer->expires_from_now(DEFAULT_EXPIRY_CHECK);
+        this->expiry_timer->async_wait(std::bind(&crud::handle_expiry_timer, shared_from_this(), std::placeholders::_1));
+    }
+}
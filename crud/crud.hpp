@@ -15,10 +15,14 @@
 #pragma once
 
 #include <include/bluzelle.hpp>
+#include <include/boost_asio_beast.hpp>
 #include <crud/crud_base.hpp>
 #include <crud/subscription_manager_base.hpp>
 #include <node/node_base.hpp>
 #include <storage/storage_base.hpp>
+#include <atomic>
+#include <mutex>
+#include <set>
 
 
 namespace bzn
@@ -26,7 +30,8 @@ namespace bzn
     class crud final : public bzn::crud_base, public std::enable_shared_from_this<crud>
     {
     public:
-        crud(std::shared_ptr<bzn::storage_base> storage, std::shared_ptr<bzn::subscription_manager_base> subscription_manager);
+        crud(std::shared_ptr<bzn::asio::io_context_base> io_context, std::shared_ptr<bzn::storage_base> storage,
+            std::shared_ptr<bzn::subscription_manager_base> subscription_manager);
 
         void handle_request(const database_msg& request, const std::shared_ptr<bzn::session_base>& session) override;
 
@@ -58,9 +63,38 @@ namespace bzn
 
         void handle_unsubscribe(const database_msg& request, std::shared_ptr<bzn::session_base> session);
 
+        void handle_multi_create(const database_msg& request, std::shared_ptr<bzn::session_base> session);
+
+        void handle_multi_read(const database_msg& request, std::shared_ptr<bzn::session_base> session);
+
+        void handle_multi_update(const database_msg& request, std::shared_ptr<bzn::session_base> session);
+
+        void handle_multi_delete(const database_msg& request, std::shared_ptr<bzn::session_base> session);
+
+        void handle_range(const database_msg& request, std::shared_ptr<bzn::session_base> session);
+
+        void handle_prefix(const database_msg& request, std::shared_ptr<bzn::session_base> session);
+
+        void send_range(const database_msg& request, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse,
+            std::shared_ptr<bzn::session_base>& session);
+
         void send_response(const database_msg& request, bzn::storage_base::result result, database_response&& response,
             std::shared_ptr<bzn::session_base>& session);
 
+        // record expiry is judged against the agreed request time rather than the local clock, so every replica
+        // expires a record between the same two requests...
+        void load_expirations();
+
+        void set_expiry(const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t expire);
+
+        void clear_expiry(const bzn::uuid_t& uuid, const bzn::key_t& key);
+
+        void clear_expiries(const bzn::uuid_t& uuid);
+
+        void expire_records(const bzn::uuid_t& uuid);
+
+        void handle_expiry_timer(const boost::system::error_code& ec);
+
         std::shared_ptr<bzn::storage_base> storage;
         std::shared_ptr<bzn::subscription_manager_base> subscription_manager;
 
@@ -69,6 +103,18 @@ namespace bzn
         std::unordered_map<database_msg::MsgCase, message_handler_t> message_handlers;
 
         std::once_flag start_once;
+
+        struct expiries
+        {
+            std::set<std::pair<uint64_t, bzn::key_t>> by_time;
+            std::unordered_map<bzn::key_t, uint64_t> by_key;
+        };
+
+        std::unordered_map<bzn::uuid_t, expiries> expiring;
+        std::atomic<uint64_t> now{0}; // latest agreed request time
+        std::unique_ptr<bzn::asio::steady_timer_base> expiry_timer;
+
+        std::mutex expiry_lock; // guards the expiry index, requests themselves do not wait on each other
     };
 
 } // namespace bzn
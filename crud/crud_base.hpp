@@ -30,6 +30,7 @@ namespace bzn
     const std::string MSG_INVALID_ARGUMENTS = "INVALID_ARGUMENTS";
     const std::string MSG_VALUE_SIZE_TOO_LARGE = "VALUE_SIZE_TOO_LARGE";
     const std::string MSG_KEY_SIZE_TOO_LARGE = "KEY_SIZE_TOO_LARGE";
+    const std::string MSG_TOO_MANY_REQUESTS = "TOO_MANY_REQUESTS";
 
     // this interface is tied too closely with raft usage and will eventually be removed...
     namespace deprecated
@@ -203,6 +203,27 @@ subscription_manager::inspect_commit(const database_msg& msg)
             this->notify_sessions(msg.header().db_uuid(), false, msg.delete_().key(), "");
             break;
 
+        case database_msg::kMultiCreate:
+            for (const auto& record : msg.multi_create().records())
+            {
+                this->notify_sessions(msg.header().db_uuid(), true, record.key(), record.value());
+            }
+            break;
+
+        case database_msg::kMultiUpdate:
+            for (const auto& record : msg.multi_update().records())
+            {
+                this->notify_sessions(msg.header().db_uuid(), true, record.key(), record.value());
+            }
+            break;
+
+        case database_msg::kMultiDelete:
+            for (const auto& key : msg.multi_delete().keys())
+            {
+                this->notify_sessions(msg.header().db_uuid(), false, key, "");
+            }
+            break;
+
         default:
             // nothing to do...
             break;
@@ -14,6 +14,7 @@
 
 #include <crud/crud.hpp>
 #include <storage/mem_storage.hpp>
+#include <mocks/mock_boost_asio_beast.hpp>
 #include <mocks/mock_session_base.hpp>
 #include <mocks/mock_subscription_manager_base.hpp>
 #include <algorithm>
@@ -21,9 +22,28 @@
 using namespace ::testing;
 
 
+namespace
+{
+    std::shared_ptr<bzn::asio::Mockio_context_base>
+    make_io_context()
+    {
+        auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+
+        // the expiry timer never fires...
+        EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillRepeatedly(Invoke(
+            []()
+            {
+                return std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+            }));
+
+        return mock_io_context;
+    }
+}
+
+
 TEST(crud, test_that_create_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), nullptr);
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
 
     database_msg msg;
 
@@ -128,7 +148,7 @@ TEST(crud, test_that_create_sends_proper_response)
 
 TEST(crud, test_that_read_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), nullptr);
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
 
     database_msg msg;
 
@@ -191,7 +211,7 @@ TEST(crud, test_that_read_sends_proper_response)
 
 TEST(crud, test_that_update_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), nullptr);
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
 
     database_msg msg;
 
@@ -255,7 +275,7 @@ TEST(crud, test_that_update_sends_proper_response)
 
 TEST(crud, test_that_delete_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), nullptr);
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
 
     database_msg msg;
 
@@ -312,7 +332,7 @@ TEST(crud, test_that_delete_sends_proper_response)
 
 TEST(crud, test_that_has_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), nullptr);
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
 
     database_msg msg;
 
@@ -373,7 +393,7 @@ TEST(crud, test_that_has_sends_proper_response)
 
 TEST(crud, test_that_keys_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), nullptr);
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
 
     database_msg msg;
 
@@ -442,9 +462,70 @@ TEST(crud, test_that_keys_sends_proper_response)
 }
 
 
+TEST(crud, test_that_keys_are_returned_in_pages)
+{
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
+
+    database_msg msg;
+
+    msg.mutable_header()->set_db_uuid("uuid");
+    msg.mutable_header()->set_transaction_id(uint64_t(123));
+    msg.mutable_create_db();
+
+    crud.handle_request(msg, nullptr);
+
+    msg.release_create_db();
+
+    for (const auto& key : {"a1", "b1", "b2", "b3", "c1"})
+    {
+        msg.mutable_create()->set_key(key);
+        msg.mutable_create()->set_value("value");
+
+        crud.handle_request(msg, nullptr);
+    }
+
+    msg.release_create();
+    msg.mutable_keys()->set_limit(2);
+    msg.mutable_keys()->set_prefix("b");
+
+    auto session = std::make_shared<bzn::Mocksession_base>();
+
+    // first page...
+    EXPECT_CALL(*session, send_message(An<std::shared_ptr<std::string>>(), false)).WillOnce(Invoke(
+        [&](auto msg, auto)
+        {
+            database_response resp;
+            ASSERT_TRUE(resp.ParseFromString(*msg));
+            ASSERT_EQ(resp.response_case(), database_response::kKeys);
+            ASSERT_EQ(resp.keys().keys().size(), int(2));
+            ASSERT_EQ(resp.keys().keys(0), "b1");
+            ASSERT_EQ(resp.keys().keys(1), "b2");
+            ASSERT_TRUE(resp.keys().more());
+        }));
+
+    crud.handle_request(msg, session);
+
+    // last page...
+    msg.mutable_keys()->set_start_after("b2");
+
+    EXPECT_CALL(*session, send_message(An<std::shared_ptr<std::string>>(), false)).WillOnce(Invoke(
+        [&](auto msg, auto)
+        {
+            database_response resp;
+            ASSERT_TRUE(resp.ParseFromString(*msg));
+            ASSERT_EQ(resp.response_case(), database_response::kKeys);
+            ASSERT_EQ(resp.keys().keys().size(), int(1));
+            ASSERT_EQ(resp.keys().keys(0), "b3");
+            ASSERT_FALSE(resp.keys().more());
+        }));
+
+    crud.handle_request(msg, session);
+}
+
+
 TEST(crud, test_that_size_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), nullptr);
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
 
     database_msg msg;
 
@@ -510,11 +591,11 @@ TEST(crud, test_that_subscribe_request_calls_subscription_manager)
 {
     auto mock_subscription_manager = std::make_shared<bzn::Mocksubscription_manager_base>();
 
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), mock_subscription_manager);
+    auto crud = std::make_shared<bzn::crud>(make_io_context(), std::make_shared<bzn::mem_storage>(), mock_subscription_manager);
 
     EXPECT_CALL(*mock_subscription_manager, start());
 
-    crud.start();
+    crud->start();
 
     // subscribe...
     database_msg msg;
@@ -524,7 +605,7 @@ TEST(crud, test_that_subscribe_request_calls_subscription_manager)
     msg.mutable_subscribe()->set_key("key");
 
     // nothing should happen...
-    crud.handle_request(msg, nullptr);
+    crud->handle_request(msg, nullptr);
 
     // try again with a valid session...
     auto mock_session = std::make_shared<bzn::Mocksession_base>();
@@ -534,7 +615,7 @@ TEST(crud, test_that_subscribe_request_calls_subscription_manager)
 
     EXPECT_CALL(*mock_session, send_message(An<std::shared_ptr<std::string>>(), false));
 
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
 }
 
 
@@ -542,11 +623,11 @@ TEST(crud, test_that_unsubscribe_request_calls_subscription_manager)
 {
     auto mock_subscription_manager = std::make_shared<bzn::Mocksubscription_manager_base>();
 
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), mock_subscription_manager);
+    auto crud = std::make_shared<bzn::crud>(make_io_context(), std::make_shared<bzn::mem_storage>(), mock_subscription_manager);
 
     EXPECT_CALL(*mock_subscription_manager, start());
 
-    crud.start();
+    crud->start();
 
     // unsubscribe...
     database_msg msg;
@@ -557,7 +638,7 @@ TEST(crud, test_that_unsubscribe_request_calls_subscription_manager)
     msg.mutable_unsubscribe()->set_transaction_id(321);
 
     // nothing should happen...
-    crud.handle_request(msg, nullptr);
+    crud->handle_request(msg, nullptr);
     
     auto mock_session = std::make_shared<bzn::Mocksession_base>();
 
@@ -566,15 +647,15 @@ TEST(crud, test_that_unsubscribe_request_calls_subscription_manager)
 
     EXPECT_CALL(*mock_session, send_message(An<std::shared_ptr<std::string>>(), false));
 
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
 }
 
 
 TEST(crud, test_that_has_db_request_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
+    auto crud = std::make_shared<bzn::crud>(make_io_context(), std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
 
-    crud.start();
+    crud->start();
 
     // has db...
     database_msg msg;
@@ -584,7 +665,7 @@ TEST(crud, test_that_has_db_request_sends_proper_response)
     msg.mutable_has_db();
 
     // nothing should happen...
-    crud.handle_request(msg, nullptr);
+    crud->handle_request(msg, nullptr);
 
     auto mock_session = std::make_shared<bzn::Mocksession_base>();
 
@@ -597,15 +678,15 @@ TEST(crud, test_that_has_db_request_sends_proper_response)
             ASSERT_EQ(resp.error().message(), bzn::MSG_RECORD_NOT_FOUND);
         }));
 
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
 }
 
 
 TEST(crud, test_that_create_db_request_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
+    auto crud = std::make_shared<bzn::crud>(make_io_context(), std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
 
-    crud.start();
+    crud->start();
 
     // create database...
     database_msg msg;
@@ -625,7 +706,7 @@ TEST(crud, test_that_create_db_request_sends_proper_response)
             ASSERT_EQ(resp.response_case(), database_response::RESPONSE_NOT_SET);
         }));
 
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
 
     EXPECT_CALL(*mock_session, send_message(An<std::shared_ptr<std::string>>(), false)).WillOnce(Invoke(
         [](std::shared_ptr<bzn::encoded_message> msg, bool /*end_session*/)
@@ -638,15 +719,15 @@ TEST(crud, test_that_create_db_request_sends_proper_response)
         }));
 
     // try to create it again...
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
 }
 
 
 TEST(crud, test_that_delete_db_sends_proper_response)
 {
-    bzn::crud crud(std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
+    auto crud = std::make_shared<bzn::crud>(make_io_context(), std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
 
-    crud.start();
+    crud->start();
 
     // delete database...
     database_msg msg;
@@ -666,7 +747,7 @@ TEST(crud, test_that_delete_db_sends_proper_response)
             ASSERT_EQ(resp.error().message(), bzn::MSG_RECORD_NOT_FOUND);
         }));
 
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
 
     // create a database...
     msg.release_delete_db();
@@ -674,7 +755,7 @@ TEST(crud, test_that_delete_db_sends_proper_response)
 
     EXPECT_CALL(*mock_session, send_message(An<std::shared_ptr<std::string>>(), false));
 
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
 
     // delete database...
     msg.release_create_db();
@@ -690,5 +771,289 @@ TEST(crud, test_that_delete_db_sends_proper_response)
             ASSERT_EQ(resp.response_case(), database_response::RESPONSE_NOT_SET);
         }));
 
-    crud.handle_request(msg, mock_session);
+    crud->handle_request(msg, mock_session);
+}
+
+
+TEST(crud, test_that_multi_operations_send_proper_responses)
+{
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
+
+    database_msg msg;
+
+    msg.mutable_header()->set_db_uuid("uuid");
+    msg.mutable_header()->set_transaction_id(uint64_t(123));
+    msg.mutable_create_db();
+
+    crud.handle_request(msg, nullptr);
+
+    auto session = std::make_shared<bzn::Mocksession_base>();
+
+    const auto expect_response = [&](database_response::ResponseCase response_case, const std::string& error = "")
+    {
+        EXPECT_CALL(*session, send_message(An<std::shared_ptr<std::string>>(), false)).WillOnce(Invoke(
+            [=](auto msg, auto)
+            {
+                database_response resp;
+                ASSERT_TRUE(resp.ParseFromString(*msg));
+                ASSERT_EQ(resp.header().db_uuid(), "uuid");
+                ASSERT_EQ(resp.header().transaction_id(), uint64_t(123));
+                ASSERT_EQ(resp.response_case(), response_case);
+                ASSERT_EQ(resp.error().message(), error);
+            }));
+    };
+
+    // create three keys in one request...
+    msg.release_create_db();
+
+    for (const auto& key : {"key0", "key1", "key2"})
+    {
+        auto record = msg.mutable_multi_create()->add_records();
+        record->set_key(key);
+        record->set_value("value");
+    }
+
+    expect_response(database_response::RESPONSE_NOT_SET);
+    crud.handle_request(msg, session);
+
+    // creating them again fails and nothing from the batch is written...
+    msg.mutable_multi_create()->mutable_records(0)->set_key("key3");
+
+    expect_response(database_response::kError, bzn::MSG_RECORD_EXISTS);
+    crud.handle_request(msg, session);
+
+    // update with one missing key is rejected...
+    msg.release_multi_create();
+
+    auto record = msg.mutable_multi_update()->add_records();
+    record->set_key("key0");
+    record->set_value("new-value");
+    record = msg.mutable_multi_update()->add_records();
+    record->set_key("key3");
+    record->set_value("new-value");
+
+    expect_response(database_response::kError, bzn::MSG_RECORD_NOT_FOUND);
+    crud.handle_request(msg, session);
+
+    msg.mutable_multi_update()->mutable_records()->RemoveLast();
+
+    expect_response(database_response::RESPONSE_NOT_SET);
+    crud.handle_request(msg, session);
+
+    // read back, missing keys are left out...
+    msg.release_multi_update();
+    msg.mutable_multi_read()->add_keys("key0");
+    msg.mutable_multi_read()->add_keys("key1");
+    msg.mutable_multi_read()->add_keys("key3");
+
+    EXPECT_CALL(*session, send_message(An<std::shared_ptr<std::string>>(), false)).WillOnce(Invoke(
+        [&](auto msg, auto)
+        {
+            database_response resp;
+            ASSERT_TRUE(resp.ParseFromString(*msg));
+            ASSERT_EQ(resp.response_case(), database_response::kMultiRead);
+            ASSERT_EQ(resp.multi_read().records_size(), 2);
+            ASSERT_EQ(resp.multi_read().records(0).key(), "key0");
+            ASSERT_EQ(resp.multi_read().records(0).value(), "new-value");
+            ASSERT_EQ(resp.multi_read().records(1).key(), "key1");
+            ASSERT_EQ(resp.multi_read().records(1).value(), "value");
+        }));
+
+    crud.handle_request(msg, session);
+
+    // delete...
+    msg.release_multi_read();
+    msg.mutable_multi_delete()->add_keys("key0");
+    msg.mutable_multi_delete()->add_keys("key1");
+    msg.mutable_multi_delete()->add_keys("key2");
+
+    expect_response(database_response::RESPONSE_NOT_SET);
+    crud.handle_request(msg, session);
+
+    expect_response(database_response::kError, bzn::MSG_RECORD_NOT_FOUND);
+    crud.handle_request(msg, session);
+}
+
+
+TEST(crud, test_that_range_and_prefix_send_proper_responses)
+{
+    bzn::crud crud(make_io_context(), std::make_shared<bzn::mem_storage>(), nullptr);
+
+    database_msg msg;
+
+    msg.mutable_header()->set_db_uuid("uuid");
+    msg.mutable_header()->set_transaction_id(uint64_t(123));
+    msg.mutable_create_db();
+
+    crud.handle_request(msg, nullptr);
+
+    msg.release_create_db();
+
+    for (const auto& key : {"2018-01", "2018-02", "2018-03", "2019-01"})
+    {
+        msg.mutable_create()->set_key(key);
+        msg.mutable_create()->set_value(std::string("value-") + key);
+
+        crud.handle_request(msg, nullptr);
+    }
+
+    auto session = std::make_shared<bzn::Mocksession_base>();
+
+    const auto expect_records = [&](const std::vector<std::string>& keys, bool more)
+    {
+        EXPECT_CALL(*session, send_message(An<std::shared_ptr<std::string>>(), false)).WillOnce(Invoke(
+            [=](auto msg, auto)
+            {
+                database_response resp;
+                ASSERT_TRUE(resp.ParseFromString(*msg));
+                ASSERT_EQ(resp.header().db_uuid(), "uuid");
+                ASSERT_EQ(resp.header().transaction_id(), uint64_t(123));
+                ASSERT_EQ(resp.response_case(), database_response::kRange);
+                ASSERT_EQ(resp.range().records_size(), int(keys.size()));
+                ASSERT_EQ(resp.range().more(), more);
+
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    ASSERT_EQ(resp.range().records(i).key(), keys[i]);
+                    ASSERT_EQ(resp.range().records(i).value(), "value-" + keys[i]);
+                }
+            }));
+    };
+
+    // first page of a range...
+    msg.release_create();
+    msg.mutable_range()->set_start("2018-02");
+    msg.mutable_range()->set_limit(2);
+
+    expect_records({"2018-02", "2018-03"}, true);
+    crud.handle_request(msg, session);
+
+    // next page...
+    msg.mutable_range()->set_start(std::string("2018-03") + '\0');
+
+    expect_records({"2019-01"}, false);
+    crud.handle_request(msg, session);
+
+    // latest records of a prefix first...
+    msg.release_range();
+    msg.mutable_prefix()->set_prefix("2018-");
+    msg.mutable_prefix()->set_reverse(true);
+
+    expect_records({"2018-03", "2018-02", "2018-01"}, false);
+    crud.handle_request(msg, session);
+
+    // null session nothing should happen...
+    crud.handle_request(msg, nullptr);
+}
+
+
+TEST(crud, test_that_records_expire_at_the_agreed_request_time)
+{
+    auto storage = std::make_shared<bzn::mem_storage>();
+
+    // capture the expiry timer so the test can fire it...
+    bzn::asio::wait_handler expiry_handler;
+
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+
+    EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillRepeatedly(Invoke(
+        [&]()
+        {
+            auto mock_steady_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+            EXPECT_CALL(*mock_steady_timer, async_wait(_)).WillRepeatedly(Invoke(
+                [&](auto handler)
+                {
+                    expiry_handler = handler;
+                }));
+
+            return mock_steady_timer;
+        }));
+
+    auto crud = std::make_shared<bzn::crud>(mock_io_context, storage, std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
+
+    crud->start();
+
+    auto session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+
+    database_response resp;
+
+    EXPECT_CALL(*session, send_message(An<std::shared_ptr<std::string>>(), false)).WillRepeatedly(Invoke(
+        [&](auto msg, auto)
+        {
+            resp.Clear();
+            ASSERT_TRUE(resp.ParseFromString(*msg));
+        }));
+
+    const auto request = [&](const std::string& uuid, uint64_t timestamp, auto&& set_msg)
+    {
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid(uuid);
+        msg.mutable_header()->set_timestamp(timestamp);
+        set_msg(msg);
+
+        crud->handle_request(msg, session);
+
+        return resp.has_error() ? resp.error().message() : std::string("ok");
+    };
+
+    const auto create = [&](const std::string& key, uint64_t timestamp, uint64_t expire)
+    {
+        return request("uuid", timestamp, [&](auto& msg) { msg.mutable_create()->set_key(key); msg.mutable_create()->set_value("value"); msg.mutable_create()->set_expire(expire); });
+    };
+
+    const auto has = [&](const std::string& key, uint64_t timestamp)
+    {
+        return request("uuid", timestamp, [&](auto& msg) { msg.mutable_has()->set_key(key); }) == "ok";
+    };
+
+    EXPECT_EQ(request("uuid", 1000, [](auto& msg) { msg.mutable_create_db(); }), "ok");
+
+    // expires ten seconds after the request that created it...
+    EXPECT_EQ(create("key", 1000, 10), "ok");
+    EXPECT_EQ(create("forever", 1000, 0), "ok");
+
+    EXPECT_TRUE(has("key", 10999));
+    EXPECT_FALSE(has("key", 11000));
+    EXPECT_FALSE(storage->has("uuid", "key"));
+
+    // an older request time does not bring it back...
+    EXPECT_FALSE(has("key", 5000));
+    EXPECT_EQ(create("key", 5000, 10), "ok");
+    EXPECT_TRUE(has("key", 20999));
+
+    // an update without an expiry keeps the record...
+    EXPECT_EQ(request("uuid", 20000, [](auto& msg) { msg.mutable_update()->set_key("key"); msg.mutable_update()->set_value("new"); }), "ok");
+    EXPECT_TRUE(has("key", 100000));
+    EXPECT_TRUE(has("forever", 100000));
+
+    // the timer only removes what has expired by the latest request time...
+    EXPECT_EQ(create("swept", 100000, 1), "ok");
+
+    expiry_handler(boost::system::error_code());
+    EXPECT_TRUE(storage->has("uuid", "swept"));
+
+    request("other", 101000, [](auto& msg) { msg.mutable_has_db(); });
+    EXPECT_TRUE(storage->has("uuid", "swept"));
+
+    expiry_handler(boost::system::error_code());
+    EXPECT_FALSE(storage->has("uuid", "swept"));
+
+    // expiries survive a restart...
+    EXPECT_EQ(create("restart", 101000, 1), "ok");
+
+    crud = std::make_shared<bzn::crud>(mock_io_context, storage, std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
+    crud->start();
+
+    EXPECT_TRUE(has("restart", 101999));
+    EXPECT_FALSE(has("restart", 102000));
+
+    // deleting the database drops its expiries...
+    EXPECT_EQ(create("dropped", 102000, 1), "ok");
+    EXPECT_EQ(request("uuid", 102000, [](auto& msg) { msg.mutable_delete_db(); }), "ok");
+    EXPECT_TRUE(storage->get_keys("TTL").empty());
+
+    // nor can a client take over the database the expiries are kept in...
+    EXPECT_EQ(request("TTL", 102000, [](auto& msg) { msg.mutable_create_db(); }), bzn::MSG_RECORD_EXISTS);
+    EXPECT_EQ(request("PERMS", 102000, [](auto& msg) { msg.mutable_create_db(); }), bzn::MSG_RECORD_EXISTS);
 }
@@ -13,9 +13,11 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <crypto/crypto.hpp>
+#include <proto/pbft.pb.h>
 #include <openssl/pem.h>
 #include <openssl/err.h>
 #include <openssl/crypto.h>
+#include <openssl/hmac.h>
 
 using namespace bzn;
 
@@ -23,15 +25,28 @@ namespace
 {
     const std::string PEM_PREFIX = "-----BEGIN PUBLIC KEY-----\n";
     const std::string PEM_SUFFIX = "\n-----END PUBLIC KEY-----\n";
+
+    const size_t MAX_CACHED_KEYS = 1024;
+
+
+    // only prepares and commits are never shown to a third party, everything else has to be signed...
+    bool
+    may_be_authenticated(const bzn_envelope& msg)
+    {
+        pbft_msg inner;
+
+        return msg.payload_case() == bzn_envelope::kPbft && inner.ParseFromString(msg.pbft())
+            && (inner.type() == PBFT_MSG_PREPARE || inner.type() == PBFT_MSG_COMMIT);
+    }
 }
 
 crypto::crypto(std::shared_ptr<bzn::options_base> options)
         : options(std::move(options))
 {
     LOG(info) << "Using " << SSLeay_version(SSLEAY_VERSION);
-    if(this->options->get_simple_options().get<bool>(bzn::option_names::CRYPTO_ENABLED_OUTGOING))
+    if(this->options->get_simple_options().get<bool>(bzn::option_names::CRYPTO_ENABLED_OUTGOING) && this->load_private_key())
     {
-        this->load_private_key();
+        this->uuid = this->options->get_uuid();
     }
 }
 
@@ -75,12 +90,20 @@ crypto::extract_payload(const bzn_envelope& msg)
 bool
 crypto::verify(const bzn_envelope& msg)
 {
-    BIO_ptr_t bio(BIO_new(BIO_s_mem()), &BIO_free);
-    EC_KEY_ptr_t pubkey(nullptr, &EC_KEY_free);
-    EVP_PKEY_ptr_t key(EVP_PKEY_new(), &EVP_PKEY_free);
+    if (msg.signature().empty() && !msg.authenticator().empty())
+    {
+        return may_be_authenticated(msg) && this->verify_authenticator(msg);
+    }
+
+    return this->verify_signature(msg);
+}
+
+bool
+crypto::verify_signature(const bzn_envelope& msg)
+{
     EVP_MD_CTX_ptr_t context(EVP_MD_CTX_create(), &EVP_MD_CTX_free);
 
-    if (!bio || !key || !context)
+    if (!context)
     {
         LOG(error) << "failed to allocate memory for signature verification";
         return false;
@@ -91,17 +114,11 @@ crypto::verify(const bzn_envelope& msg)
     std::string signature = msg.signature();
     char* sig_ptr = signature.data();
 
+    // the public key the message is allegedly from
+    const auto key = this->public_key(msg.sender());
 
     bool result =
-            // Reconstruct the PEM file in memory (this is awkward, but it avoids dealing with EC specifics)
-            (0 < BIO_write(bio.get(), PEM_PREFIX.c_str(), PEM_PREFIX.length()))
-            && (0 < BIO_write(bio.get(), msg.sender().c_str(), msg.sender().length()))
-            && (0 < BIO_write(bio.get(), PEM_SUFFIX.c_str(), PEM_SUFFIX.length()))
-
-            // Parse the PEM string to get the public key the message is allegedly from
-            && (pubkey = EC_KEY_ptr_t(PEM_read_bio_EC_PUBKEY(bio.get(), NULL, NULL, NULL), &EC_KEY_free))
-            && (1 == EC_KEY_check_key(pubkey.get()))
-            && (1 == EVP_PKEY_set1_EC_KEY(key.get(), pubkey.get()))
+            (bool) (key)
 
             // Perform the signature validation
             && (1 == EVP_DigestVerifyInit(context.get(), NULL, EVP_sha512(), NULL, key.get()))
@@ -116,6 +133,180 @@ crypto::verify(const bzn_envelope& msg)
     return result;
 }
 
+bool
+crypto::verify_authenticator(const bzn_envelope& msg)
+{
+    const auto mac = msg.authenticator().find(this->uuid);
+    if (this->uuid.empty() || mac == msg.authenticator().end())
+    {
+        return false;
+    }
+
+    const auto key = this->session_key(msg.sender());
+    if (!key)
+    {
+        return false;
+    }
+
+    const auto expected = this->mac(*key, this->extract_payload(msg));
+
+    return expected.size() == mac->second.size() && 0 == CRYPTO_memcmp(expected.data(), mac->second.data(), expected.size());
+}
+
+bool
+crypto::authenticate(bzn_envelope& msg, const std::vector<bzn::uuid_t>& recipients)
+{
+    if (msg.sender().empty())
+    {
+        msg.set_sender(this->uuid);
+    }
+
+    if (this->uuid.empty() || msg.sender() != this->uuid)
+    {
+        LOG(error) << "Cannot authenticate message purportedly sent by " << msg.sender() << " (do we have a valid private key?)";
+        return false;
+    }
+
+    if (!may_be_authenticated(msg))
+    {
+        LOG(error) << "Only pbft prepares and commits may be sent with authenticators instead of a signature";
+        return false;
+    }
+
+    const auto& payload = this->extract_payload(msg);
+    bool result = true;
+
+    for (const auto& recipient : recipients)
+    {
+        if (const auto key = this->session_key(recipient))
+        {
+            (*msg.mutable_authenticator())[recipient] = this->mac(*key, payload);
+        }
+        else
+        {
+            // they will drop the message, as they would one with a bad signature
+            LOG(error) << "Failed to derive a session key with " << recipient;
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+std::shared_ptr<EVP_PKEY>
+crypto::public_key(const bzn::uuid_t& uuid)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->keys_lock);
+
+        if (const auto it = this->public_keys.find(uuid); it != this->public_keys.end())
+        {
+            return it->second;
+        }
+    }
+
+    BIO_ptr_t bio(BIO_new(BIO_s_mem()), &BIO_free);
+    EC_KEY_ptr_t pubkey(nullptr, &EC_KEY_free);
+    std::shared_ptr<EVP_PKEY> key(EVP_PKEY_new(), &EVP_PKEY_free);
+
+    if (!bio || !key)
+    {
+        LOG(error) << "failed to allocate memory for public key";
+        return nullptr;
+    }
+
+    bool result =
+            // Reconstruct the PEM file in memory (this is awkward, but it avoids dealing with EC specifics)
+            (0 < BIO_write(bio.get(), PEM_PREFIX.c_str(), PEM_PREFIX.length()))
+            && (0 < BIO_write(bio.get(), uuid.c_str(), uuid.length()))
+            && (0 < BIO_write(bio.get(), PEM_SUFFIX.c_str(), PEM_SUFFIX.length()))
+
+            // Parse the PEM string to get the public key
+            && (pubkey = EC_KEY_ptr_t(PEM_read_bio_EC_PUBKEY(bio.get(), NULL, NULL, NULL), &EC_KEY_free))
+            && (1 == EC_KEY_check_key(pubkey.get()))
+            && (1 == EVP_PKEY_set1_EC_KEY(key.get(), pubkey.get()));
+
+    // as for a bad signature, a bad key is the sender's problem rather than ours
+    ERR_clear_error();
+
+    if (!result)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(this->keys_lock);
+
+    if (this->public_keys.size() >= MAX_CACHED_KEYS)
+    {
+        this->public_keys.clear();
+    }
+
+    return this->public_keys.emplace(uuid, std::move(key)).first->second;
+}
+
+std::optional<std::string>
+crypto::session_key(const bzn::uuid_t& peer)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->keys_lock);
+
+        if (const auto it = this->session_keys.find(peer); it != this->session_keys.end())
+        {
+            return it->second;
+        }
+    }
+
+    const auto key = this->public_key(peer);
+    EVP_PKEY_CTX_ptr_t context(this->private_key_EVP ? EVP_PKEY_CTX_new(this->private_key_EVP.get(), NULL) : nullptr, &EVP_PKEY_CTX_free);
+    size_t secret_length = 0;
+
+    bool result =
+            (bool) (key)
+            && (bool) (context)
+            && (1 == EVP_PKEY_derive_init(context.get()))
+            && (1 == EVP_PKEY_derive_set_peer(context.get(), key.get()))
+            && (1 == EVP_PKEY_derive(context.get(), NULL, &secret_length));
+
+    std::string secret(secret_length, '\0');
+
+    result = result && (1 == EVP_PKEY_derive(context.get(), reinterpret_cast<unsigned char*>(secret.data()), &secret_length));
+
+    ERR_clear_error();
+
+    if (!result)
+    {
+        return std::nullopt;
+    }
+
+    secret.resize(secret_length);
+    auto shared_key = this->hash(secret);
+    OPENSSL_cleanse(secret.data(), secret.size());
+
+    std::lock_guard<std::mutex> lock(this->keys_lock);
+
+    if (this->session_keys.size() >= MAX_CACHED_KEYS)
+    {
+        this->session_keys.clear();
+    }
+
+    return this->session_keys.emplace(peer, std::move(shared_key)).first->second;
+}
+
+std::string
+crypto::mac(const std::string& key, const std::string& data)
+{
+    unsigned char result[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+
+    if (!HMAC(EVP_sha256(), key.data(), key.size(), reinterpret_cast<const unsigned char*>(data.data()), data.size(), result, &length))
+    {
+        this->log_openssl_errors();
+        throw std::runtime_error("failed to compute message MAC");
+    }
+
+    return std::string(reinterpret_cast<char*>(result), length);
+}
+
 bool
 crypto::sign(bzn_envelope& msg)
 {
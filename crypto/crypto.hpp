@@ -20,6 +20,10 @@
 #include <proto/bluzelle.pb.h>
 #include <openssl/evp.h>
 #include <openssl/ec.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 namespace bzn
 {
@@ -33,6 +37,8 @@ namespace bzn
 
         bool verify(const bzn_envelope& msg) override;
 
+        bool authenticate(bzn_envelope& msg, const std::vector<bzn::uuid_t>& recipients) override;
+
         std::string hash(const std::string& msg) override;
 
     private:
@@ -41,6 +47,7 @@ namespace bzn
         using EVP_PKEY_ptr_t = std::unique_ptr<EVP_PKEY, decltype(&::EVP_PKEY_free)>;
         using BIO_ptr_t = std::unique_ptr<BIO, decltype(&::BIO_free)>;
         using EVP_MD_CTX_ptr_t = std::unique_ptr<EVP_MD_CTX, decltype(&::EVP_MD_CTX_free)>;
+        using EVP_PKEY_CTX_ptr_t = std::unique_ptr<EVP_PKEY_CTX, decltype(&::EVP_PKEY_CTX_free)>;
 
         bool load_private_key();
 
@@ -48,10 +55,28 @@ namespace bzn
 
         const std::string& extract_payload(const bzn_envelope& msg);
 
+        bool verify_signature(const bzn_envelope& msg);
+
+        bool verify_authenticator(const bzn_envelope& msg);
+
+        // the public key a uuid names, parsed once...
+        std::shared_ptr<EVP_PKEY> public_key(const bzn::uuid_t& uuid);
+
+        // the key we share with a peer: the hash of the ECDH secret between our key pair and theirs, derived once...
+        std::optional<std::string> session_key(const bzn::uuid_t& peer);
+
+        std::string mac(const std::string& key, const std::string& data);
+
         std::shared_ptr<bzn::options_base> options;
 
         EVP_PKEY_ptr_t private_key_EVP = EVP_PKEY_ptr_t(nullptr, &EVP_PKEY_free);
         EC_KEY_ptr_t private_key_EC = EC_KEY_ptr_t(nullptr, &EC_KEY_free);
+        bzn::uuid_t uuid; // ours, known once the private key is loaded
+
+        // anyone can name any key as a message's sender, so these are dropped once they grow too large...
+        std::unordered_map<bzn::uuid_t, std::shared_ptr<EVP_PKEY>> public_keys;
+        std::unordered_map<bzn::uuid_t, std::string> session_keys;
+        std::mutex keys_lock;
 
     };
 }
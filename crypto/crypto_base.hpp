@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <include/bluzelle.hpp>
 #include <proto/bluzelle.pb.h>
 
 namespace bzn
@@ -29,12 +30,22 @@ namespace bzn
         virtual bool sign(bzn_envelope& msg) = 0;
 
         /*
-         * verify that the signature on a message is correct and matches its sender
+         * verify that the signature on a message is correct and matches its sender, or for a message carrying an
+         * authenticator in place of a signature, that the MAC it holds for us does
          * @msg message to verify
-         * @return signature is present, valid and matches sender
+         * @return signature or MAC is present, valid and matches sender
          */
         virtual bool verify(const bzn_envelope& msg) = 0;
 
+        /*
+         * authenticate a message to its recipients with a MAC for each, under a key derived from our key pair and
+         * theirs. Much cheaper than a signature, but it convinces only those recipients and cannot be shown to others
+         * @msg message to authenticate
+         * @recipients uuids of the nodes it will be sent to
+         * @return if there is a MAC for every recipient
+         */
+        virtual bool authenticate(bzn_envelope& msg, const std::vector<bzn::uuid_t>& recipients) = 0;
+
         /*
          * Compute the hash of some message
          * @msg data
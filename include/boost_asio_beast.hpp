@@ -392,6 +392,8 @@ namespace bzn::beast
 
         virtual size_t write(const boost::asio::mutable_buffers_1& buffer, boost::beast::error_code& ec) = 0;
 
+        virtual size_t write_buffers(const std::vector<boost::asio::const_buffer>& buffers, boost::beast::error_code& ec) = 0;
+
         virtual void async_close(boost::beast::websocket::close_code reason, bzn::beast::close_handler handler) = 0;
 
         virtual void async_handshake(const std::string& host, const std::string& target, bzn::beast::handshake_handler handler) = 0;
@@ -434,6 +436,11 @@ namespace bzn::beast
             return this->websocket.write(buffer, ec);
         }
 
+        size_t write_buffers(const std::vector<boost::asio::const_buffer>& buffers, boost::beast::error_code& ec) override
+        {
+            return this->websocket.write(buffers, ec);
+        }
+
         void async_close(boost::beast::websocket::close_code reason, bzn::beast::close_handler handler) override
         {
             this->websocket.async_close(reason, handler);
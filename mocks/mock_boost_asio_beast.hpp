@@ -150,6 +150,8 @@ namespace bzn::beast {
             void(const boost::asio::mutable_buffers_1& buffer, bzn::asio::write_handler handler));
         MOCK_METHOD2(write,
             size_t(const boost::asio::mutable_buffers_1& buffer, boost::beast::error_code& ec));
+        MOCK_METHOD2(write_buffers,
+            size_t(const std::vector<boost::asio::const_buffer>& buffers, boost::beast::error_code& ec));
         MOCK_METHOD2(async_close,
             void(boost::beast::websocket::close_code reason, bzn::beast::close_handler handler));
         MOCK_METHOD3(async_handshake,
@@ -55,6 +55,14 @@ class mock_options_base : public options_base {
       size_t());
   MOCK_CONST_METHOD0(get_mem_storage,
       bool());
+  MOCK_CONST_METHOD0(get_mem_storage_budget,
+      size_t());
+  MOCK_CONST_METHOD0(get_storage_cache_size,
+      size_t());
+  MOCK_CONST_METHOD0(get_storage_compression_threshold,
+      size_t());
+  MOCK_CONST_METHOD0(get_rocksdb_tuning,
+      bzn::rocksdb_tuning());
   MOCK_CONST_METHOD0(get_logfile_rotation_size,
       size_t());
   MOCK_CONST_METHOD0(get_logfile_max_size,
@@ -39,12 +39,26 @@ namespace bzn {
                      std::string(storage_base::result error_id));
         MOCK_METHOD1(get_keys,
                      std::vector<std::string>(const bzn::uuid_t& uuid));
+        MOCK_METHOD4(get_keys,
+                     std::vector<std::string>(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix));
         MOCK_METHOD2(has,
                      bool(const bzn::uuid_t& uuid, const std::string& key));
+        MOCK_METHOD5(get_range,
+                     std::vector<bzn::key_value_t>(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse));
         MOCK_METHOD1(get_size,
                      std::pair<std::size_t, std::size_t>(const bzn::uuid_t& uuid));
         MOCK_METHOD1(remove,
                      storage_base::result(const bzn::uuid_t& uuid));
+        MOCK_METHOD2(multi_create,
+                     storage_base::result(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records));
+        MOCK_METHOD2(multi_read,
+                     std::vector<std::optional<bzn::value_t>>(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys));
+        MOCK_METHOD2(multi_update,
+                     storage_base::result(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records));
+        MOCK_METHOD2(multi_remove,
+                     storage_base::result(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys));
+        MOCK_METHOD0(get_snapshot,
+                     std::shared_ptr<bzn::storage_snapshot_base>());
     };
 
 }  // namespace bzn
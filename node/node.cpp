@@ -145,7 +145,22 @@ node::priv_msg_handler(const Json::Value& msg, std::shared_ptr<bzn::session_base
 void
 node::priv_protobuf_handler(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session)
 {
-    std::lock_guard<std::mutex> lock(this->message_map_mutex);
+    // only the lookup is guarded, so messages are verified and handled in parallel...
+    bzn::protobuf_handler handler;
+    {
+        std::lock_guard<std::mutex> lock(this->message_map_mutex);
+
+        if (auto it = this->protobuf_map.find(msg.payload_case()); it != this->protobuf_map.end())
+        {
+            handler = it->second;
+        }
+    }
+
+    if (!handler)
+    {
+        LOG(debug) << "no handler for message type " << msg.payload_case();
+        return;
+    }
 
     if (this->options->get_simple_options().get<bool>(bzn::option_names::CRYPTO_ENABLED_INCOMING)
         && (!msg.sender().empty())
@@ -156,15 +171,7 @@ node::priv_protobuf_handler(const bzn_envelope& msg, std::shared_ptr<bzn::sessio
         return;
     }
 
-    if (auto it = this->protobuf_map.find(msg.payload_case()); it != this->protobuf_map.end())
-    {
-        it->second(msg, std::move(session));
-    }
-    else
-    {
-        LOG(debug) << "no handler for message type " << msg.payload_case();
-    }
-
+    handler(msg, std::move(session));
 }
 
 void
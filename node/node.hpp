@@ -49,6 +49,7 @@ namespace bzn
     private:
         FRIEND_TEST(node, test_that_registered_message_handler_is_invoked);
         FRIEND_TEST(node, test_that_wrongly_signed_messages_are_dropped);
+        FRIEND_TEST(node, test_that_protobuf_messages_are_handled_in_parallel);
 
         void do_accept();
 
@@ -140,6 +140,41 @@ session::send_message(std::shared_ptr<bzn::encoded_message> msg, const bool end_
     boost::beast::error_code ec;
     this->websocket->write(boost::asio::buffer(*msg), ec);
 
+    this->finish_write(ec, end_session);
+}
+
+
+void
+session::send_buffers(const std::vector<boost::asio::const_buffer>& buffers, std::shared_ptr<const void> owner, const bool end_session)
+{
+    if (this->chaos->is_message_delayed())
+    {
+        this->chaos->reschedule_message(std::bind(&session::send_buffers, shared_from_this(), buffers, std::move(owner), end_session));
+        return;
+    }
+
+    if (this->chaos->is_message_dropped())
+    {
+        return;
+    }
+
+    this->idle_timer->cancel(); // kill timer for duration of write...
+
+    std::lock_guard<std::mutex> lock(this->write_lock);
+
+    this->websocket->get_websocket().binary(true);
+
+    // gathered straight from the callers buffers into the frame...
+    boost::beast::error_code ec;
+    this->websocket->write_buffers(buffers, ec);
+
+    this->finish_write(ec, end_session);
+}
+
+
+void
+session::finish_write(const boost::beast::error_code& ec, const bool end_session)
+{
     if (ec)
     {
         LOG(error) << "websocket write failed: " << ec.message();
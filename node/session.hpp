@@ -39,6 +39,8 @@ namespace bzn
 
         void send_message(std::shared_ptr<bzn::encoded_message> msg, bool end_session) override;
 
+        void send_buffers(const std::vector<boost::asio::const_buffer>& buffers, std::shared_ptr<const void> owner, bool end_session) override;
+
         void send_datagram(std::shared_ptr<bzn::encoded_message> msg) override;
 
         void close() override;
@@ -50,6 +52,8 @@ namespace bzn
 
         void start_idle_timeout();
 
+        void finish_write(const boost::beast::error_code& ec, bool end_session);
+
         std::unique_ptr<bzn::asio::strand_base> strand;
         const bzn::session_id session_id;
 
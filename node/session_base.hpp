@@ -16,6 +16,8 @@
 
 #include <include/bluzelle.hpp>
 #include <proto/bluzelle.pb.h>
+#include <boost/asio/buffer.hpp>
+#include <vector>
 
 
 namespace bzn
@@ -55,6 +57,25 @@ namespace bzn
          */
         virtual void send_message(std::shared_ptr<bzn::encoded_message> msg, bool end_session) = 0;
 
+        /**
+         * Send a message made up of several buffers without joining them into one string first
+         * @param buffers message fragments, sent in order as a single message
+         * @param owner keeps the memory the buffers refer to alive until they have been sent
+         * @param end_session close connection after send
+         */
+        virtual void send_buffers(const std::vector<boost::asio::const_buffer>& buffers, std::shared_ptr<const void> /*owner*/, bool end_session)
+        {
+            auto msg = std::make_shared<bzn::encoded_message>();
+            msg->reserve(boost::asio::buffer_size(buffers));
+
+            for (const auto& buffer : buffers)
+            {
+                msg->append(static_cast<const char*>(buffer.data()), buffer.size());
+            }
+
+            this->send_message(msg, end_session);
+        }
+
         /**
          * Send a message with no expected response
          * @param msg message
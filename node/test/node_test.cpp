@@ -26,6 +26,9 @@
 
 #include <proto/bluzelle.pb.h>
 
+#include <condition_variable>
+#include <thread>
+
 using namespace ::testing;
 
 namespace
@@ -205,6 +208,50 @@ namespace  bzn
         EXPECT_EQ(callback_execute, 1u);
     }
 
+    TEST(node, test_that_protobuf_messages_are_handled_in_parallel)
+    {
+        auto mock_chaos = std::make_shared<NiceMock<bzn::mock_chaos_base>>();
+        auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+        auto options = std::make_shared<bzn::options>();
+        options->get_mutable_simple_options().set(bzn::option_names::CRYPTO_ENABLED_INCOMING, "true");
+        auto crypto = std::make_shared<bzn::crypto>(options);
+        auto node = std::make_shared<bzn::node>(mock_io_context, nullptr, mock_chaos, std::chrono::milliseconds(0), TEST_ENDPOINT, crypto, options);
+
+        // each handler waits for the other to be running at the same time...
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t running = 0;
+        size_t most_running = 0;
+
+        node->register_for_message(bzn_envelope::kPbft, [&](const auto& /*msg*/, auto)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            most_running = std::max(most_running, ++running);
+            cv.notify_all();
+            cv.wait_for(lock, std::chrono::seconds(5), [&]{ return most_running > 1; });
+            --running;
+        });
+
+        bzn_envelope msg;
+        msg.set_pbft("some stuff");
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < 2; ++i)
+        {
+            threads.emplace_back([&]()
+            {
+                node->priv_protobuf_handler(msg, std::make_shared<NiceMock<bzn::Mocksession_base>>());
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        EXPECT_EQ(size_t(2), most_running);
+    }
+
 
     TEST(node, test_that_send_msg_connects_and_performs_handshake)
     {
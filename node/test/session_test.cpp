@@ -260,4 +260,67 @@ namespace bzn
         session->send_message(std::make_shared<bzn::json_message>("asdf"), false);
     }
 
+
+    TEST(node_session, test_that_buffers_are_sent_without_being_joined)
+    {
+        auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        auto mock_strand = std::make_unique<bzn::asio::Mockstrand_base>();
+        auto mock_steady_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+        auto mock_chaos = std::make_shared<NiceMock<bzn::mock_chaos_base>>();
+
+        EXPECT_CALL(*mock_strand, wrap(An<bzn::asio::close_handler>())).WillRepeatedly(Invoke(
+            [&](bzn::asio::close_handler handler)
+            {
+                return handler;
+            }));
+
+        EXPECT_CALL(*mock_strand, wrap(An<bzn::asio::read_handler>())).WillRepeatedly(Invoke(
+            [&](bzn::asio::read_handler handler)
+            {
+                return handler;
+            }));
+
+        EXPECT_CALL(*mock_io_context, make_unique_strand()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(mock_strand);
+            }));
+
+        EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(mock_steady_timer);
+            }));
+
+        auto mock_websocket_stream = std::make_shared<bzn::beast::Mockwebsocket_stream_base>();
+
+        auto session = std::make_shared<bzn::session>(mock_io_context, bzn::session_id(1), mock_websocket_stream, mock_chaos, std::chrono::milliseconds(0));
+
+        boost::asio::io_context io;
+        boost::beast::websocket::stream<boost::asio::ip::tcp::socket> socket(io);
+        EXPECT_CALL(*mock_websocket_stream, get_websocket()).WillRepeatedly(ReturnRef(socket));
+
+        const std::string header{"header"};
+        const auto value = std::make_shared<const std::string>("value");
+
+        // the value is written from where it lives and the owner keeps it alive...
+        EXPECT_CALL(*mock_websocket_stream, write(_,_)).Times(0);
+        EXPECT_CALL(*mock_websocket_stream, write_buffers(_,_)).WillOnce(Invoke(
+            [&](const std::vector<boost::asio::const_buffer>& buffers, auto& ec)
+            {
+                EXPECT_EQ(size_t(2), buffers.size());
+                EXPECT_EQ(header.data(), buffers[0].data());
+                EXPECT_EQ(value->data(), buffers[1].data());
+                EXPECT_EQ(2, value.use_count());
+
+                ec = boost::beast::error_code();
+                return boost::asio::buffer_size(buffers);
+            }));
+
+        // read should be setup...
+        EXPECT_CALL(*mock_websocket_stream, async_read(_,_));
+
+        session->send_buffers({boost::asio::buffer(header), boost::asio::buffer(*value)}, value, false);
+    }
+
 } // bzn
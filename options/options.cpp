@@ -13,6 +13,7 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <options/options.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <regex>
 #include <cstdint>
@@ -197,6 +198,48 @@ options::get_mem_storage() const
 }
 
 
+size_t
+options::get_mem_storage_budget() const
+{
+    return this->parse_size(this->raw_opts.get<std::string>(MEM_STORAGE_BUDGET));
+}
+
+
+size_t
+options::get_storage_cache_size() const
+{
+    return this->parse_size(this->raw_opts.get<std::string>(STORAGE_CACHE_SIZE));
+}
+
+
+size_t
+options::get_storage_compression_threshold() const
+{
+    return this->parse_size(this->raw_opts.get<std::string>(STORAGE_COMPRESSION_THRESHOLD));
+}
+
+
+bzn::rocksdb_tuning
+options::get_rocksdb_tuning() const
+{
+    bzn::rocksdb_tuning tuning;
+
+    tuning.block_cache_size = this->parse_size(this->raw_opts.get<std::string>(ROCKSDB_BLOCK_CACHE_SIZE));
+    tuning.bloom_filter_bits_per_key = this->raw_opts.get<int>(ROCKSDB_BLOOM_FILTER_BITS);
+    tuning.write_buffer_size = this->parse_size(this->raw_opts.get<std::string>(ROCKSDB_WRITE_BUFFER_SIZE));
+    tuning.max_write_buffer_number = this->raw_opts.get<int>(ROCKSDB_MAX_WRITE_BUFFERS);
+    tuning.database_write_buffer_size = this->parse_size(this->raw_opts.get<std::string>(ROCKSDB_DATABASE_WRITE_BUFFER_SIZE));
+    tuning.statistics = this->raw_opts.get<bool>(ROCKSDB_STATISTICS);
+
+    if (const auto compression = this->raw_opts.get<std::string>(ROCKSDB_COMPRESSION); !compression.empty())
+    {
+        boost::split(tuning.compression, compression, boost::is_any_of(", "), boost::token_compress_on);
+    }
+
+    return tuning;
+}
+
+
 size_t
 options::get_logfile_rotation_size() const
 {
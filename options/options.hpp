@@ -59,6 +59,14 @@ namespace bzn
 
         bool get_mem_storage() const override;
 
+        size_t get_mem_storage_budget() const override;
+
+        size_t get_storage_cache_size() const override;
+
+        size_t get_storage_compression_threshold() const override;
+
+        bzn::rocksdb_tuning get_rocksdb_tuning() const override;
+
         size_t get_logfile_rotation_size() const override ;
 
         size_t get_logfile_max_size() const override;
@@ -19,6 +19,7 @@
 #include <include/bluzelle.hpp>
 #include <include/boost_asio_beast.hpp>
 #include <options/simple_options.hpp>
+#include <storage/rocksdb_tuning.hpp>
 #include <string>
 #include <map>
 #include <optional>
@@ -149,6 +150,34 @@ namespace bzn
         virtual bool get_mem_storage() const = 0;
 
 
+        /**
+         * Memory in memory storage may use before spilling records to disk
+         * @return size in bytes, 0 for no limit
+         */
+        virtual size_t get_mem_storage_budget() const = 0;
+
+
+        /**
+         * Memory for caching recently read values in front of persistent storage
+         * @return size in bytes, 0 for no cache
+         */
+        virtual size_t get_storage_cache_size() const = 0;
+
+
+        /**
+         * Smallest value compressed by persistent storage
+         * @return size in bytes, 0 to store values as they are
+         */
+        virtual size_t get_storage_compression_threshold() const = 0;
+
+
+        /**
+         * Cache, filter, compression and memtable settings for rocksdb storage
+         * @return tuning
+         */
+        virtual bzn::rocksdb_tuning get_rocksdb_tuning() const = 0;
+
+
         /**
          * Get the size of a log file to rotate
          * @return size
@@ -80,12 +80,27 @@ simple_options::build_options()
                 (MEM_STORAGE.c_str(),
                          po::value<bool>()->default_value(true),
                          "enable in memory storage for debugging")
+                (MEM_STORAGE_SHARDS.c_str(),
+                         po::value<size_t>()->default_value(1),
+                         "number of lock stripes for in memory storage (0 = one per core)")
+                (MEM_STORAGE_BUDGET.c_str(),
+                         po::value<std::string>()->default_value("0"),
+                         "memory for in memory storage, least recently used records spill to disk beyond it (0 = unbounded)")
                 (NODE_UUID.c_str(),
                         po::value<std::string>(),
                         "uuid of this node")
+                (ROCKSDB_CF_PER_DB.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "store each database in its own rocksdb column family (fixed when state is first created)")
                 (STATE_DIR.c_str(),
                         po::value<std::string>()->default_value("./.state/"),
                         "location for state files")
+                (STORAGE_CACHE_SIZE.c_str(),
+                        po::value<std::string>()->default_value("0"),
+                        "memory for caching recently read values in front of rocksdb storage (0 = no cache)")
+                (STORAGE_COMPRESSION_THRESHOLD.c_str(),
+                        po::value<std::string>()->default_value("0"),
+                        "compress rocksdb values of at least this size (0 = values are stored as is, must not change to 0 once set)")
                 (WS_IDLE_TIMEOUT.c_str(),
                         po::value<uint64_t>(),
                         "websocket idle timeout");
@@ -109,6 +124,31 @@ simple_options::build_options()
                         "enable debug logging");
     this->options_root.add(logging);
 
+    po::options_description rocksdb("RocksDB");
+    rocksdb.add_options()
+                (ROCKSDB_BLOCK_CACHE_SIZE.c_str(),
+                        po::value<std::string>()->default_value("8M"),
+                        "size of the block cache shared by all databases (0 disables it)")
+                (ROCKSDB_BLOOM_FILTER_BITS.c_str(),
+                        po::value<int>()->default_value(10),
+                        "bloom filter bits per key for point lookups (0 disables them)")
+                (ROCKSDB_COMPRESSION.c_str(),
+                        po::value<std::string>()->default_value(""),
+                        "compression for every level or a comma separated list per level: none, snappy, zlib, bzip2, lz4, lz4hc, xpress or zstd")
+                (ROCKSDB_WRITE_BUFFER_SIZE.c_str(),
+                        po::value<std::string>()->default_value("128M"),
+                        "memtable size")
+                (ROCKSDB_MAX_WRITE_BUFFERS.c_str(),
+                        po::value<int>()->default_value(6),
+                        "maximum number of memtables")
+                (ROCKSDB_DATABASE_WRITE_BUFFER_SIZE.c_str(),
+                        po::value<std::string>()->default_value("4M"),
+                        "memtable size for each database when using a column family per database")
+                (ROCKSDB_STATISTICS.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "collect rocksdb statistics and report them in the node status");
+    this->options_root.add(rocksdb);
+
     po::options_description audit("Audit");
     audit.add_options()
                 (AUDIT_ENABLED.c_str(),
@@ -133,6 +173,27 @@ simple_options::build_options()
                 (PBFT_ENABLED.c_str(),
                         po::value<bool>()->default_value(false),
                         "use pbft consensus instead of raft (experimental)")
+                (PBFT_BATCH_SIZE.c_str(),
+                        po::value<size_t>()->default_value(1),
+                        "most client requests the pbft primary orders together (1 disables batching)")
+                (PBFT_BATCH_TIMEOUT.c_str(),
+                        po::value<uint64_t>()->default_value(5),
+                        "longest a request waits for its batch to fill up")
+                (PBFT_CHECKPOINT_INTERVAL.c_str(),
+                        po::value<uint64_t>()->default_value(100),
+                        "sequences between pbft checkpoints")
+                (PBFT_DIGEST_PREPREPARES.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "send client requests to every node and have the pbft primary order only their digests (must match across the swarm)")
+                (PBFT_HIGH_WATER_INTERVAL.c_str(),
+                        po::value<double>()->default_value(2.0),
+                        "checkpoint intervals past the last stable checkpoint that pbft accepts sequences for (at least 1)")
+                (PBFT_MAC_AUTHENTICATORS.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "authenticate pbft prepares and commits with MACs under keys shared between peers rather than signatures")
+                (PBFT_MAX_IN_FLIGHT.c_str(),
+                        po::value<size_t>()->default_value(0),
+                        "uncommitted sequences the pbft primary allows before refusing requests (0 = up to the high water mark)")
                 (PEER_VALIDATION_ENABLED.c_str(),
                         po::value<bool>()->default_value(false),
                         "require signed key for new peers to join swarm")
@@ -233,6 +294,13 @@ simple_options::validate_options()
         errors = true;
     }
 
+    const auto checkpoint_interval = this->get<uint64_t>(PBFT_CHECKPOINT_INTERVAL);
+    if (checkpoint_interval < 2 || checkpoint_interval * this->get<double>(PBFT_HIGH_WATER_INTERVAL) < checkpoint_interval)
+    {
+        std::cerr << "Invalid pbft checkpoint interval; it must be at least 2 and the high water interval at least 1";
+        errors = true;
+    }
+
     return !errors;
 }
 
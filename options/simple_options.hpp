@@ -36,13 +36,32 @@ namespace bzn::option_names
     const std::string LOGFILE_ROTATION_SIZE = "logfile_rotation_size";
     const std::string MAX_STORAGE = "max_storage";
     const std::string MEM_STORAGE = "mem_storage";
+    const std::string MEM_STORAGE_SHARDS = "mem_storage_shards";
+    const std::string MEM_STORAGE_BUDGET = "mem_storage_budget";
     const std::string MONITOR_ADDRESS = "monitor_address";
     const std::string MONITOR_PORT = "monitor_port";
     const std::string NODE_UUID = "uuid";
     const std::string NODE_PUBKEY_FILE = "public_key_file";
     const std::string NODE_PRIVATEKEY_FILE = "private_key_file";
     const std::string PBFT_ENABLED = "use_pbft";
+    const std::string PBFT_BATCH_SIZE = "pbft_batch_size";
+    const std::string PBFT_BATCH_TIMEOUT = "pbft_batch_timeout_milliseconds";
+    const std::string PBFT_CHECKPOINT_INTERVAL = "pbft_checkpoint_interval";
+    const std::string PBFT_DIGEST_PREPREPARES = "pbft_digest_preprepares";
+    const std::string PBFT_HIGH_WATER_INTERVAL = "pbft_high_water_interval_in_checkpoints";
+    const std::string PBFT_MAC_AUTHENTICATORS = "pbft_mac_authenticators";
+    const std::string PBFT_MAX_IN_FLIGHT = "pbft_max_in_flight_sequences";
+    const std::string ROCKSDB_CF_PER_DB = "rocksdb_column_family_per_db";
+    const std::string ROCKSDB_BLOCK_CACHE_SIZE = "rocksdb_block_cache_size";
+    const std::string ROCKSDB_BLOOM_FILTER_BITS = "rocksdb_bloom_filter_bits_per_key";
+    const std::string ROCKSDB_COMPRESSION = "rocksdb_compression";
+    const std::string ROCKSDB_WRITE_BUFFER_SIZE = "rocksdb_write_buffer_size";
+    const std::string ROCKSDB_MAX_WRITE_BUFFERS = "rocksdb_max_write_buffer_number";
+    const std::string ROCKSDB_DATABASE_WRITE_BUFFER_SIZE = "rocksdb_database_write_buffer_size";
+    const std::string ROCKSDB_STATISTICS = "rocksdb_statistics";
     const std::string STATE_DIR = "state_dir";
+    const std::string STORAGE_CACHE_SIZE = "storage_cache_size";
+    const std::string STORAGE_COMPRESSION_THRESHOLD = "storage_compression_threshold";
     const std::string WS_IDLE_TIMEOUT = "ws_idle_timeout";
     const std::string PEER_VALIDATION_ENABLED = "peer_validation_enabled";
     const std::string SIGNED_KEY = "signed_key";
@@ -166,6 +166,17 @@ TEST_F(options_file_test, test_that_loading_of_default_config_file)
         EXPECT_EQ("logs/", options.get_logfile_dir());
         EXPECT_EQ(uint16_t(8080), options.get_http_port());
         EXPECT_TRUE(options.get_mem_storage());
+        EXPECT_EQ(size_t(1), options.get_simple_options().get<size_t>(bzn::option_names::MEM_STORAGE_SHARDS));
+        EXPECT_EQ(size_t(0), options.get_mem_storage_budget());
+        EXPECT_EQ(size_t(0), options.get_storage_cache_size());
+        EXPECT_EQ(size_t(0), options.get_storage_compression_threshold());
+        EXPECT_EQ(size_t(1), options.get_simple_options().get<size_t>(bzn::option_names::PBFT_BATCH_SIZE));
+        EXPECT_EQ(uint64_t(5), options.get_simple_options().get<uint64_t>(bzn::option_names::PBFT_BATCH_TIMEOUT));
+        EXPECT_EQ(uint64_t(100), options.get_simple_options().get<uint64_t>(bzn::option_names::PBFT_CHECKPOINT_INTERVAL));
+        EXPECT_FALSE(options.get_simple_options().get<bool>(bzn::option_names::PBFT_DIGEST_PREPREPARES));
+        EXPECT_EQ(2.0, options.get_simple_options().get<double>(bzn::option_names::PBFT_HIGH_WATER_INTERVAL));
+        EXPECT_FALSE(options.get_simple_options().get<bool>(bzn::option_names::PBFT_MAC_AUTHENTICATORS));
+        EXPECT_EQ(size_t(0), options.get_simple_options().get<size_t>(bzn::option_names::PBFT_MAX_IN_FLIGHT));
     }
 }
 
@@ -240,6 +251,50 @@ TEST_F(options_file_test, test_enable_whitlelist_temporary)
 }
 
 
+TEST_F(options_file_test, test_rocksdb_tuning)
+{
+    bzn::json_message json;
+    config_text_to_json(json);
+    {
+        this->save_options_file(json.toStyledString());
+        bzn::options options;
+        options.parse_command_line(1, NO_ARGS);
+
+        // defaults match rocksdb_storage's own...
+        const auto tuning = options.get_rocksdb_tuning();
+        const bzn::rocksdb_tuning defaults;
+        EXPECT_EQ(defaults.block_cache_size, tuning.block_cache_size);
+        EXPECT_EQ(defaults.bloom_filter_bits_per_key, tuning.bloom_filter_bits_per_key);
+        EXPECT_TRUE(tuning.compression.empty());
+        EXPECT_EQ(defaults.write_buffer_size, tuning.write_buffer_size);
+        EXPECT_EQ(defaults.max_write_buffer_number, tuning.max_write_buffer_number);
+        EXPECT_EQ(defaults.database_write_buffer_size, tuning.database_write_buffer_size);
+        EXPECT_FALSE(tuning.statistics);
+    }
+    {
+        json[bzn::option_names::ROCKSDB_BLOCK_CACHE_SIZE] = "1G";
+        json[bzn::option_names::ROCKSDB_BLOOM_FILTER_BITS] = 0;
+        json[bzn::option_names::ROCKSDB_COMPRESSION] = "none, none, lz4,zstd";
+        json[bzn::option_names::ROCKSDB_WRITE_BUFFER_SIZE] = "64M";
+        json[bzn::option_names::ROCKSDB_MAX_WRITE_BUFFERS] = 3;
+        json[bzn::option_names::ROCKSDB_DATABASE_WRITE_BUFFER_SIZE] = "1M";
+        json[bzn::option_names::ROCKSDB_STATISTICS] = true;
+        this->save_options_file(json.toStyledString());
+        bzn::options options;
+        options.parse_command_line(1, NO_ARGS);
+
+        const auto tuning = options.get_rocksdb_tuning();
+        EXPECT_EQ(size_t(1073741824), tuning.block_cache_size);
+        EXPECT_EQ(0, tuning.bloom_filter_bits_per_key);
+        EXPECT_EQ(std::vector<std::string>({"none", "none", "lz4", "zstd"}), tuning.compression);
+        EXPECT_EQ(size_t(67108864), tuning.write_buffer_size);
+        EXPECT_EQ(3, tuning.max_write_buffer_number);
+        EXPECT_EQ(size_t(1048576), tuning.database_write_buffer_size);
+        EXPECT_TRUE(tuning.statistics);
+    }
+}
+
+
 TEST_F(options_file_test, test_that_command_line_options_work)
 {
     bzn::options options;
@@ -15,6 +15,9 @@
 
 #include <pbft/database_pbft_service.hpp>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 
 
 using namespace bzn;
@@ -22,6 +25,17 @@ using namespace bzn;
 namespace
 {
     const std::string NEXT_REQUEST_SEQUENCE_KEY{"next_request_sequence"};
+    const size_t REQUEST_KEY_DIGITS{20};
+    const size_t FORGET_REQUESTS_PAGE_SIZE{1000};
+
+    // fixed width so requests sort by sequence: the log is written in key order and truncated from its start...
+    bzn::key_t request_key(uint64_t sequence)
+    {
+        std::ostringstream key;
+        key << std::setw(REQUEST_KEY_DIGITS) << std::setfill('0') << sequence;
+
+        return key.str();
+    }
 }
 
 
@@ -49,8 +63,16 @@ database_pbft_service::apply_operation(const std::shared_ptr<bzn::pbft_operation
 {
     std::lock_guard<std::mutex> lock(this->lock);
 
+    // executed requests stay in the log until the next checkpoint, so a repeat must not be stored again...
+    if (op->sequence < this->next_request_sequence)
+    {
+        LOG(debug) << "ignoring already executed request: " << op->sequence;
+
+        return;
+    }
+
     // store op...
-    if (auto result = this->unstable_storage->create(this->uuid, std::to_string(op->sequence), op->get_request().SerializeAsString());
+    if (auto result = this->unstable_storage->create(this->uuid, request_key(op->sequence), op->get_request().SerializeAsString());
         result != bzn::storage_base::result::ok)
     {
         LOG(fatal) << "failed to store pbft request: " << op->get_request().DebugString() << ", " << uint32_t(result);
@@ -60,7 +82,7 @@ database_pbft_service::apply_operation(const std::shared_ptr<bzn::pbft_operation
     }
 
     // store requester session for eventual response...
-    this->sessions_awaiting_response[op->sequence] = op->session();
+    this->sessions_awaiting_response[op->sequence] = op->sessions();
 
     this->process_awaiting_operations();
 }
@@ -69,18 +91,10 @@ database_pbft_service::apply_operation(const std::shared_ptr<bzn::pbft_operation
 void
 database_pbft_service::process_awaiting_operations()
 {
-    while (this->unstable_storage->has(this->uuid, std::to_string(this->next_request_sequence)))
+    // a single read both tests for and fetches the next request...
+    for (key_t key{request_key(this->next_request_sequence)}; auto result = this->unstable_storage->read(this->uuid, key);
+        key = request_key(this->next_request_sequence))
     {
-        const key_t key{std::to_string(this->next_request_sequence)};
-
-        auto result = this->unstable_storage->read(this->uuid, key);
-
-        if (!result)
-        {
-            // these are fatal... something bad is going on.
-            throw std::runtime_error("Failed to store pbft request!");
-        }
-
         pbft_request request;
 
         if (!request.ParseFromString(*result))
@@ -91,33 +105,61 @@ database_pbft_service::process_awaiting_operations()
 
         LOG(info) << "Executing request " << request.DebugString() << "..., sequence: " << key;
 
+        // no sessions are waiting on a request loaded from the database...
+        std::vector<std::weak_ptr<bzn::session_base>> sessions;
+
         if (auto session_it = this->sessions_awaiting_response.find(this->next_request_sequence); session_it != this->sessions_awaiting_response.end())
         {
-            // session found, but is the connection still around?
-            auto session = session_it->second.lock();
+            sessions = std::move(session_it->second);
+        }
 
-            this->crud->handle_request(request.operation(), (session) ? session : nullptr);
+        const auto session = [&sessions](size_t index)
+        {
+            return index < sessions.size() ? sessions[index] : std::weak_ptr<bzn::session_base>();
+        };
+
+        if (request.type() == PBFT_REQ_BATCH)
+        {
+            // the requests of a batch are executed in order under its sequence number...
+            for (int i = 0; i < request.batch().requests_size(); ++i)
+            {
+                pbft_request batched;
+
+                if (!batched.ParseFromString(request.batch().requests(i)))
+                {
+                    // these are fatal... something bad is going on.
+                    throw std::runtime_error("Failed to create pbft_request from batch!");
+                }
+
+                this->execute_request(batched, session(i));
+            }
         }
         else
         {
-            // session not found then this was probably loaded from the database...
-            this->crud->handle_request(request.operation(), nullptr);
+            this->execute_request(request, session(0));
         }
 
         this->io_context->post(std::bind(this->execute_handler, nullptr)); // TODO: need to find the pbft_operation here; requires pbft_operation not being an in-memory construct
 
-        if (auto result = this->unstable_storage->remove(this->uuid, key); result != bzn::storage_base::result::ok)
-        {
-            // these are fatal... something bad is going on.
-            throw std::runtime_error("Failed to remove pbft_request from database! (" + std::to_string(uint8_t(result)) + ")");
-        }
+        this->sessions_awaiting_response.erase(this->next_request_sequence);
 
+        // the request stays in the log until consolidate_log(), advancing the sequence is what marks it executed...
         ++this->next_request_sequence;
 
         this->save_next_request_sequence();
     }
 }
 
+void
+database_pbft_service::execute_request(pbft_request& request, const std::weak_ptr<bzn::session_base>& session)
+{
+    // the request's agreed timestamp is the only clock every replica shares...
+    request.mutable_operation()->mutable_header()->set_timestamp(request.timestamp());
+
+    // is the connection still around?
+    this->crud->handle_request(request.operation(), session.lock());
+}
+
 bzn::hash_t
 database_pbft_service::service_state_hash(uint64_t /*sequence_number*/) const
 {
@@ -146,16 +188,14 @@ database_pbft_service::set_service_state(uint64_t sequence_number, const bzn::se
             return false;
     */
 
+    std::lock_guard<std::mutex> lock(this->lock);
+
     // remove all backlogged requests prior to checkpoint
-    uint64_t seq = this->next_request_sequence;
-    while (seq <= sequence_number)
-    {
-        const key_t key{std::to_string(seq)};
-        this->unstable_storage->remove(uuid, key);
-        seq++;
-    }
+    this->forget_requests(sequence_number);
+
+    this->next_request_sequence = std::max(this->next_request_sequence, sequence_number + 1);
+    this->save_next_request_sequence();
 
-    this->next_request_sequence = seq;
     this->process_awaiting_operations();
     return true;
 }
@@ -169,6 +209,11 @@ database_pbft_service::consolidate_log(uint64_t sequence_number)
     /*
         this->crud->remember_state(sequence_number);
     */
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    // requests up to a stable checkpoint that have been executed will never be needed again...
+    this->forget_requests(std::min(sequence_number, this->next_request_sequence - 1));
 }
 
 
@@ -186,6 +231,37 @@ database_pbft_service::applied_requests_count() const
 }
 
 
+void
+database_pbft_service::forget_requests(uint64_t sequence_number)
+{
+    const auto last_key = request_key(sequence_number);
+
+    // the log is in sequence order, so page through it from the start removing each page in one write...
+    for (;;)
+    {
+        auto keys = this->unstable_storage->get_keys(this->uuid, "", FORGET_REQUESTS_PAGE_SIZE, "");
+
+        keys.erase(std::find_if(keys.begin(), keys.end(), [&](const auto& key){ return key > last_key; }), keys.end());
+
+        if (keys.empty())
+        {
+            return;
+        }
+
+        if (auto result = this->unstable_storage->multi_remove(this->uuid, keys); result != bzn::storage_base::result::ok)
+        {
+            LOG(error) << "failed to remove pbft requests up to: " << sequence_number << ", " << uint32_t(result);
+            return;
+        }
+
+        for (const auto& key : keys)
+        {
+            this->sessions_awaiting_response.erase(boost::lexical_cast<uint64_t>(key));
+        }
+    }
+}
+
+
 void
 database_pbft_service::load_next_request_sequence()
 {
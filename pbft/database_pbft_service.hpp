@@ -51,6 +51,11 @@ namespace bzn
     private:
         void process_awaiting_operations();
 
+        void execute_request(pbft_request& request, const std::weak_ptr<bzn::session_base>& session);
+
+        // drop stored requests up to and including a sequence number...
+        void forget_requests(uint64_t sequence_number);
+
         void load_next_request_sequence();
         void save_next_request_sequence();
 
@@ -60,7 +65,8 @@ namespace bzn
         uint64_t next_request_sequence = 1;
         const bzn::uuid_t uuid;
 
-        std::unordered_map<uint64_t, std::weak_ptr<bzn::session_base>> sessions_awaiting_response;
+        // one session per request of a batch...
+        std::unordered_map<uint64_t, std::vector<std::weak_ptr<bzn::session_base>>> sessions_awaiting_response;
 
         bzn::execute_handler_t execute_handler;
 
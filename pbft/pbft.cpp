@@ -54,7 +54,7 @@ pbft::pbft(
 
     // TODO: stable checkpoint should be read from disk first: KEP-494
     this->low_water_mark = this->stable_checkpoint.first;
-    this->high_water_mark = this->stable_checkpoint.first + std::lround(CHECKPOINT_INTERVAL*HIGH_WATER_INTERVAL_IN_CHECKPOINTS);
+    this->high_water_mark = this->stable_checkpoint.first + this->high_water_window();
 }
 
 void
@@ -84,21 +84,20 @@ pbft::start()
                                             {
                                                 // TODO: Get real pbft_operation pointers from pbft_service
                                                 LOG(error) << "Ignoring null operation pointer recieved from pbft_service";
+                                                return;
                                             }
 
                                             fd->request_executed(op->request_hash);
 
-                                            if (op->sequence % CHECKPOINT_INTERVAL == 0)
+                                            auto strong_this = weak_this.lock();
+                                            if (!strong_this)
                                             {
-                                                auto strong_this = weak_this.lock();
-                                                if(strong_this)
-                                                {
-                                                    strong_this->checkpoint_reached_locally(op->sequence);
-                                                }
-                                                else
-                                                {
-                                                    throw std::runtime_error("pbft_service callback failed because pbft does not exist");
-                                                }
+                                                throw std::runtime_error("pbft_service callback failed because pbft does not exist");
+                                            }
+
+                                            if (op->sequence % strong_this->checkpoint_interval == 0)
+                                            {
+                                                strong_this->checkpoint_reached_locally(op->sequence);
                                             }
                                         }
                 );
@@ -167,6 +166,8 @@ pbft::handle_membership_message(const bzn_envelope& msg, std::shared_ptr<bzn::se
         return;
     }
 
+    std::lock_guard<std::mutex> lock(this->pbft_lock);
+
     switch (inner_msg.type())
     {
         case PBFT_MMSG_JOIN:
@@ -196,27 +197,75 @@ pbft::handle_message(const pbft_msg& msg, const bzn_envelope& original_msg)
         return;
     }
 
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    // requests only travel on their own when preprepares carry digests...
+    if ((msg.type() == PBFT_MSG_REQUEST || msg.type() == PBFT_MSG_GET_REQUEST) && !this->digest_preprepares)
+    {
+        LOG(info) << "Dropping request message because preprepares carry whole requests";
+        return;
+    }
+
+    if ((msg.type() == PBFT_MSG_REQUEST || msg.type() == PBFT_MSG_FORWARD_REQUEST) && msg.request().empty())
+    {
+        LOG(info) << "Dropping request message without a request";
+        return;
+    }
+
+    // hashing the request is the costly part of a preprepare, so it is checked before taking any lock...
+    if (!msg.request().empty() && this->crypto->hash(msg.request()) != msg.request_hash())
+    {
+        LOG(info) << "Dropping message because its request does not match its hash";
+        return;
+    }
 
     switch (msg.type())
     {
         case PBFT_MSG_PREPREPARE :
+        {
+            std::lock_guard<std::mutex> lock(this->shard_for(msg.sequence()).lock);
             this->handle_preprepare(msg, original_msg);
             break;
+        }
         case PBFT_MSG_PREPARE :
+        {
+            std::lock_guard<std::mutex> lock(this->shard_for(msg.sequence()).lock);
             this->handle_prepare(msg, original_msg);
             break;
+        }
         case PBFT_MSG_COMMIT :
+        {
+            std::lock_guard<std::mutex> lock(this->shard_for(msg.sequence()).lock);
             this->handle_commit(msg, original_msg);
             break;
+        }
         case PBFT_MSG_CHECKPOINT :
+        {
+            std::lock_guard<std::mutex> lock(this->pbft_lock);
             this->handle_checkpoint(msg, original_msg);
             break;
+        }
+        case PBFT_MSG_REQUEST :
+            this->handle_disseminated_request(msg, original_msg);
+            break;
+        case PBFT_MSG_GET_REQUEST :
+            this->handle_get_request(msg, original_msg);
+            break;
+        case PBFT_MSG_REFUSE_REQUEST :
+            this->handle_refused_request(msg, original_msg);
+            break;
+        case PBFT_MSG_FORWARD_REQUEST :
+            this->handle_forwarded_request(msg, original_msg);
+            break;
         default :
             throw std::runtime_error("Unsupported message type");
     }
 }
 
+pbft::operation_shard&
+pbft::shard_for(uint64_t sequence)
+{
+    return this->operation_shards[sequence % OPERATION_SHARDS];
+}
+
 bool
 pbft::preliminary_filter_msg(const pbft_msg& msg)
 {
@@ -250,6 +299,14 @@ pbft::setup_request_operation(const bzn::encoded_message& request, const request
     const std::shared_ptr<session_base>& session)
 {
     const uint64_t request_seq = this->next_issued_sequence_number++;
+
+    {
+        std::lock_guard<std::mutex> lock(this->in_flight_lock);
+        this->in_flight_sequences.insert(request_seq);
+    }
+
+    std::lock_guard<std::mutex> lock(this->shard_for(request_seq).lock);
+
     auto op = this->find_operation(this->view, request_seq, hash);
     op->record_request(request);
 
@@ -261,52 +318,608 @@ pbft::setup_request_operation(const bzn::encoded_message& request, const request
     return op;
 }
 
-void
+bool
 pbft::handle_request(const pbft_request& msg, const bzn::json_message& original_msg, const std::shared_ptr<session_base>& session)
 {
+    if (this->digest_preprepares)
+    {
+        return this->disseminate_request(msg, session);
+    }
+
     if (!this->is_primary())
     {
         LOG(info) << "Forwarding request to primary: " << original_msg.toStyledString();
-        this->node->send_message(bzn::make_endpoint(this->get_primary()), std::make_shared<bzn::json_message>(original_msg));
-        return;
+
+        // signed as ours, so the primary knows it comes from a replica and not from a client...
+        pbft_msg forward_msg;
+        forward_msg.set_type(PBFT_MSG_FORWARD_REQUEST);
+        forward_msg.set_request(msg.SerializeAsString());
+        forward_msg.set_request_hash(this->crypto->hash(forward_msg.request()));
+
+        // the primary answers a refusal to us, and we pass it on to the client...
+        {
+            std::lock_guard<std::mutex> lock(this->forwarded_lock);
+
+            auto& forwarded = this->forwarded_requests[forward_msg.request_hash()];
+            forwarded.header = msg.operation().header();
+            forwarded.forwarded = this->now();
+            forwarded.session = session;
+        }
+
+        this->node->send_message_str(bzn::make_endpoint(this->get_primary())
+            , std::make_shared<bzn::encoded_message>(this->wrap_message(forward_msg, "forward_request")));
+        return true;
     }
 
+    // stored and sent the same way whether or not it ends up in a batch...
+    auto smsg = msg.SerializeAsString();
+    auto hash = this->crypto->hash(smsg);
+
+    return this->order_request(msg, smsg, hash, session);
+}
+
+bool
+pbft::order_request(const pbft_request& msg, const bzn::encoded_message& request, const request_hash_t& hash
+    , const std::shared_ptr<session_base>& session)
+{
     if (msg.timestamp() < (this->now() - MAX_REQUEST_AGE_MS) || msg.timestamp() > (this->now() + MAX_REQUEST_AGE_MS))
     {
         // TODO: send error message to client
-        LOG(info) << "Rejecting request because it is outside allowable timestamp range: "
-            << original_msg.toStyledString();
-        return;
+        LOG(info) << "Rejecting request because it is outside allowable timestamp range: " << msg.ShortDebugString();
+        return true;
     }
 
-    auto smsg = original_msg.toStyledString();
-    auto hash = this->crypto->hash(smsg);
+    std::lock_guard<std::mutex> lock(this->pbft_lock);
+
+    if (this->window_full())
+    {
+        LOG(debug) << "Refusing request with sequence " << this->next_issued_sequence_number << " next to be issued";
+        return false;
+    }
 
     // keep track of what requests we've seen based on timestamp and only send preprepares once
     if (this->already_seen_request(msg, hash))
     {
         // TODO: send error message to client
-        LOG(info) << "Rejecting duplicate request: " << original_msg.toStyledString();
-        return;
+        LOG(info) << "Rejecting duplicate request: " << msg.ShortDebugString();
+        return true;
     }
     this->saw_request(msg, hash);
 
-    auto op = setup_request_operation(smsg, hash, session);
+    if (this->max_batch_requests > 1)
+    {
+        this->batch_request(request, hash, session);
+
+        return true;
+    }
+
+    auto op = setup_request_operation(request, hash, session);
     this->do_preprepare(op);
+
+    return true;
+}
+
+bool
+pbft::disseminate_request(const pbft_request& msg, const std::shared_ptr<session_base>& session)
+{
+    if (this->is_primary())
+    {
+        std::lock_guard<std::mutex> lock(this->pbft_lock);
+
+        if (this->window_full())
+        {
+            return false;
+        }
+    }
+
+    pbft_msg request_msg;
+    request_msg.set_type(PBFT_MSG_REQUEST);
+    request_msg.set_request(msg.SerializeAsString());
+    request_msg.set_request_hash(this->crypto->hash(request_msg.request()));
+
+    {
+        std::lock_guard<std::mutex> lock(this->disseminated_lock);
+
+        // this node answers the client once the request is executed...
+        auto& stored = this->disseminated_requests.emplace(request_msg.request_hash(), disseminated_request()).first->second;
+        stored.request = request_msg.request();
+        stored.received = this->now();
+        stored.session = session;
+    }
+
+    // every replica, this one and the primary included, gets the request from us rather than in a preprepare...
+    this->broadcast(this->wrap_message(request_msg, "request"));
+
+    return true;
 }
 
 void
-pbft::maybe_record_request(const pbft_msg& msg, const std::shared_ptr<pbft_operation>& op)
+pbft::handle_disseminated_request(const pbft_msg& msg, const bzn_envelope& original_msg)
 {
-    if (!msg.request().empty() && !op->has_request())
+    std::set<uint64_t> sequences;
+    std::vector<std::shared_ptr<pbft_operation>> deferred;
+
     {
-        if (this->crypto->hash(msg.request()) != msg.request_hash())
+        std::lock_guard<std::mutex> lock(this->disseminated_lock);
+
+        // the copy we already have keeps its client session...
+        this->disseminated_requests.emplace(msg.request_hash(), disseminated_request{msg.request(), this->now(), {}});
+
+        if (auto awaited = this->awaited_requests.find(msg.request_hash()); awaited != this->awaited_requests.end())
+        {
+            sequences = std::move(awaited->second);
+            this->awaited_requests.erase(awaited);
+        }
+
+        this->fetched_requests.erase(msg.request_hash());
+
+        for (const auto sequence : sequences)
+        {
+            if (auto held = this->deferred_executions.find(sequence); held != this->deferred_executions.end())
+            {
+                deferred.emplace_back(std::move(held->second));
+                this->deferred_executions.erase(held);
+            }
+        }
+    }
+
+    // committed batches held for this request are executed if it was the last one they were missing...
+    for (const auto& op : deferred)
+    {
+        if (auto executed = this->expand_request(op))
+        {
+            this->io_context->post(std::bind(&pbft_service_base::apply_operation, this->service, executed));
+        }
+    }
+
+    // operations that were waiting on this request may now go ahead...
+    const uint64_t view = this->view;
+    for (const auto sequence : sequences)
+    {
+        auto& shard = this->shard_for(sequence);
+        std::lock_guard<std::mutex> lock(shard.lock);
+
+        for (auto it = shard.operations.lower_bound(operation_key_t(view, sequence, bzn::hash_t()));
+            it != shard.operations.end() && it->second->view == view && it->second->sequence == sequence; ++it)
         {
-            LOG(info) << "Not recording request because its hash does not match";
+            const auto op = it->second;
+
+            if (op->has_request())
+            {
+                continue;
+            }
+
+            if (auto request = this->find_disseminated_request(bzn::encoded_message(), sequence, op->request_hash, bzn::uuid_t()))
+            {
+                op->record_request(*request);
+                this->maybe_advance_operation_state(op);
+            }
+        }
+    }
+
+    // the primary orders client requests as they reach it, and tells the node that has the client when it cannot...
+    if (this->is_primary())
+    {
+        pbft_request request;
+        if (request.ParseFromString(msg.request()) && request.type() == PBFT_REQ_DATABASE
+            && !this->order_request(request, msg.request(), msg.request_hash(), nullptr))
+        {
+            this->refuse_request(msg.request_hash(), original_msg.sender());
+        }
+    }
+}
+
+void
+pbft::handle_forwarded_request(const pbft_msg& msg, const bzn_envelope& original_msg)
+{
+    // the sender is authenticated by its signature, and only a replica forwards requests...
+    {
+        const auto peers = this->current_peers_ptr();
+        if (std::none_of(peers->begin(), peers->end(), [&](const auto& peer) { return peer.uuid == original_msg.sender(); }))
+        {
+            LOG(info) << "Ignoring a forwarded request from " << original_msg.sender() << ", which is not a peer";
+            return;
+        }
+    }
+
+    if (!this->is_primary())
+    {
+        LOG(info) << "Ignoring a forwarded request from " << original_msg.sender() << " because I am not the primary";
+        return;
+    }
+
+    pbft_request request;
+    if (!request.ParseFromString(msg.request()) || request.type() != PBFT_REQ_DATABASE)
+    {
+        LOG(info) << "Ignoring a forwarded request from " << original_msg.sender() << " that is not a database request";
+        return;
+    }
+
+    // the client is answered by the replica it sent the request to...
+    if (!this->order_request(request, msg.request(), msg.request_hash(), nullptr))
+    {
+        this->refuse_request(msg.request_hash(), original_msg.sender());
+    }
+}
+
+void
+pbft::refuse_request(const request_hash_t& hash, const bzn::uuid_t& sender)
+{
+    LOG(debug) << "Refusing request from " << sender << " because the window is full";
+
+    pbft_msg refusal;
+    refusal.set_type(PBFT_MSG_REFUSE_REQUEST);
+    refusal.set_request_hash(hash);
+
+    const auto peers = this->current_peers_ptr();
+    for (const auto& peer : *peers)
+    {
+        if (peer.uuid == sender)
+        {
+            this->node->send_message_str(make_endpoint(peer), std::make_shared<bzn::encoded_message>(this->wrap_message(refusal, "refuse_request")));
+        }
+    }
+}
+
+void
+pbft::handle_get_request(const pbft_msg& msg, const bzn_envelope& original_msg)
+{
+    pbft_msg reply;
+    reply.set_type(PBFT_MSG_REQUEST);
+    reply.set_request_hash(msg.request_hash());
+
+    {
+        std::lock_guard<std::mutex> lock(this->disseminated_lock);
+
+        auto stored = this->disseminated_requests.find(msg.request_hash());
+        if (stored == this->disseminated_requests.end() || stored->second.request.empty())
+        {
+            LOG(debug) << "Asked by " << original_msg.sender() << " for a request I do not have";
             return;
         }
 
-        op->record_request(msg.request());
+        reply.set_request(stored->second.request);
+    }
+
+    const auto peers = this->current_peers_ptr();
+    for (const auto& peer : *peers)
+    {
+        if (peer.uuid == original_msg.sender())
+        {
+            this->node->send_message_str(make_endpoint(peer), std::make_shared<bzn::encoded_message>(this->wrap_message(reply, "request")));
+        }
+    }
+}
+
+void
+pbft::handle_refused_request(const pbft_msg& msg, const bzn_envelope& original_msg)
+{
+    // only the primary knows whether its window is full...
+    if (original_msg.sender() != this->get_primary().uuid)
+    {
+        LOG(info) << "Ignoring a refused request from " << original_msg.sender() << ", which is not the primary";
+        return;
+    }
+
+    database_header header;
+    std::weak_ptr<bzn::session_base> client;
+
+    // a request we forwarded to the primary...
+    {
+        std::lock_guard<std::mutex> lock(this->forwarded_lock);
+
+        if (auto forwarded = this->forwarded_requests.find(msg.request_hash()); forwarded != this->forwarded_requests.end())
+        {
+            header = forwarded->second.header;
+            client = forwarded->second.session;
+            this->forwarded_requests.erase(forwarded);
+        }
+    }
+
+    // ...or one we sent to every replica, when preprepares carry digests
+    if (client.expired())
+    {
+        std::lock_guard<std::mutex> lock(this->disseminated_lock);
+
+        if (auto stored = this->disseminated_requests.find(msg.request_hash());
+            stored != this->disseminated_requests.end() && !stored->second.session.expired())
+        {
+            pbft_request request;
+            if (request.ParseFromString(stored->second.request))
+            {
+                header = request.operation().header();
+            }
+
+            // it will not be executed, so there is nothing more to tell the client...
+            client = std::move(stored->second.session);
+            stored->second.session.reset();
+        }
+    }
+
+    if (auto session = client.lock())
+    {
+        database_response response;
+        *response.mutable_header() = header;
+        response.mutable_error()->set_message(bzn::MSG_TOO_MANY_REQUESTS);
+
+        session->send_message(std::make_shared<bzn::encoded_message>(response.SerializeAsString()), false);
+        return;
+    }
+
+    LOG(debug) << "The primary refused a request I have no client session for";
+}
+
+std::optional<bzn::encoded_message>
+pbft::find_disseminated_request(const bzn::encoded_message& carried, uint64_t sequence, const request_hash_t& hash
+    , const bzn::uuid_t& fetch_from)
+{
+    std::optional<bzn::encoded_message> found;
+    std::vector<request_hash_t> to_fetch;
+
+    {
+        std::lock_guard<std::mutex> lock(this->disseminated_lock);
+
+        // a request carried in a preprepare is kept too, so a batch can be recorded once its last request arrives...
+        if (!carried.empty())
+        {
+            this->disseminated_requests.emplace(hash, disseminated_request{carried, this->now(), {}});
+        }
+
+        // a request we only have an empty record of is as good as missing, and is fetched like one...
+        const auto find_stored = [&](const request_hash_t& stored_hash)
+        {
+            auto stored = this->disseminated_requests.find(stored_hash);
+            return (stored != this->disseminated_requests.end() && !stored->second.request.empty()) ? stored
+                : this->disseminated_requests.end();
+        };
+
+        bool complete = true;
+        const auto missing = [&](const request_hash_t& missing_hash)
+        {
+            complete = false;
+            this->awaited_requests[missing_hash].insert(sequence);
+
+            if (!fetch_from.empty() && this->fetched_requests.insert(missing_hash).second)
+            {
+                to_fetch.emplace_back(missing_hash);
+            }
+        };
+
+        if (auto stored = find_stored(hash); stored == this->disseminated_requests.end())
+        {
+            missing(hash);
+        }
+        else
+        {
+            // a batch of digests is only recorded once it has every request it lists...
+            pbft_request request;
+            if (request.ParseFromString(stored->second.request) && request.type() == PBFT_REQ_BATCH)
+            {
+                for (const auto& listed : request.batch().request_hashes())
+                {
+                    if (find_stored(listed) == this->disseminated_requests.end())
+                    {
+                        missing(listed);
+                    }
+                }
+            }
+
+            if (complete)
+            {
+                found = stored->second.request;
+            }
+        }
+    }
+
+    if (!to_fetch.empty())
+    {
+        const auto peers = this->current_peers_ptr();
+        for (const auto& peer : *peers)
+        {
+            if (peer.uuid != fetch_from)
+            {
+                continue;
+            }
+
+            for (const auto& missing_hash : to_fetch)
+            {
+                LOG(debug) << "Fetching request for seq " << sequence << " from " << fetch_from;
+
+                pbft_msg get_msg;
+                get_msg.set_type(PBFT_MSG_GET_REQUEST);
+                get_msg.set_request_hash(missing_hash);
+
+                this->node->send_message_str(make_endpoint(peer), std::make_shared<bzn::encoded_message>(this->wrap_message(get_msg, "get_request")));
+            }
+        }
+    }
+
+    return found;
+}
+
+std::shared_ptr<pbft_operation>
+pbft::expand_request(const std::shared_ptr<pbft_operation>& op)
+{
+    const auto& request = op->get_request();
+
+    pbft_request batch;
+    batch.set_type(PBFT_REQ_BATCH);
+    batch.set_timestamp(request.timestamp());
+
+    std::vector<std::weak_ptr<session_base>> sessions;
+    std::vector<request_hash_t> to_fetch;
+
+    {
+        std::lock_guard<std::mutex> lock(this->disseminated_lock);
+
+        if (request.type() != PBFT_REQ_BATCH || request.batch().request_hashes().empty())
+        {
+            if (auto stored = this->disseminated_requests.find(op->request_hash);
+                stored != this->disseminated_requests.end() && !stored->second.session.expired())
+            {
+                op->set_session(stored->second.session);
+            }
+
+            return op;
+        }
+
+        // a listed request may have aged out since the batch was recorded, or never reached us...
+        for (const auto& hash : request.batch().request_hashes())
+        {
+            auto stored = this->disseminated_requests.find(hash);
+            if (stored == this->disseminated_requests.end() || stored->second.request.empty())
+            {
+                this->awaited_requests[hash].insert(op->sequence);
+
+                if (this->fetched_requests.insert(hash).second)
+                {
+                    to_fetch.emplace_back(hash);
+                }
+
+                continue;
+            }
+
+            batch.mutable_batch()->add_requests(stored->second.request);
+            sessions.emplace_back(stored->second.session);
+        }
+
+        if (batch.batch().requests_size() != request.batch().request_hashes_size())
+        {
+            this->deferred_executions[op->sequence] = op;
+        }
+    }
+
+    if (batch.batch().requests_size() != request.batch().request_hashes_size())
+    {
+        // ...so it is asked for, and executed once it arrives
+        for (const auto& hash : to_fetch)
+        {
+            LOG(debug) << "Fetching request for committed seq " << op->sequence << " from every replica";
+
+            pbft_msg get_msg;
+            get_msg.set_type(PBFT_MSG_GET_REQUEST);
+            get_msg.set_request_hash(hash);
+
+            this->broadcast(this->wrap_message(get_msg, "get_request"));
+        }
+
+        return nullptr;
+    }
+
+    // the service executes the requests, agreement was on their digests...
+    auto expanded = std::make_shared<pbft_operation>(op->view, op->sequence, op->request_hash, nullptr);
+    expanded->record_request(batch.SerializeAsString());
+    expanded->set_sessions(std::move(sessions));
+
+    return expanded;
+}
+
+void
+pbft::batch_request(const bzn::encoded_message& request, const request_hash_t& hash, const std::shared_ptr<session_base>& session)
+{
+    this->pending_batch.push_back({request, hash, session});
+
+    if (this->pending_batch.size() >= this->max_batch_requests)
+    {
+        this->send_batch();
+        return;
+    }
+
+    if (this->pending_batch.size() == 1)
+    {
+        this->batch_timer->expires_from_now(this->max_batch_delay);
+        this->batch_timer->async_wait(std::bind(&pbft::handle_batch_timeout, shared_from_this(), std::placeholders::_1));
+    }
+}
+
+void
+pbft::send_batch()
+{
+    if (this->pending_batch.empty())
+    {
+        return;
+    }
+
+    if (this->batch_timer)
+    {
+        this->batch_timer->cancel();
+    }
+
+    std::vector<std::weak_ptr<session_base>> sessions;
+
+    // a batch is always wrapped, even a lone request, so replicas only ever see one shape with batching on...
+    pbft_request batch;
+    batch.set_type(PBFT_REQ_BATCH);
+    batch.set_timestamp(this->now());
+
+    for (auto& batched : this->pending_batch)
+    {
+        // a batch lists the digests of requests every replica already has, or carries the requests themselves...
+        if (this->digest_preprepares)
+        {
+            batch.mutable_batch()->add_request_hashes(std::move(batched.hash));
+        }
+        else
+        {
+            batch.mutable_batch()->add_requests(std::move(batched.request));
+        }
+
+        sessions.emplace_back(std::move(batched.session));
+    }
+
+    LOG(debug) << "Sending batch of " << this->pending_batch.size() << " requests";
+
+    this->pending_batch.clear();
+
+    const auto request = batch.SerializeAsString();
+
+    auto op = this->setup_request_operation(request, this->crypto->hash(request));
+    op->set_sessions(std::move(sessions));
+
+    this->do_preprepare(op);
+}
+
+void
+pbft::handle_batch_timeout(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        // the batch filled up and was sent before its time ran out...
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->pbft_lock);
+
+    // a timeout that was already queued when its batch filled up sends the next batch early, which is harmless...
+    this->send_batch();
+}
+
+void
+pbft::maybe_record_request(const pbft_msg& msg, const std::shared_ptr<pbft_operation>& op, const bzn_envelope& original_msg)
+{
+    if (op->has_request())
+    {
+        return;
+    }
+
+    if (!this->digest_preprepares)
+    {
+        // handle_message has already checked the request against its hash...
+        if (!msg.request().empty())
+        {
+            op->record_request(msg.request());
+        }
+
+        return;
+    }
+
+    // a replica that committed the operation has its request, sparing the primary...
+    const auto fetch_from = (msg.type() == PBFT_MSG_COMMIT && original_msg.sender() != this->uuid)
+        ? original_msg.sender() : bzn::uuid_t();
+
+    if (auto request = this->find_disseminated_request(msg.request(), op->sequence, op->request_hash, fetch_from))
+    {
+        op->record_request(*request);
     }
 }
 
@@ -317,8 +930,10 @@ pbft::handle_preprepare(const pbft_msg& msg, const bzn_envelope& original_msg)
     // Note that if we get the same preprepare more than once, we can still accept it
     const log_key_t log_key(msg.view(), msg.sequence());
 
-    if (auto lookup = this->accepted_preprepares.find(log_key);
-        lookup != this->accepted_preprepares.end()
+    auto& accepted_preprepares = this->shard_for(msg.sequence()).accepted_preprepares;
+
+    if (auto lookup = accepted_preprepares.find(log_key);
+        lookup != accepted_preprepares.end()
         && std::get<2>(lookup->second) != msg.request_hash())
     {
 
@@ -329,7 +944,7 @@ pbft::handle_preprepare(const pbft_msg& msg, const bzn_envelope& original_msg)
     {
         auto op = this->find_operation(msg);
         op->record_preprepare(original_msg);
-        this->maybe_record_request(msg, op);
+        this->maybe_record_request(msg, op, original_msg);
 
         // This assignment will be redundant if we've seen this preprepare before, but that's fine
         accepted_preprepares[log_key] = op->get_operation_key();
@@ -351,7 +966,7 @@ pbft::handle_prepare(const pbft_msg& msg, const bzn_envelope& original_msg)
     auto op = this->find_operation(msg);
 
     op->record_prepare(original_msg);
-    this->maybe_record_request(msg, op);
+    this->maybe_record_request(msg, op, original_msg);
     this->maybe_advance_operation_state(op);
 }
 
@@ -362,7 +977,7 @@ pbft::handle_commit(const pbft_msg& msg, const bzn_envelope& original_msg)
     auto op = this->find_operation(msg);
 
     op->record_commit(original_msg);
-    this->maybe_record_request(msg, op);
+    this->maybe_record_request(msg, op, original_msg);
     this->maybe_advance_operation_state(op);
 }
 
@@ -466,7 +1081,10 @@ pbft::broadcast(const bzn::encoded_message& msg)
 {
     auto msg_ptr = std::make_shared<bzn::encoded_message>(msg);
 
-    for (const auto& peer : this->current_peers())
+    // the configuration may change under us while we send...
+    const auto peers = this->current_peers_ptr();
+
+    for (const auto& peer : *peers)
     {
         this->node->send_message_str(make_endpoint(peer), msg_ptr);
     }
@@ -504,7 +1122,12 @@ pbft::do_preprepare(const std::shared_ptr<pbft_operation>& op)
     LOG(debug) << "Doing preprepare for operation " << op->debug_string();
 
     pbft_msg msg = this->common_message_setup(op, PBFT_MSG_PREPREPARE);
-    msg.set_request(op->get_encoded_request());
+
+    // every replica was sent the client's request by the node that received it...
+    if (!this->digest_preprepares || op->get_request().type() != PBFT_REQ_DATABASE)
+    {
+        msg.set_request(op->get_encoded_request());
+    }
 
     this->broadcast(this->wrap_message(msg, "preprepare"));
 }
@@ -557,6 +1180,11 @@ pbft::do_committed(const std::shared_ptr<pbft_operation>& op)
     LOG(debug) << "Operation " << op->debug_string() << " is committed-local";
     op->end_commit_phase();
 
+    {
+        std::lock_guard<std::mutex> lock(this->in_flight_lock);
+        this->in_flight_sequences.erase(op->sequence);
+    }
+
     if (this->audit_enabled)
     {
         audit_message msg;
@@ -568,9 +1196,17 @@ pbft::do_committed(const std::shared_ptr<pbft_operation>& op)
     }
 
     // TODO: this needs to be refactored to be service-agnostic
-    if (op->get_request().type() == PBFT_REQ_DATABASE)
+    if (op->get_request().type() == PBFT_REQ_DATABASE || op->get_request().type() == PBFT_REQ_BATCH)
     {
-        this->io_context->post(std::bind(&pbft_service_base::apply_operation, this->service, this->find_operation(op)));
+        // requests agreed on by digest are put back into their batch, and answered by the node the client used...
+        auto executed = this->digest_preprepares ? this->expand_request(op) : this->find_operation(op);
+        if (!executed)
+        {
+            LOG(info) << "Holding execution of " << op->debug_string() << " until the requests it lists arrive";
+            return;
+        }
+
+        this->io_context->post(std::bind(&pbft_service_base::apply_operation, this->service, executed));
     }
     else
     {
@@ -584,14 +1220,21 @@ pbft::do_committed(const std::shared_ptr<pbft_operation>& op)
             , this->crypto->hash(smsg), nullptr);
         new_op->record_request(smsg);
         this->io_context->post(std::bind(&pbft_service_base::apply_operation, this->service, new_op));
-            request.SerializeAsString();
     }
 }
 
 size_t
 pbft::outstanding_operations_count() const
 {
-    return operations.size();
+    size_t count = 0;
+
+    for (const auto& shard : this->operation_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+        count += shard.operations.size();
+    }
+
+    return count;
 }
 
 bool
@@ -600,10 +1243,12 @@ pbft::is_primary() const
     return this->get_primary().uuid == this->uuid;
 }
 
-const peer_address_t&
+peer_address_t
 pbft::get_primary() const
 {
-    return this->current_peers()[this->view % this->current_peers().size()];
+    // the configuration can change under us, so the peers are held while they are read and the primary is copied out...
+    const auto peers = this->current_peers_ptr();
+    return (*peers)[this->view % peers->size()];
 }
 
 // Find this node's record of an operation (creating a new record for it if this is the first time we've heard of it)
@@ -623,6 +1268,7 @@ std::shared_ptr<pbft_operation>
 pbft::find_operation(uint64_t view, uint64_t sequence, const bzn::hash_t& req_hash)
 {
     auto key = bzn::operation_key_t(view, sequence, req_hash);
+    auto& operations = this->shard_for(sequence).operations;
 
     auto lookup = operations.find(key);
     if (lookup == operations.end())
@@ -647,6 +1293,30 @@ pbft::wrap_message(const pbft_msg& msg, const std::string& /*debug_info*/)
     result.set_pbft(msg.SerializeAsString());
     result.set_sender(this->uuid);
 
+    // only the normal case messages no one else needs to be shown, every peer is sent the same copy...
+    if (this->mac_authenticators && (msg.type() == PBFT_MSG_PREPARE || msg.type() == PBFT_MSG_COMMIT))
+    {
+        std::vector<bzn::uuid_t> recipients;
+        for (const auto& peer : *this->current_peers_ptr())
+        {
+            recipients.emplace_back(peer.uuid);
+        }
+
+        if (this->crypto->authenticate(result, recipients))
+        {
+            return result.SerializeAsString();
+        }
+
+        // a peer left without a mac would drop the message, but every peer can check a signature...
+        LOG(warning) << "Signing " << msg.type() << " message, authenticators could not be made for every peer";
+        result.clear_authenticator();
+    }
+
+    if (this->sign_messages)
+    {
+        this->crypto->sign(result);
+    }
+
     return result.SerializeAsString();
 }
 
@@ -657,6 +1327,11 @@ pbft::wrap_message(const pbft_membership_msg& msg, const std::string& /*debug_in
     result.set_pbft_membership(msg.SerializeAsString());
     result.set_sender(this->uuid);
 
+    if (this->sign_messages)
+    {
+        this->crypto->sign(result);
+    }
+
     return result.SerializeAsString();
 }
 
@@ -687,6 +1362,88 @@ pbft::set_audit_enabled(bool setting)
     this->audit_enabled = setting;
 }
 
+void
+pbft::set_checkpoint_interval(uint64_t interval, double high_water_interval_in_checkpoints)
+{
+    // sequences past the high water mark could never reach the checkpoint that moves it on...
+    if (interval < 2 || std::lround(interval * high_water_interval_in_checkpoints) < int64_t(interval))
+    {
+        throw std::runtime_error("The high water mark must be at least one checkpoint interval of 2 or more sequences");
+    }
+
+    std::lock_guard<std::mutex> lock(this->pbft_lock);
+
+    this->checkpoint_interval = interval;
+    this->high_water_interval_in_checkpoints = high_water_interval_in_checkpoints;
+    this->high_water_mark = this->stable_checkpoint.first + this->high_water_window();
+}
+
+uint64_t
+pbft::high_water_window() const
+{
+    return std::lround(this->checkpoint_interval * this->high_water_interval_in_checkpoints);
+}
+
+void
+pbft::set_digest_preprepares(bool setting)
+{
+    this->digest_preprepares = setting;
+}
+
+void
+pbft::set_message_authentication(bool sign_messages, bool mac_authenticators)
+{
+    this->sign_messages = sign_messages;
+
+    // authenticators take the place of signatures, so there are none where nothing is signed...
+    if (mac_authenticators && !sign_messages)
+    {
+        LOG(warning) << "Not using authenticators because outgoing messages are not signed";
+    }
+    this->mac_authenticators = sign_messages && mac_authenticators;
+}
+
+void
+pbft::set_max_in_flight(size_t sequences)
+{
+    std::lock_guard<std::mutex> lock(this->pbft_lock);
+
+    this->max_in_flight_sequences = sequences;
+}
+
+bool
+pbft::window_full() const
+{
+    if (this->next_issued_sequence_number > this->high_water_mark)
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(this->in_flight_lock);
+
+    return this->max_in_flight_sequences && this->in_flight_sequences.size() >= this->max_in_flight_sequences;
+}
+
+void
+pbft::set_batching(size_t max_requests, std::chrono::milliseconds max_delay)
+{
+    std::lock_guard<std::mutex> lock(this->pbft_lock);
+
+    this->max_batch_requests = std::max(max_requests, size_t(1));
+    this->max_batch_delay = max_delay;
+
+    if (this->max_batch_requests > 1 && !this->batch_timer)
+    {
+        this->batch_timer = this->io_context->make_unique_steady_timer();
+    }
+
+    // requests waiting for a batch that can no longer fill up go now...
+    if (this->pending_batch.size() >= this->max_batch_requests)
+    {
+        this->send_batch();
+    }
+}
+
 void
 pbft::notify_audit_failure_detected()
 {
@@ -798,9 +1555,8 @@ pbft::stabilize_checkpoint(const checkpoint_t& cp)
     this->clear_checkpoint_messages_until(cp);
     this->clear_operations_until(cp);
 
-    this->low_water_mark = std::max(this->low_water_mark, cp.first);
-    this->high_water_mark = std::max(this->high_water_mark,
-        cp.first + std::lround(HIGH_WATER_INTERVAL_IN_CHECKPOINTS * CHECKPOINT_INTERVAL));
+    this->low_water_mark = std::max(this->low_water_mark.load(), cp.first);
+    this->high_water_mark = std::max(this->high_water_mark.load(), cp.first + this->high_water_window());
 
     this->service->consolidate_log(cp.first);
 
@@ -825,7 +1581,7 @@ pbft::request_checkpoint_state(const checkpoint_t& cp)
     this->node->send_message_str(make_endpoint(selected), msg_ptr);
 }
 
-const peer_address_t&
+peer_address_t
 pbft::select_peer_for_checkpoint(const checkpoint_t& cp)
 {
     // choose one of the peers who vouch for this checkpoint at random
@@ -863,8 +1619,8 @@ void
 pbft::clear_local_checkpoints_until(const checkpoint_t& cp)
 {
     const auto local_start = this->local_unstable_checkpoints.begin();
-    // Iterator to the first unstable checkpoint that's newer than this one. This logic assumes that CHECKPOINT_INTERVAL
-    // is >= 2, otherwise we would have do do something awkward here
+    // Iterator to the first unstable checkpoint that's newer than this one. This logic assumes that the checkpoint
+    // interval is >= 2, otherwise we would have do do something awkward here
     const auto local_end = this->local_unstable_checkpoints.upper_bound(checkpoint_t(cp.first+1, ""));
     const size_t local_removed = std::distance(local_start, local_end);
     this->local_unstable_checkpoints.erase(local_start, local_end);
@@ -885,13 +1641,67 @@ void
 pbft::clear_operations_until(const checkpoint_t& cp)
 {
     size_t ops_removed = 0;
-    auto it = this->operations.begin();
-    while (it != this->operations.end())
+    std::vector<request_hash_t> cleared_requests;
+    for (auto& shard : this->operation_shards)
     {
-        if(it->second->sequence <= cp.first)
+        std::lock_guard<std::mutex> lock(shard.lock);
+
+        auto it = shard.operations.begin();
+        while (it != shard.operations.end())
+        {
+            if(it->second->sequence <= cp.first)
+            {
+                cleared_requests.emplace_back(it->second->request_hash);
+                it = shard.operations.erase(it);
+                ops_removed++;
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+
+    this->clear_disseminated_requests(cleared_requests, cp.first);
+    this->clear_forwarded_requests();
+
+    // a sequence behind a stable checkpoint is committed at enough nodes whether or not we saw it...
+    std::lock_guard<std::mutex> lock(this->in_flight_lock);
+    this->in_flight_sequences.erase(this->in_flight_sequences.begin(), this->in_flight_sequences.upper_bound(cp.first));
+
+    LOG(debug) << boost::format("Cleared %1% old operation records") % ops_removed;
+}
+
+void
+pbft::clear_disseminated_requests(const std::vector<request_hash_t>& hashes, uint64_t sequence)
+{
+    std::lock_guard<std::mutex> lock(this->disseminated_lock);
+
+    // the requests of cleared operations, and those of the batches among them...
+    for (const auto& hash : hashes)
+    {
+        if (auto stored = this->disseminated_requests.find(hash); stored != this->disseminated_requests.end())
         {
-            it = this->operations.erase(it);
-            ops_removed++;
+            pbft_request request;
+            if (request.ParseFromString(stored->second.request) && request.type() == PBFT_REQ_BATCH)
+            {
+                for (const auto& listed : request.batch().request_hashes())
+                {
+                    this->disseminated_requests.erase(listed);
+                }
+            }
+
+            this->disseminated_requests.erase(stored);
+        }
+    }
+
+    // ...and any never ordered, once they are too old to be
+    const auto oldest = this->now() - MAX_REQUEST_AGE_MS;
+    for (auto it = this->disseminated_requests.begin(); it != this->disseminated_requests.end(); )
+    {
+        if (it->second.received < oldest)
+        {
+            it = this->disseminated_requests.erase(it);
         }
         else
         {
@@ -899,7 +1709,46 @@ pbft::clear_operations_until(const checkpoint_t& cp)
         }
     }
 
-    LOG(debug) << boost::format("Cleared %1% old operation records") % ops_removed;
+    for (auto it = this->deferred_executions.begin(); it != this->deferred_executions.end() && it->first <= sequence; )
+    {
+        LOG(warning) << "Giving up on executing seq " << it->first << ", which is behind the stable checkpoint";
+        it = this->deferred_executions.erase(it);
+    }
+
+    for (auto it = this->awaited_requests.begin(); it != this->awaited_requests.end(); )
+    {
+        it->second.erase(it->second.begin(), it->second.upper_bound(sequence));
+
+        if (it->second.empty())
+        {
+            this->fetched_requests.erase(it->first);
+            it = this->awaited_requests.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void
+pbft::clear_forwarded_requests()
+{
+    std::lock_guard<std::mutex> lock(this->forwarded_lock);
+
+    // the primary has refused them by now if it was going to...
+    const auto oldest = this->now() - MAX_REQUEST_AGE_MS;
+    for (auto it = this->forwarded_requests.begin(); it != this->forwarded_requests.end(); )
+    {
+        if (it->second.forwarded < oldest)
+        {
+            it = this->forwarded_requests.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
 }
 
 size_t
@@ -911,7 +1760,7 @@ pbft::quorum_size() const
 size_t
 pbft::max_faulty_nodes() const
 {
-    return this->current_peers().size()/3;
+    return this->current_peers_ptr()->size()/3;
 }
 
 void
@@ -941,10 +1790,16 @@ pbft::handle_database_message(const bzn::json_message& json, std::shared_ptr<bzn
     *response.mutable_header() = msg.db().header();
 
     pbft_request req;
+    req.set_type(PBFT_REQ_DATABASE);
     *req.mutable_operation() = msg.db();
     req.set_timestamp(this->now()); //TODO: the timestamp needs to come from the client
 
-    this->handle_request(req, json, session);
+    if (!this->handle_request(req, json, session))
+    {
+        response.mutable_error()->set_message(bzn::MSG_TOO_MANY_REQUESTS);
+        session->send_message(std::make_shared<bzn::encoded_message>(response.SerializeAsString()), false);
+        return;
+    }
 
     LOG(debug) << "Sending request ack: " << response.ShortDebugString();
     session->send_message(std::make_shared<bzn::encoded_message>(response.SerializeAsString()), false);
@@ -993,10 +1848,15 @@ pbft::get_status()
 
     status["unstable_checkpoints_count"] = uint64_t(this->unstable_checkpoints_count());
     status["next_issued_sequence_number"] = this->next_issued_sequence_number;
-    status["view"] = this->view;
+    {
+        std::lock_guard<std::mutex> in_flight_lock(this->in_flight_lock);
+        status["in_flight_sequences"] = uint64_t(this->in_flight_sequences.size());
+    }
+    status["view"] = this->view.load();
 
     status["peer_index"] = bzn::json_message();
-    for(const auto& p : this->current_peers())
+    const auto peers = this->current_peers_ptr();
+    for(const auto& p : *peers)
     {
         bzn::json_message peer;
         peer["host"] = p.host;
@@ -1044,16 +1904,11 @@ pbft::current_peers_ptr() const
     throw std::runtime_error("No current configuration!");
 }
 
-const std::vector<bzn::peer_address_t>&
-pbft::current_peers() const
-{
-    return *(this->current_peers_ptr());
-}
-
-const peer_address_t&
+peer_address_t
 pbft::get_peer_by_uuid(const std::string& uuid) const
 {
-    for (auto const& peer : this->current_peers())
+    const auto peers = this->current_peers_ptr();
+    for (auto const& peer : *peers)
     {
         if (peer.uuid == uuid)
         {
@@ -23,16 +23,20 @@
 #include <status/status_provider_base.hpp>
 #include <crypto/crypto_base.hpp>
 #include <proto/audit.pb.h>
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <optional>
 #include <gtest/gtest_prod.h>
 
 namespace
 {
     const std::chrono::milliseconds HEARTBEAT_INTERVAL{std::chrono::milliseconds(5000)};
     const std::string INITIAL_CHECKPOINT_HASH = "<null db state>";
-    const uint64_t CHECKPOINT_INTERVAL = 100; //TODO: KEP-574
-    const double HIGH_WATER_INTERVAL_IN_CHECKPOINTS = 2.0; //TODO: KEP-574
+    const uint64_t CHECKPOINT_INTERVAL = 100; // defaults, see pbft::set_checkpoint_interval
+    const double HIGH_WATER_INTERVAL_IN_CHECKPOINTS = 2.0;
     const uint64_t MAX_REQUEST_AGE_MS = 300000; // 5 minutes
+    const size_t OPERATION_SHARDS = 16;
 }
 
 namespace bzn
@@ -64,7 +68,7 @@ namespace bzn
 
         bool is_primary() const override;
 
-        const peer_address_t& get_primary() const override;
+        peer_address_t get_primary() const override;
 
         const bzn::uuid_t& get_uuid() const override;
 
@@ -72,6 +76,27 @@ namespace bzn
 
         void set_audit_enabled(bool setting);
 
+        // the primary orders up to max_requests client requests under one sequence number, sending a batch once it
+        // is full or its oldest request has waited max_delay... a single request per batch turns batching off
+        void set_batching(size_t max_requests, std::chrono::milliseconds max_delay);
+
+        // a checkpoint is taken every interval sequences, and sequences are accepted up to
+        // high_water_interval_in_checkpoints intervals past the last stable one... throws if that is under one interval
+        void set_checkpoint_interval(uint64_t interval, double high_water_interval_in_checkpoints);
+
+        // the primary refuses client requests while this many of the sequences it issued are not committed, or while
+        // the next sequence would pass the high water mark... 0 leaves only the high water mark
+        void set_max_in_flight(size_t sequences);
+
+        // the node receiving a client request sends it to every replica, and the primary orders its digest... a
+        // replica missing a request fetches it from a node that committed it. Every node in the swarm must agree
+        void set_digest_preprepares(bool setting);
+
+        // pbft messages are signed when sign_messages is set... with mac_authenticators, prepares and commits instead
+        // carry a MAC for each peer, leaving signatures to the messages kept as proof, such as checkpoints. Ignored
+        // unless messages are signed
+        void set_message_authentication(bool sign_messages, bool mac_authenticators);
+
         checkpoint_t latest_stable_checkpoint() const;
 
         checkpoint_t latest_checkpoint() const;
@@ -87,17 +112,35 @@ namespace bzn
         bzn::json_message get_status() override;
 
     private:
+        struct operation_shard;
+
+        // the caller holds the lock of the shard owning the sequence...
         std::shared_ptr<pbft_operation> find_operation(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash);
         std::shared_ptr<pbft_operation> find_operation(const pbft_msg& msg);
         std::shared_ptr<pbft_operation> find_operation(const std::shared_ptr<pbft_operation>& op);
 
         bool preliminary_filter_msg(const pbft_msg& msg);
 
-        void handle_request(const pbft_request& msg, const bzn::json_message& original_msg, const std::shared_ptr<session_base>& session = nullptr);
+        operation_shard& shard_for(uint64_t sequence);
+
+        // returns false if the primary's window is full and the request was refused...
+        bool handle_request(const pbft_request& msg, const bzn::json_message& original_msg, const std::shared_ptr<session_base>& session = nullptr);
+        bool order_request(const pbft_request& msg, const bzn::encoded_message& request, const request_hash_t& hash
+            , const std::shared_ptr<session_base>& session);
+        void batch_request(const bzn::encoded_message& request, const request_hash_t& hash, const std::shared_ptr<session_base>& session);
+        void send_batch();
+        void handle_batch_timeout(const boost::system::error_code& ec);
+        bool window_full() const;
+        uint64_t high_water_window() const;
         void handle_preprepare(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_prepare(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_commit(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_checkpoint(const pbft_msg& msg, const bzn_envelope& original_msg);
+        void handle_disseminated_request(const pbft_msg& msg, const bzn_envelope& original_msg);
+        void handle_get_request(const pbft_msg& msg, const bzn_envelope& original_msg);
+        void handle_refused_request(const pbft_msg& msg, const bzn_envelope& original_msg);
+        void handle_forwarded_request(const pbft_msg& msg, const bzn_envelope& original_msg);
+        void refuse_request(const request_hash_t& hash, const bzn::uuid_t& sender);
         void handle_join_or_leave(const pbft_membership_msg& msg);
         void handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::session_base> session) const;
         void handle_set_state(const pbft_membership_msg& msg);
@@ -128,7 +171,7 @@ namespace bzn
         void checkpoint_reached_locally(uint64_t sequence);
         void maybe_stabilize_checkpoint(const checkpoint_t& cp);
         void stabilize_checkpoint(const checkpoint_t& cp);
-        const peer_address_t& select_peer_for_checkpoint(const checkpoint_t& cp);
+        peer_address_t select_peer_for_checkpoint(const checkpoint_t& cp);
         void request_checkpoint_state(const checkpoint_t& cp);
         std::string get_checkpoint_state(const checkpoint_t& cp) const;
         void set_checkpoint_state(const checkpoint_t& cp, const std::string& data);
@@ -142,14 +185,19 @@ namespace bzn
 
         bool initialize_configuration(const bzn::peers_list_t& peers);
         std::shared_ptr<const std::vector<bzn::peer_address_t>> current_peers_ptr() const;
-        const std::vector<bzn::peer_address_t>& current_peers() const;
-        const peer_address_t& get_peer_by_uuid(const std::string& uuid) const;
+        peer_address_t get_peer_by_uuid(const std::string& uuid) const;
         void broadcast_new_configuration(pbft_configuration::shared_const_ptr config);
         bool is_configuration_acceptable_in_new_view(hash_t config_hash);
         bool move_to_new_configuration(hash_t config_hash);
         bool proposed_config_is_acceptable(std::shared_ptr<pbft_configuration> config);
 
-        void maybe_record_request(const pbft_msg& msg, const std::shared_ptr<pbft_operation>& op);
+        void maybe_record_request(const pbft_msg& msg, const std::shared_ptr<pbft_operation>& op, const bzn_envelope& original_msg);
+        bool disseminate_request(const pbft_request& msg, const std::shared_ptr<session_base>& session);
+        std::optional<bzn::encoded_message> find_disseminated_request(const bzn::encoded_message& carried, uint64_t sequence
+            , const request_hash_t& hash, const bzn::uuid_t& fetch_from);
+        std::shared_ptr<pbft_operation> expand_request(const std::shared_ptr<pbft_operation>& op);
+        void clear_disseminated_requests(const std::vector<request_hash_t>& hashes, uint64_t sequence);
+        void clear_forwarded_requests();
 
         timestamp_t now() const;
         bool already_seen_request(const pbft_request& msg, const request_hash_t& hash) const;
@@ -157,11 +205,19 @@ namespace bzn
 
 
         // Using 1 as first value here to distinguish from default value of 0 in protobuf
-        uint64_t view = 1;
+        std::atomic<uint64_t> view{1};
         uint64_t next_issued_sequence_number = 1;
 
-        uint64_t low_water_mark;
-        uint64_t high_water_mark;
+        // moved on under pbft_lock, read by every message filter...
+        std::atomic<uint64_t> low_water_mark;
+        std::atomic<uint64_t> high_water_mark;
+
+        uint64_t checkpoint_interval = CHECKPOINT_INTERVAL;
+        double high_water_interval_in_checkpoints = HIGH_WATER_INTERVAL_IN_CHECKPOINTS;
+
+        size_t max_in_flight_sequences = 0;
+        std::set<uint64_t> in_flight_sequences; // issued by this primary and not yet committed
+        mutable std::mutex in_flight_lock;
 
         std::shared_ptr<bzn::node_base> node;
 
@@ -170,10 +226,19 @@ namespace bzn
 
         std::shared_ptr<pbft_failure_detector_base> failure_detector;
 
+        // Guards request intake, batching, checkpoints and configuration changes. Operations are kept in shards by
+        // sequence, each with its own lock, so preprepares, prepares and commits for different sequences are handled
+        // in parallel. Locks are taken in the order pbft_lock, then shard locks in index order, then in_flight_lock...
         std::mutex pbft_lock;
 
-        std::map<bzn::operation_key_t, std::shared_ptr<bzn::pbft_operation>> operations;
-        std::map<bzn::log_key_t, bzn::operation_key_t> accepted_preprepares;
+        struct operation_shard
+        {
+            mutable std::mutex lock;
+            std::map<bzn::operation_key_t, std::shared_ptr<bzn::pbft_operation>> operations;
+            std::map<bzn::log_key_t, bzn::operation_key_t> accepted_preprepares;
+        };
+
+        std::array<operation_shard, OPERATION_SHARDS> operation_shards;
 
         std::once_flag start_once;
 
@@ -182,6 +247,49 @@ namespace bzn
 
         bool audit_enabled = true;
 
+        struct batched_request
+        {
+            bzn::encoded_message request;
+            request_hash_t hash; // only kept when preprepares carry digests
+            std::weak_ptr<bzn::session_base> session;
+        };
+
+        size_t max_batch_requests = 1;
+        std::chrono::milliseconds max_batch_delay{0};
+        std::vector<batched_request> pending_batch;
+        std::unique_ptr<bzn::asio::steady_timer_base> batch_timer;
+
+        // Client requests sent to every replica, by digest. Operations still missing a request wait on it by
+        // sequence, and each missing request is fetched once. Taken after any shard lock...
+        struct disseminated_request
+        {
+            bzn::encoded_message request;
+            timestamp_t received;
+            std::weak_ptr<bzn::session_base> session; // held by the node the client sent the request to
+        };
+
+        // Requests forwarded to the primary, by digest, so the client can be told if the primary refuses one. Taken
+        // after any shard lock...
+        struct forwarded_request
+        {
+            database_header header;
+            timestamp_t forwarded;
+            std::weak_ptr<bzn::session_base> session;
+        };
+
+        std::unordered_map<request_hash_t, forwarded_request> forwarded_requests;
+        std::mutex forwarded_lock;
+
+        std::atomic<bool> digest_preprepares{false};
+
+        std::atomic<bool> sign_messages{false};
+        std::atomic<bool> mac_authenticators{false};
+        std::unordered_map<request_hash_t, disseminated_request> disseminated_requests;
+        std::map<request_hash_t, std::set<uint64_t>> awaited_requests;
+        std::set<request_hash_t> fetched_requests;
+        std::map<uint64_t, std::shared_ptr<pbft_operation>> deferred_executions; // committed, but missing a listed request
+        std::mutex disseminated_lock;
+
         checkpoint_t stable_checkpoint{0, INITIAL_CHECKPOINT_HASH};
         std::unordered_map<uuid_t, std::string> stable_checkpoint_proof;
 
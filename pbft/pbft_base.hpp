@@ -36,7 +36,7 @@ namespace bzn
 
         virtual bool is_primary() const = 0;
 
-        virtual const peer_address_t& get_primary() const = 0;
+        virtual peer_address_t get_primary() const = 0;
 
         virtual const bzn::uuid_t& get_uuid() const = 0;
 
@@ -19,6 +19,8 @@ using namespace bzn;
 bool
 pbft_config_store::add(pbft_configuration::shared_const_ptr config)
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     // TODO - should we be making a copy here instead?
     // currently the added config could be changed externally after being added
     return (this->configs.insert(std::make_pair(this->next_index++, std::make_pair(std::move(config), false)))).second;
@@ -39,6 +41,8 @@ pbft_config_store::find_by_hash(hash_t hash) const
 bool
 pbft_config_store::set_current(const hash_t& hash)
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     auto config = this->find_by_hash(hash);
     if (config == this->configs.end())
     {
@@ -52,6 +56,8 @@ pbft_config_store::set_current(const hash_t& hash)
 bool
 pbft_config_store::remove_prior_to(const hash_t& hash)
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     auto config = this->find_by_hash(hash);
     if (config == this->configs.end())
     {
@@ -76,6 +82,8 @@ pbft_config_store::remove_prior_to(const hash_t& hash)
 pbft_configuration::shared_const_ptr
 pbft_config_store::get(const hash_t& hash) const
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     auto config = this->find_by_hash(hash);
     return config != this->configs.end() ? config->second.first : nullptr;
 }
@@ -83,6 +91,8 @@ pbft_config_store::get(const hash_t& hash) const
 bool
 pbft_config_store::enable(const hash_t& hash, bool val)
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     // can't find_by_hash here because we need a non-const
     auto config = std::find_if(this->configs.begin(), this->configs.end(),
         [hash](auto& c)
@@ -102,6 +112,8 @@ pbft_config_store::enable(const hash_t& hash, bool val)
 bool
 pbft_config_store::is_enabled(const hash_t& hash) const
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     auto config = this->find_by_hash(hash);
     return config != this->configs.end() ? config->second.second : false;
 }
@@ -109,6 +121,8 @@ pbft_config_store::is_enabled(const hash_t& hash) const
 pbft_configuration::shared_const_ptr
 pbft_config_store::current() const
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     auto it = this->configs.find(this->current_index);
     return it != this->configs.end() ? it->second.first : nullptr;
 }
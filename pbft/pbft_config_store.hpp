@@ -16,11 +16,13 @@
 
 #include <pbft/pbft_configuration.hpp>
 #include <map>
+#include <mutex>
 
 namespace bzn
 {
     using hash_t = std::string;
 
+    // safe to use from several threads at once...
     class pbft_config_store
     {
     public:
@@ -55,6 +57,8 @@ namespace bzn
         config_map configs;
         index_t current_index = 0;
         index_t next_index = 1;
+
+        mutable std::mutex lock;
     };
 }
 
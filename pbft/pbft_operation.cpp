@@ -57,13 +57,11 @@ pbft_operation::get_encoded_request() const
 void
 pbft_operation::record_request(const bzn::encoded_message& wrapped_request)
 {
-    // not actually parsing the request because, for now, its still json
     this->encoded_request = wrapped_request;
 
-    if (this->parsed_request.ParseFromString(wrapped_request))
+    if (!this->parsed_request.ParseFromString(wrapped_request))
     {
-        LOG(error) << "Tried to record request as something not a valid request (perhaps an old json request?)";
-        // We don't consider this a failure case, for now, because it could be an old json request
+        LOG(error) << "Tried to record request as something not a valid request";
     }
 
     this->request_saved = true;
@@ -155,11 +153,23 @@ pbft_operation::debug_string() const
 void
 pbft_operation::set_session(std::weak_ptr<bzn::session_base> session)
 {
-    this->listener_session = std::move(session);
+    this->listener_sessions = {std::move(session)};
+}
+
+void
+pbft_operation::set_sessions(std::vector<std::weak_ptr<bzn::session_base>> sessions)
+{
+    this->listener_sessions = std::move(sessions);
 }
 
 std::weak_ptr<bzn::session_base>
 pbft_operation::session() const
 {
-    return this->listener_session;
+    return this->listener_sessions.empty() ? std::weak_ptr<bzn::session_base>() : this->listener_sessions.front();
+}
+
+const std::vector<std::weak_ptr<bzn::session_base>>&
+pbft_operation::sessions() const
+{
+    return this->listener_sessions;
 }
@@ -19,6 +19,7 @@
 #include <bootstrap/bootstrap_peers_base.hpp>
 #include <cstdint>
 #include <string>
+#include <vector>
 #include <node/session_base.hpp>
 
 namespace bzn
@@ -43,6 +44,9 @@ namespace bzn
 
         void set_session(std::weak_ptr<bzn::session_base>);
 
+        // one per request of a batch, in the batch's order...
+        void set_sessions(std::vector<std::weak_ptr<bzn::session_base>> sessions);
+
         operation_key_t get_operation_key() const;
         pbft_operation_state get_state() const;
 
@@ -60,6 +64,8 @@ namespace bzn
 
         std::weak_ptr<bzn::session_base> session() const;
 
+        const std::vector<std::weak_ptr<bzn::session_base>>& sessions() const;
+
         const pbft_request& get_request() const;
         const bzn::encoded_message& get_encoded_request() const;
 
@@ -83,7 +89,7 @@ namespace bzn
         std::set<bzn::uuid_t> prepares_seen;
         std::set<bzn::uuid_t> commits_seen;
 
-        std::weak_ptr<bzn::session_base> listener_session;
+        std::vector<std::weak_ptr<bzn::session_base>> listener_sessions;
 
         bzn::encoded_message encoded_request;
         pbft_request parsed_request;
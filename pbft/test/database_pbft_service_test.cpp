@@ -209,4 +209,128 @@ TEST(database_pbft_service, test_that_set_state_catches_up_backlogged_operations
 
     // operations applied should be caught up now
     ASSERT_EQ(uint64_t(102), dps.applied_requests_count());
-}
\ No newline at end of file
+}
+
+TEST(database_pbft_service, test_that_stored_requests_are_executed_after_restart)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+    auto mock_crud = std::make_shared<bzn::Mockcrud_base>();
+
+    EXPECT_CALL(*mock_crud, handle_request(ResultOf(test::database_msg_seq, 1), _)).Times(Exactly(1));
+    EXPECT_CALL(*mock_io_context, post(_)).Times(Exactly(4));
+
+    {
+        bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, TEST_UUID);
+
+        test::do_operation(1, dps);
+        test::do_operation(3, dps);
+        test::do_operation(4, dps);
+        ASSERT_EQ(uint64_t(1), dps.applied_requests_count());
+    }
+
+    // the node comes back with the requests it had agreed on but could not execute yet...
+    bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, TEST_UUID);
+    ASSERT_EQ(uint64_t(1), dps.applied_requests_count());
+
+    EXPECT_CALL(*mock_crud, handle_request(ResultOf(test::database_msg_seq, 2), _)).Times(Exactly(1));
+    EXPECT_CALL(*mock_crud, handle_request(ResultOf(test::database_msg_seq, 3), _)).Times(Exactly(1));
+    EXPECT_CALL(*mock_crud, handle_request(ResultOf(test::database_msg_seq, 4), _)).Times(Exactly(1));
+
+    test::do_operation(2, dps);
+
+    ASSERT_EQ(uint64_t(4), dps.applied_requests_count());
+
+    // repeats of executed requests are ignored...
+    test::do_operation(3, dps);
+}
+
+
+TEST(database_pbft_service, test_that_executed_requests_are_forgotten_at_checkpoints)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+    auto mock_crud = std::make_shared<bzn::Mockcrud_base>();
+
+    EXPECT_CALL(*mock_crud, handle_request(_, _)).Times(Exactly(12));
+    EXPECT_CALL(*mock_io_context, post(_)).Times(Exactly(12));
+
+    bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, TEST_UUID);
+
+    for (uint64_t seq = 1; seq <= 12; ++seq)
+    {
+        test::do_operation(seq, dps);
+    }
+
+    test::do_operation(14, dps);
+
+    // sequence numbers are stored in order, along with the next request sequence...
+    EXPECT_EQ(size_t(14), mem_storage->get_keys(TEST_UUID).size());
+
+    dps.consolidate_log(10);
+
+    auto keys = mem_storage->get_keys(TEST_UUID);
+    ASSERT_EQ(size_t(4), keys.size());
+    EXPECT_EQ("00000000000000000011", keys[0]);
+    EXPECT_EQ("00000000000000000012", keys[1]);
+    EXPECT_EQ("00000000000000000014", keys[2]);
+
+    // the unexecuted request survives a checkpoint past it...
+    dps.consolidate_log(14);
+    EXPECT_EQ(size_t(2), mem_storage->get_keys(TEST_UUID).size());
+}
+
+
+TEST(database_pbft_service, test_that_a_batch_is_executed_in_order_under_one_sequence)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+    auto mock_crud = std::make_shared<bzn::Mockcrud_base>();
+
+    bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, TEST_UUID);
+
+    pbft_request batch;
+    batch.set_type(PBFT_REQ_BATCH);
+
+    std::vector<std::weak_ptr<bzn::session_base>> sessions;
+    auto mock_session = std::make_shared<bzn::Mocksession_base>();
+
+    for (uint64_t i = 1; i <= 3; ++i)
+    {
+        pbft_request msg;
+        msg.set_type(PBFT_REQ_DATABASE);
+        msg.set_timestamp(1000 + i);
+        msg.mutable_operation()->mutable_header()->set_transaction_id(i);
+        msg.mutable_operation()->mutable_create()->set_key("key" + std::to_string(i));
+
+        batch.mutable_batch()->add_requests(msg.SerializeAsString());
+
+        // only the second requester is still connected...
+        sessions.emplace_back(i == 2 ? mock_session : std::make_shared<bzn::Mocksession_base>());
+    }
+
+    auto operation = std::make_shared<bzn::pbft_operation>(0, 1, "batchhash", nullptr);
+    operation->record_request(batch.SerializeAsString());
+    operation->set_sessions(sessions);
+
+    {
+        InSequence dummy;
+
+        for (uint64_t i = 1; i <= 3; ++i)
+        {
+            EXPECT_CALL(*mock_crud, handle_request(ResultOf(test::database_msg_seq, i), _)).WillOnce(Invoke(
+                [&, i](const database_msg& request, const std::shared_ptr<bzn::session_base>& session)
+                {
+                    EXPECT_EQ(1000 + i, request.header().timestamp());
+                    EXPECT_EQ(i == 2, session == mock_session);
+                }));
+        }
+    }
+
+    // the batch is one operation as far as pbft is concerned...
+    EXPECT_CALL(*mock_io_context, post(_)).Times(Exactly(1));
+
+    dps.apply_operation(operation);
+
+    EXPECT_EQ(uint64_t(1), dps.applied_requests_count());
+}
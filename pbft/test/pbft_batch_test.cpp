@@ -0,0 +1,308 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <pbft/test/pbft_proto_test.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+using namespace ::testing;
+
+namespace
+{
+    const std::chrono::milliseconds BATCH_TIMEOUT{10};
+
+    const size_t BENCHMARK_REQUESTS{1024};
+    const std::vector<size_t> BENCHMARK_BATCH_SIZES{1, 4, 16, 64};
+}
+
+
+namespace bzn
+{
+    using namespace test;
+
+    class pbft_batch_test : public pbft_proto_test
+    {
+    public:
+        pbft_batch_test()
+        {
+            EXPECT_CALL(*this->batch_timer, async_wait(_)).WillRepeatedly(Invoke(
+                [&](auto handler)
+                {
+                    this->batch_timer_callback = handler;
+                }));
+
+            // the primary broadcasts each preprepare, only one copy is kept...
+            EXPECT_CALL(*this->mock_node, send_message_str(_, _)).WillRepeatedly(Invoke(
+                [&](auto, auto wrapped_msg)
+                {
+                    ++this->messages_sent;
+
+                    if (auto msg = extract_pbft_msg(*wrapped_msg); msg.type() == PBFT_MSG_PREPREPARE
+                        && (this->sent_preprepares.empty() || this->sent_preprepares.back().sequence() != msg.sequence()))
+                    {
+                        this->sent_preprepares.emplace_back(std::move(msg));
+                    }
+                }));
+
+            EXPECT_CALL(*this->mock_io_context, post(_)).WillRepeatedly(Invoke(
+                [&](auto task)
+                {
+                    this->posted.emplace_back(std::move(task));
+                }));
+
+            EXPECT_CALL(*this->mock_service, service_state_hash(_)).WillRepeatedly(Invoke(
+                [](auto sequence)
+                {
+                    return std::to_string(sequence);
+                }));
+        }
+
+        // must follow build_pbft, which takes the fixture's first timer for the audit heartbeat...
+        void enable_batching(size_t batch_size)
+        {
+            EXPECT_CALL(*this->mock_io_context, make_unique_steady_timer()).Times(AtMost(1)).WillOnce(Invoke(
+                [&]()
+                {
+                    return std::move(this->batch_timer);
+                }));
+
+            this->pbft->set_batching(batch_size, BATCH_TIMEOUT);
+        }
+
+        void send_database_request(const std::shared_ptr<session_base>& session = nullptr)
+        {
+            pbft_request request;
+            request.set_type(PBFT_REQ_DATABASE);
+            request.set_timestamp(this->now());
+            request.mutable_operation()->mutable_create()->set_key("key_" + std::to_string(++this->index));
+            request.mutable_operation()->mutable_create()->set_value("value_" + std::to_string(this->index));
+
+            bzn::json_message json_msg;
+            json_msg["msg"] = request.SerializeAsString();
+
+            this->handle_request(request, json_msg, session);
+        }
+
+        void receive(const pbft_msg& msg, const bzn::uuid_t& sender)
+        {
+            auto wmsg = wrap_pbft_msg(msg);
+            wmsg.set_sender(sender);
+
+            this->pbft->handle_message(msg, wmsg);
+        }
+
+        // the primary gets its own preprepare back, then every node's prepare and commit...
+        void agree(const pbft_msg& preprepare)
+        {
+            this->receive(preprepare, this->uuid);
+
+            for (const auto type : {PBFT_MSG_PREPARE, PBFT_MSG_COMMIT})
+            {
+                pbft_msg msg;
+                msg.set_view(preprepare.view());
+                msg.set_sequence(preprepare.sequence());
+                msg.set_type(type);
+                msg.set_request_hash(preprepare.request_hash());
+
+                for (const auto& peer : TEST_PEER_LIST)
+                {
+                    this->receive(msg, peer.uuid);
+                }
+            }
+        }
+
+        // tell pbft the operation has been executed, agreeing on the checkpoints it reaches...
+        void execute(const pbft_msg& preprepare)
+        {
+            this->service_execute_handler(std::make_shared<pbft_operation>(preprepare.view(), preprepare.sequence(),
+                preprepare.request_hash(), nullptr));
+
+            if (preprepare.sequence() % CHECKPOINT_INTERVAL == 0)
+            {
+                this->stabilize_checkpoint(preprepare.sequence());
+            }
+        }
+
+        pbft_request sent_batch(size_t index = 0) const
+        {
+            pbft_request batch;
+            EXPECT_TRUE(batch.ParseFromString(this->sent_preprepares.at(index).request()));
+
+            return batch;
+        }
+
+        std::unique_ptr<bzn::asio::Mocksteady_timer_base> batch_timer =
+            std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+        bzn::asio::wait_handler batch_timer_callback;
+
+        std::vector<pbft_msg> sent_preprepares;
+        size_t messages_sent = 0;
+        std::vector<bzn::asio::task> posted;
+    };
+
+
+    TEST_F(pbft_batch_test, test_that_a_full_batch_is_sent_under_one_sequence)
+    {
+        this->build_pbft();
+        this->enable_batching(4);
+
+        for (size_t i = 0; i < 3; ++i)
+        {
+            this->send_database_request();
+        }
+
+        EXPECT_TRUE(this->sent_preprepares.empty());
+
+        this->send_database_request();
+
+        ASSERT_EQ(size_t(1), this->sent_preprepares.size());
+        EXPECT_EQ(1u, this->pbft->outstanding_operations_count());
+
+        const auto batch = this->sent_batch();
+        EXPECT_EQ(PBFT_REQ_BATCH, batch.type());
+        ASSERT_EQ(4, batch.batch().requests_size());
+
+        // in the order they arrived...
+        for (int i = 0; i < batch.batch().requests_size(); ++i)
+        {
+            pbft_request request;
+            ASSERT_TRUE(request.ParseFromString(batch.batch().requests(i)));
+            EXPECT_EQ("key_" + std::to_string(i + 1), request.operation().create().key());
+        }
+
+        // the next batch starts empty...
+        this->send_database_request();
+        EXPECT_EQ(size_t(1), this->sent_preprepares.size());
+    }
+
+
+    TEST_F(pbft_batch_test, test_that_a_partial_batch_is_sent_when_its_time_runs_out)
+    {
+        this->build_pbft();
+        this->enable_batching(4);
+
+        this->send_database_request();
+        this->send_database_request();
+
+        EXPECT_TRUE(this->sent_preprepares.empty());
+        ASSERT_TRUE(this->batch_timer_callback);
+
+        this->batch_timer_callback(boost::system::error_code());
+
+        ASSERT_EQ(size_t(1), this->sent_preprepares.size());
+        EXPECT_EQ(2, this->sent_batch().batch().requests_size());
+
+        // a lone request is still wrapped...
+        this->send_database_request();
+        this->batch_timer_callback(boost::system::error_code());
+
+        ASSERT_EQ(size_t(2), this->sent_preprepares.size());
+        EXPECT_EQ(PBFT_REQ_BATCH, this->sent_batch(1).type());
+        ASSERT_EQ(1, this->sent_batch(1).batch().requests_size());
+
+        pbft_request request;
+        ASSERT_TRUE(request.ParseFromString(this->sent_batch(1).batch().requests(0)));
+        EXPECT_EQ("key_3", request.operation().create().key());
+
+        // a cancelled timeout leaves the batch alone...
+        this->send_database_request();
+        this->batch_timer_callback(boost::asio::error::operation_aborted);
+
+        EXPECT_EQ(size_t(2), this->sent_preprepares.size());
+    }
+
+
+    TEST_F(pbft_batch_test, test_that_a_committed_batch_is_applied_as_one_operation)
+    {
+        this->build_pbft();
+        this->enable_batching(2);
+
+        auto session1 = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        auto session2 = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+
+        this->send_database_request(session1);
+        this->send_database_request(session2);
+
+        ASSERT_EQ(size_t(1), this->sent_preprepares.size());
+
+        this->agree(this->sent_preprepares.front());
+
+        ASSERT_EQ(size_t(1), this->posted.size());
+
+        EXPECT_CALL(*this->mock_service, apply_operation(An<const std::shared_ptr<pbft_operation>&>())).WillOnce(Invoke(
+            [&](const auto& op)
+            {
+                EXPECT_EQ(PBFT_REQ_BATCH, op->get_request().type());
+                EXPECT_EQ(2, op->get_request().batch().requests_size());
+
+                // each requester hears back about its own request...
+                ASSERT_EQ(size_t(2), op->sessions().size());
+                EXPECT_EQ(session1, op->sessions()[0].lock());
+                EXPECT_EQ(session2, op->sessions()[1].lock());
+            }));
+
+        this->posted.front()();
+    }
+
+
+    TEST_F(pbft_batch_test, test_committed_requests_per_second_by_batch_size)
+    {
+        this->build_pbft();
+        this->enable_batching(1);
+
+        std::vector<double> requests_per_second;
+
+        for (const auto batch_size : BENCHMARK_BATCH_SIZES)
+        {
+            this->pbft->set_batching(batch_size, BATCH_TIMEOUT);
+
+            this->sent_preprepares.clear();
+            this->posted.clear();
+            const auto messages_before = this->messages_sent;
+
+            const auto start = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < BENCHMARK_REQUESTS; ++i)
+            {
+                const auto sent_before = this->sent_preprepares.size();
+
+                this->send_database_request();
+
+                for (size_t p = sent_before; p < this->sent_preprepares.size(); ++p)
+                {
+                    this->agree(this->sent_preprepares[p]);
+                    this->execute(this->sent_preprepares[p]);
+                }
+            }
+
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            // every sequence was committed and handed to the service...
+            EXPECT_EQ(BENCHMARK_REQUESTS / batch_size, this->sent_preprepares.size());
+            EXPECT_EQ(this->sent_preprepares.size(), this->posted.size());
+
+            requests_per_second.emplace_back(BENCHMARK_REQUESTS / elapsed.count());
+
+            std::cout << "[          ] batch size " << std::setw(3) << batch_size << ": " << std::setw(5)
+                      << this->sent_preprepares.size() << " sequences, " << std::fixed << std::setprecision(2)
+                      << double(this->messages_sent - messages_before) / BENCHMARK_REQUESTS
+                      << " messages sent per request, " << std::setprecision(0) << requests_per_second.back()
+                      << " committed requests/s" << std::endl;
+        }
+
+        // a round of agreement costs about the same whatever it orders...
+        EXPECT_GT(requests_per_second.back(), requests_per_second.front());
+    }
+}
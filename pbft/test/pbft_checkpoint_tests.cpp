@@ -206,4 +206,36 @@ namespace bzn::test
         EXPECT_GT(this->pbft->get_high_water_mark(), initial_high);
         EXPECT_GT(this->pbft->get_low_water_mark(), initial_low);
     }
+
+    TEST_F(pbft_checkpoint_test, test_checkpoint_interval_and_water_marks_are_configurable)
+    {
+        const uint64_t interval = 10;
+
+        EXPECT_CALL(*mock_service, service_state_hash(interval)).WillRepeatedly(Return(cp1_hash));
+
+        this->build_pbft();
+        this->pbft->set_checkpoint_interval(interval, 3.0);
+
+        EXPECT_EQ(interval * 3, this->pbft->get_high_water_mark());
+
+        this->service_execute_handler(std::make_shared<bzn::pbft_operation>(1, interval - 1, "somehash", nullptr));
+        EXPECT_EQ(0u, this->pbft->latest_checkpoint().first);
+
+        this->service_execute_handler(std::make_shared<bzn::pbft_operation>(1, interval, "somehash", nullptr));
+        EXPECT_EQ(interval, this->pbft->latest_checkpoint().first);
+
+        for (const auto& peer : TEST_PEER_LIST)
+        {
+            pbft_msg msg = cp1_msg;
+            msg.set_sequence(interval);
+            this->pbft->handle_message(msg, from(peer.uuid));
+        }
+
+        EXPECT_EQ(interval, this->pbft->get_low_water_mark());
+        EXPECT_EQ(interval * 4, this->pbft->get_high_water_mark());
+
+        // the high water mark must leave room to reach the next checkpoint...
+        EXPECT_THROW(this->pbft->set_checkpoint_interval(interval, 0.5), std::runtime_error);
+        EXPECT_THROW(this->pbft->set_checkpoint_interval(1, 2.0), std::runtime_error);
+    }
 }
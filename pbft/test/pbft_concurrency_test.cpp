@@ -0,0 +1,211 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <pbft/test/pbft_proto_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace ::testing;
+
+namespace
+{
+    const size_t TEST_SEQUENCES{128};
+
+    const size_t BENCHMARK_SEQUENCES{1024};
+    const std::vector<size_t> BENCHMARK_THREADS{1, 2, 4, 8};
+
+    // room for every sequence the benchmark issues without a checkpoint...
+    const uint64_t BENCHMARK_CHECKPOINT_INTERVAL{4096};
+}
+
+
+namespace bzn
+{
+    using namespace test;
+
+    class pbft_concurrency_test : public pbft_proto_test
+    {
+    public:
+        pbft_concurrency_test()
+        {
+            EXPECT_CALL(*this->mock_node, send_message_str(_, _)).WillRepeatedly(Invoke(
+                [&](auto, auto wrapped_msg)
+                {
+                    ++this->messages_sent;
+
+                    if (auto msg = extract_pbft_msg(*wrapped_msg); msg.type() == PBFT_MSG_PREPREPARE)
+                    {
+                        std::lock_guard<std::mutex> lock(this->test_lock);
+
+                        if (this->sent_preprepares.empty() || this->sent_preprepares.back().sequence() != msg.sequence())
+                        {
+                            this->sent_preprepares.emplace_back(std::move(msg));
+                        }
+                    }
+                }));
+
+            EXPECT_CALL(*this->mock_io_context, post(_)).WillRepeatedly(Invoke(
+                [&](auto task)
+                {
+                    std::lock_guard<std::mutex> lock(this->test_lock);
+                    this->posted.emplace_back(std::move(task));
+                }));
+        }
+
+        // the primary orders count requests, and gets its own preprepares back...
+        void issue(size_t count)
+        {
+            this->sent_preprepares.clear();
+            this->posted.clear();
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                pbft_request request;
+                request.set_type(PBFT_REQ_DATABASE);
+                request.set_timestamp(this->now());
+                request.mutable_operation()->mutable_create()->set_key("key_" + std::to_string(++this->index));
+                request.mutable_operation()->mutable_create()->set_value("value_" + std::to_string(this->index));
+
+                bzn::json_message json_msg;
+                json_msg["msg"] = request.SerializeAsString();
+
+                this->handle_request(request, json_msg);
+            }
+
+            ASSERT_EQ(count, this->sent_preprepares.size());
+        }
+
+        void receive(const pbft_msg& msg, const bzn::uuid_t& sender)
+        {
+            auto wmsg = wrap_pbft_msg(msg);
+            wmsg.set_sender(sender);
+
+            this->pbft->handle_message(msg, wmsg);
+        }
+
+        void send_all(const pbft_msg& preprepare, pbft_msg_type type, const bzn::uuid_t& sender)
+        {
+            pbft_msg msg;
+            msg.set_view(preprepare.view());
+            msg.set_sequence(preprepare.sequence());
+            msg.set_type(type);
+            msg.set_request_hash(preprepare.request_hash());
+
+            this->receive(msg, sender);
+        }
+
+        // runs work(t) on each of the threads at once...
+        static void run_threads(size_t threads, const std::function<void(size_t)>& work)
+        {
+            std::vector<std::thread> workers;
+
+            for (size_t t = 0; t < threads; ++t)
+            {
+                workers.emplace_back(work, t);
+            }
+
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        std::mutex test_lock;
+        std::vector<pbft_msg> sent_preprepares;
+        std::atomic<size_t> messages_sent{0};
+        std::vector<bzn::asio::task> posted;
+    };
+
+
+    TEST_F(pbft_concurrency_test, test_that_messages_for_one_sequence_can_arrive_on_many_threads)
+    {
+        this->build_pbft();
+        this->issue(TEST_SEQUENCES);
+
+        std::vector<bzn::uuid_t> senders;
+        for (const auto& peer : TEST_PEER_LIST)
+        {
+            senders.emplace_back(peer.uuid);
+        }
+
+        // every node's messages on a thread of their own, racing the others for the same operations...
+        run_threads(senders.size(), [&](size_t t)
+        {
+            const auto& sender = senders[t];
+
+            for (const auto& preprepare : this->sent_preprepares)
+            {
+                if (sender == this->uuid)
+                {
+                    this->receive(preprepare, sender);
+                }
+
+                this->send_all(preprepare, PBFT_MSG_PREPARE, sender);
+                this->send_all(preprepare, PBFT_MSG_COMMIT, sender);
+            }
+        });
+
+        // each sequence was handed to the service exactly once...
+        EXPECT_EQ(TEST_SEQUENCES, this->posted.size());
+        EXPECT_EQ(TEST_SEQUENCES, this->pbft->outstanding_operations_count());
+    }
+
+
+    TEST_F(pbft_concurrency_test, test_messages_handled_per_second_by_thread_count)
+    {
+        this->build_pbft();
+        this->pbft->set_checkpoint_interval(BENCHMARK_CHECKPOINT_INTERVAL, 2.0);
+
+        for (const auto threads : BENCHMARK_THREADS)
+        {
+            this->issue(BENCHMARK_SEQUENCES);
+
+            // the messages each sequence needs, handed out to the threads by sequence...
+            const size_t messages = BENCHMARK_SEQUENCES * (1 + 2 * TEST_PEER_LIST.size());
+
+            const auto start = std::chrono::steady_clock::now();
+
+            run_threads(threads, [&](size_t t)
+            {
+                for (size_t i = t; i < this->sent_preprepares.size(); i += threads)
+                {
+                    const auto& preprepare = this->sent_preprepares[i];
+
+                    this->receive(preprepare, this->uuid);
+
+                    for (const auto type : {PBFT_MSG_PREPARE, PBFT_MSG_COMMIT})
+                    {
+                        for (const auto& peer : TEST_PEER_LIST)
+                        {
+                            this->send_all(preprepare, type, peer.uuid);
+                        }
+                    }
+                }
+            });
+
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            EXPECT_EQ(BENCHMARK_SEQUENCES, this->posted.size());
+
+            // scaling depends on the cores available, so it is reported rather than asserted...
+            std::cout << "[          ] " << std::setw(2) << threads << " threads: " << std::fixed << std::setprecision(0)
+                      << messages / elapsed.count() << " messages/s, " << BENCHMARK_SEQUENCES / elapsed.count()
+                      << " committed sequences/s on " << std::thread::hardware_concurrency() << " cores" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,489 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <pbft/test/pbft_proto_test.hpp>
+#include <crud/crud_base.hpp>
+#include <iomanip>
+#include <iostream>
+
+using namespace ::testing;
+
+namespace
+{
+    const std::chrono::milliseconds BATCH_TIMEOUT{10};
+
+    const size_t BENCHMARK_REQUESTS{16};
+    const std::vector<size_t> BENCHMARK_VALUE_SIZES{1024, 65536, 262144};
+}
+
+
+namespace bzn
+{
+    using namespace test;
+
+    class pbft_digest_test : public pbft_proto_test
+    {
+    public:
+        struct sent_message
+        {
+            unsigned short port;
+            pbft_msg msg;
+            size_t bytes;
+        };
+
+        pbft_digest_test()
+        {
+            EXPECT_CALL(*this->mock_node, send_message_str(_, _)).WillRepeatedly(Invoke(
+                [&](const auto& ep, auto wrapped_msg)
+                {
+                    this->sent.push_back({ep.port(), extract_pbft_msg(*wrapped_msg), wrapped_msg->size()});
+                }));
+
+            EXPECT_CALL(*this->mock_io_context, post(_)).WillRepeatedly(Invoke(
+                [&](auto task)
+                {
+                    this->posted.emplace_back(std::move(task));
+                }));
+        }
+
+        void build(const bzn::uuid_t& uuid)
+        {
+            this->uuid = uuid;
+            this->build_pbft();
+            this->pbft->set_digest_preprepares(true);
+        }
+
+        pbft_request client_request(size_t value_size = 8)
+        {
+            pbft_request request;
+            request.set_type(PBFT_REQ_DATABASE);
+            request.set_timestamp(this->now());
+            request.mutable_operation()->mutable_create()->set_key("key_" + std::to_string(++this->index));
+            request.mutable_operation()->mutable_create()->set_value(std::string(value_size, 'v'));
+
+            return request;
+        }
+
+        void send_client_request(const pbft_request& request, const std::shared_ptr<session_base>& session = nullptr)
+        {
+            bzn::json_message json_msg;
+            json_msg["msg"] = request.SerializeAsString();
+
+            this->handle_request(request, json_msg, session);
+        }
+
+        void receive(const pbft_msg& msg, const bzn::uuid_t& sender)
+        {
+            auto wmsg = wrap_pbft_msg(msg);
+            wmsg.set_sender(sender);
+
+            this->pbft->handle_message(msg, wmsg);
+        }
+
+        pbft_msg disseminated(const pbft_request& request)
+        {
+            pbft_msg msg;
+            msg.set_type(PBFT_MSG_REQUEST);
+            msg.set_request(request.SerializeAsString());
+            msg.set_request_hash(this->crypto->hash(msg.request()));
+
+            return msg;
+        }
+
+        pbft_msg agreement_msg(pbft_msg_type type, uint64_t sequence, const bzn::hash_t& request_hash)
+        {
+            pbft_msg msg;
+            msg.set_type(type);
+            msg.set_view(this->view);
+            msg.set_sequence(sequence);
+            msg.set_request_hash(request_hash);
+
+            return msg;
+        }
+
+        void send_from_all(const pbft_msg& msg)
+        {
+            for (const auto& peer : TEST_PEER_LIST)
+            {
+                this->receive(msg, peer.uuid);
+            }
+        }
+
+        std::vector<sent_message> sent_of_type(pbft_msg_type type) const
+        {
+            std::vector<sent_message> result;
+            std::copy_if(this->sent.begin(), this->sent.end(), std::back_inserter(result),
+                [type](const auto& sent) { return sent.msg.type() == type; });
+
+            return result;
+        }
+
+        std::vector<sent_message> sent;
+        std::vector<bzn::asio::task> posted;
+    };
+
+
+    TEST_F(pbft_digest_test, test_that_a_client_request_goes_to_every_replica_and_the_primary_orders_its_digest)
+    {
+        this->build(TEST_NODE_UUID);
+
+        const auto request = this->client_request();
+        this->send_client_request(request);
+
+        const auto requests = this->sent_of_type(PBFT_MSG_REQUEST);
+        ASSERT_EQ(TEST_PEER_LIST.size(), requests.size());
+        EXPECT_EQ(this->disseminated(request).request(), requests.front().msg.request());
+        EXPECT_EQ(this->disseminated(request).request_hash(), requests.front().msg.request_hash());
+        EXPECT_TRUE(this->sent_of_type(PBFT_MSG_PREPREPARE).empty());
+
+        // the primary orders it once it arrives like any other replica's...
+        this->receive(requests.front().msg, this->uuid);
+
+        const auto preprepares = this->sent_of_type(PBFT_MSG_PREPREPARE);
+        ASSERT_EQ(TEST_PEER_LIST.size(), preprepares.size());
+        EXPECT_TRUE(preprepares.front().msg.request().empty());
+        EXPECT_EQ(requests.front().msg.request_hash(), preprepares.front().msg.request_hash());
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_a_replica_commits_only_once_it_has_the_request)
+    {
+        this->build(SECOND_NODE_UUID);
+
+        auto session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        const auto request = this->client_request();
+        const auto request_msg = this->disseminated(request);
+
+        // the client's request reaches this replica after the primary has ordered it...
+        this->receive(this->agreement_msg(PBFT_MSG_PREPREPARE, 1, request_msg.request_hash()), TEST_NODE_UUID);
+        this->send_from_all(this->agreement_msg(PBFT_MSG_PREPARE, 1, request_msg.request_hash()));
+
+        EXPECT_FALSE(this->sent_of_type(PBFT_MSG_PREPARE).empty());
+        EXPECT_TRUE(this->sent_of_type(PBFT_MSG_COMMIT).empty());
+
+        this->send_client_request(request, session);
+        this->receive(request_msg, this->uuid);
+
+        EXPECT_FALSE(this->sent_of_type(PBFT_MSG_COMMIT).empty());
+
+        this->send_from_all(this->agreement_msg(PBFT_MSG_COMMIT, 1, request_msg.request_hash()));
+        ASSERT_EQ(size_t(1), this->posted.size());
+
+        EXPECT_CALL(*this->mock_service, apply_operation(An<const std::shared_ptr<pbft_operation>&>())).WillOnce(Invoke(
+            [&](const auto& op)
+            {
+                EXPECT_EQ(request.SerializeAsString(), op->get_encoded_request());
+
+                // the node the client sent the request to answers it...
+                EXPECT_EQ(session, op->session().lock());
+            }));
+
+        this->posted.front()();
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_a_missing_request_is_fetched_from_a_replica_that_committed)
+    {
+        this->build(SECOND_NODE_UUID);
+
+        const auto request_msg = this->disseminated(this->client_request());
+
+        this->receive(this->agreement_msg(PBFT_MSG_PREPREPARE, 1, request_msg.request_hash()), TEST_NODE_UUID);
+        this->send_from_all(this->agreement_msg(PBFT_MSG_PREPARE, 1, request_msg.request_hash()));
+
+        // prepares alone leave time for the request to arrive...
+        EXPECT_TRUE(this->sent_of_type(PBFT_MSG_GET_REQUEST).empty());
+
+        this->send_from_all(this->agreement_msg(PBFT_MSG_COMMIT, 1, request_msg.request_hash()));
+
+        // ...the first other replica to commit is asked for it, once
+        const auto asked = *std::find_if(TEST_PEER_LIST.begin(), TEST_PEER_LIST.end(),
+            [&](const auto& peer) { return peer.uuid != this->uuid; });
+
+        const auto gets = this->sent_of_type(PBFT_MSG_GET_REQUEST);
+        ASSERT_EQ(size_t(1), gets.size());
+        EXPECT_EQ(request_msg.request_hash(), gets.front().msg.request_hash());
+        EXPECT_EQ(asked.port, gets.front().port);
+        EXPECT_TRUE(this->posted.empty());
+
+        this->receive(request_msg, asked.uuid);
+
+        EXPECT_EQ(size_t(1), this->posted.size());
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_a_replica_sends_a_request_it_is_asked_for)
+    {
+        this->build(SECOND_NODE_UUID);
+
+        const auto request_msg = this->disseminated(this->client_request());
+
+        pbft_msg get_msg;
+        get_msg.set_type(PBFT_MSG_GET_REQUEST);
+        get_msg.set_request_hash(request_msg.request_hash());
+
+        // nothing to send yet...
+        this->receive(get_msg, "uuid2");
+        EXPECT_TRUE(this->sent_of_type(PBFT_MSG_REQUEST).empty());
+
+        this->receive(request_msg, "uuid3");
+        this->receive(get_msg, "uuid2");
+
+        const auto replies = this->sent_of_type(PBFT_MSG_REQUEST);
+        ASSERT_EQ(size_t(1), replies.size());
+        EXPECT_EQ(8082, replies.front().port);
+        EXPECT_EQ(request_msg.request(), replies.front().msg.request());
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_request_messages_are_dropped_unless_they_carry_their_request)
+    {
+        this->build_pbft();
+
+        const auto request_msg = this->disseminated(this->client_request());
+
+        pbft_msg get_msg;
+        get_msg.set_type(PBFT_MSG_GET_REQUEST);
+        get_msg.set_request_hash(request_msg.request_hash());
+
+        // requests do not travel on their own unless preprepares carry digests...
+        this->receive(request_msg, "uuid3");
+        this->pbft->set_digest_preprepares(true);
+        this->receive(get_msg, "uuid2");
+        EXPECT_TRUE(this->sent_of_type(PBFT_MSG_REQUEST).empty());
+
+        // ...and a request message must carry the request its digest names
+        auto empty_msg = request_msg;
+        empty_msg.clear_request();
+        this->receive(empty_msg, "uuid3");
+
+        auto other_msg = this->disseminated(this->client_request());
+        other_msg.set_request_hash(request_msg.request_hash());
+        this->receive(other_msg, "uuid3");
+
+        this->receive(get_msg, "uuid2");
+        EXPECT_TRUE(this->sent_of_type(PBFT_MSG_REQUEST).empty());
+
+        this->receive(request_msg, "uuid3");
+        this->receive(get_msg, "uuid2");
+        ASSERT_EQ(size_t(1), this->sent_of_type(PBFT_MSG_REQUEST).size());
+        EXPECT_EQ(request_msg.request(), this->sent_of_type(PBFT_MSG_REQUEST).front().msg.request());
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_the_primary_refuses_a_request_to_the_replica_that_sent_it)
+    {
+        this->build(TEST_NODE_UUID);
+        this->pbft->set_max_in_flight(1);
+
+        this->receive(this->disseminated(this->client_request()), this->uuid);
+        ASSERT_EQ(TEST_PEER_LIST.size(), this->sent_of_type(PBFT_MSG_PREPREPARE).size());
+
+        const auto refused_msg = this->disseminated(this->client_request());
+        this->receive(refused_msg, "uuid2");
+
+        const auto refusals = this->sent_of_type(PBFT_MSG_REFUSE_REQUEST);
+        ASSERT_EQ(size_t(1), refusals.size());
+        EXPECT_EQ(8082, refusals.front().port);
+        EXPECT_EQ(refused_msg.request_hash(), refusals.front().msg.request_hash());
+        EXPECT_EQ(TEST_PEER_LIST.size(), this->sent_of_type(PBFT_MSG_PREPREPARE).size());
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_a_refused_request_is_reported_to_its_client)
+    {
+        this->build(SECOND_NODE_UUID);
+
+        auto session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        database_response response;
+
+        EXPECT_CALL(*session, send_message(A<std::shared_ptr<std::string>>(), _)).WillRepeatedly(Invoke(
+            [&](auto msg, auto)
+            {
+                response.Clear();
+                ASSERT_TRUE(response.ParseFromString(*msg));
+            }));
+
+        auto request = this->client_request();
+        request.mutable_operation()->mutable_header()->set_transaction_id(42);
+        this->send_client_request(request, session);
+
+        pbft_msg refusal;
+        refusal.set_type(PBFT_MSG_REFUSE_REQUEST);
+        refusal.set_request_hash(this->disseminated(request).request_hash());
+
+        // only the primary can refuse it...
+        this->receive(refusal, "uuid2");
+        EXPECT_FALSE(response.has_error());
+
+        this->receive(refusal, TEST_NODE_UUID);
+        EXPECT_EQ(bzn::MSG_TOO_MANY_REQUESTS, response.error().message());
+        EXPECT_EQ(uint64_t(42), response.header().transaction_id());
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_a_batch_lists_digests_and_is_executed_with_its_requests)
+    {
+        std::unique_ptr<bzn::asio::Mocksteady_timer_base> batch_timer =
+            std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        this->build(TEST_NODE_UUID);
+
+        EXPECT_CALL(*this->mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(batch_timer);
+            }));
+        this->pbft->set_batching(2, BATCH_TIMEOUT);
+
+        auto session1 = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        auto session2 = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        const auto request1 = this->client_request();
+        const auto request2 = this->client_request();
+
+        this->send_client_request(request1, session1);
+        this->send_client_request(request2, session2);
+        this->receive(this->disseminated(request1), this->uuid);
+        this->receive(this->disseminated(request2), this->uuid);
+
+        const auto preprepares = this->sent_of_type(PBFT_MSG_PREPREPARE);
+        ASSERT_EQ(TEST_PEER_LIST.size(), preprepares.size());
+
+        pbft_request batch;
+        ASSERT_TRUE(batch.ParseFromString(preprepares.front().msg.request()));
+        EXPECT_EQ(PBFT_REQ_BATCH, batch.type());
+        EXPECT_EQ(0, batch.batch().requests_size());
+        ASSERT_EQ(2, batch.batch().request_hashes_size());
+        EXPECT_EQ(this->disseminated(request1).request_hash(), batch.batch().request_hashes(0));
+
+        const auto& preprepare = preprepares.front().msg;
+        this->receive(preprepare, this->uuid);
+        this->send_from_all(this->agreement_msg(PBFT_MSG_PREPARE, preprepare.sequence(), preprepare.request_hash()));
+        this->send_from_all(this->agreement_msg(PBFT_MSG_COMMIT, preprepare.sequence(), preprepare.request_hash()));
+
+        ASSERT_EQ(size_t(1), this->posted.size());
+
+        EXPECT_CALL(*this->mock_service, apply_operation(An<const std::shared_ptr<pbft_operation>&>())).WillOnce(Invoke(
+            [&](const auto& op)
+            {
+                ASSERT_EQ(2, op->get_request().batch().requests_size());
+                EXPECT_EQ(request1.SerializeAsString(), op->get_request().batch().requests(0));
+                EXPECT_EQ(request2.SerializeAsString(), op->get_request().batch().requests(1));
+
+                ASSERT_EQ(size_t(2), op->sessions().size());
+                EXPECT_EQ(session1, op->sessions()[0].lock());
+                EXPECT_EQ(session2, op->sessions()[1].lock());
+            }));
+
+        this->posted.front()();
+    }
+
+
+    TEST_F(pbft_digest_test, test_that_a_committed_batch_waits_for_a_request_it_no_longer_has)
+    {
+        std::unique_ptr<bzn::asio::Mocksteady_timer_base> batch_timer =
+            std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        this->build(TEST_NODE_UUID);
+
+        EXPECT_CALL(*this->mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(batch_timer);
+            }));
+        this->pbft->set_batching(2, BATCH_TIMEOUT);
+
+        const auto request1 = this->client_request();
+        const auto request2 = this->client_request();
+        this->receive(this->disseminated(request1), "uuid2");
+        this->receive(this->disseminated(request2), "uuid2");
+
+        const auto preprepare = this->sent_of_type(PBFT_MSG_PREPREPARE).front().msg;
+        this->receive(preprepare, this->uuid);
+        this->send_from_all(this->agreement_msg(PBFT_MSG_PREPARE, preprepare.sequence(), preprepare.request_hash()));
+
+        // the request is gone by the time the batch commits...
+        this->forget_disseminated_request(this->disseminated(request2).request_hash());
+        this->send_from_all(this->agreement_msg(PBFT_MSG_COMMIT, preprepare.sequence(), preprepare.request_hash()));
+
+        EXPECT_TRUE(this->posted.empty());
+
+        const auto gets = this->sent_of_type(PBFT_MSG_GET_REQUEST);
+        ASSERT_EQ(TEST_PEER_LIST.size(), gets.size());
+        EXPECT_EQ(this->disseminated(request2).request_hash(), gets.front().msg.request_hash());
+
+        // ...and the batch is executed once a replica sends it back
+        this->receive(this->disseminated(request2), "uuid3");
+        ASSERT_EQ(size_t(1), this->posted.size());
+
+        EXPECT_CALL(*this->mock_service, apply_operation(An<const std::shared_ptr<pbft_operation>&>())).WillOnce(Invoke(
+            [&](const auto& op)
+            {
+                ASSERT_EQ(2, op->get_request().batch().requests_size());
+                EXPECT_EQ(request1.SerializeAsString(), op->get_request().batch().requests(0));
+                EXPECT_EQ(request2.SerializeAsString(), op->get_request().batch().requests(1));
+            }));
+
+        this->posted.front()();
+    }
+
+
+    TEST_F(pbft_digest_test, test_primary_upload_per_request_by_value_size)
+    {
+        this->build(TEST_NODE_UUID);
+
+        for (const auto value_size : BENCHMARK_VALUE_SIZES)
+        {
+            std::vector<double> bytes_per_request;
+
+            // requests whole in the primary's preprepares, then sent to every replica by the node the client used...
+            for (const bool digest : {false, true})
+            {
+                this->pbft->set_digest_preprepares(digest);
+                this->sent.clear();
+
+                for (size_t i = 0; i < BENCHMARK_REQUESTS; ++i)
+                {
+                    const auto request = this->client_request(value_size);
+
+                    if (digest)
+                    {
+                        this->receive(this->disseminated(request), "uuid2");
+                    }
+                    else
+                    {
+                        this->send_client_request(request);
+                    }
+                }
+
+                EXPECT_EQ(BENCHMARK_REQUESTS * TEST_PEER_LIST.size(), this->sent_of_type(PBFT_MSG_PREPREPARE).size());
+
+                size_t bytes = 0;
+                for (const auto& sent : this->sent)
+                {
+                    bytes += sent.bytes;
+                }
+
+                bytes_per_request.emplace_back(double(bytes) / BENCHMARK_REQUESTS);
+            }
+
+            std::cout << "[          ] value size " << std::setw(6) << value_size << ": primary sends " << std::fixed
+                      << std::setprecision(0) << std::setw(7) << bytes_per_request[0] << " bytes per request, "
+                      << std::setw(4) << bytes_per_request[1] << " with digests" << std::endl;
+
+            // what the primary sends no longer grows with the request...
+            EXPECT_LT(bytes_per_request[1], 1024);
+        }
+    }
+}
@@ -13,6 +13,8 @@
 
 #include <pbft/test/pbft_test_common.hpp>
 #include <pbft/test/pbft_proto_test.hpp>
+#include <crud/crud_base.hpp>
+#include <utils/make_endpoint.hpp>
 
 using namespace ::testing;
 
@@ -283,5 +285,173 @@ namespace bzn
         run_transaction_through_backup();
         force_checkpoint(10);
     }
+
+    TEST_F(pbft_proto_test, test_primary_refuses_requests_while_its_window_is_full)
+    {
+        this->build_pbft();
+        this->pbft->set_max_in_flight(2);
+
+        auto op1 = send_request();
+        auto op2 = send_request();
+        ASSERT_NE(op1, nullptr);
+        ASSERT_NE(op2, nullptr);
+
+        auto session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        std::string last_error;
+
+        EXPECT_CALL(*session, send_message(A<std::shared_ptr<std::string>>(), _)).WillRepeatedly(Invoke(
+            [&](auto msg, auto)
+            {
+                database_response response;
+                response.ParseFromString(*msg);
+                last_error = response.error().message();
+            }));
+
+        this->database_handler(this->request_json, session);
+        EXPECT_EQ(bzn::MSG_TOO_MANY_REQUESTS, last_error);
+
+        // committing a sequence makes room for another...
+        send_prepares(op1->sequence, op1->request_hash);
+        send_commits(op1->sequence, op1->request_hash);
+
+        EXPECT_CALL(*this->mock_node, send_message_str(_, ResultOf(test::is_preprepare, Eq(true))))
+            .Times(Exactly(TEST_PEER_LIST.size()));
+
+        this->database_handler(this->request_json, session);
+        EXPECT_EQ("", last_error);
+    }
+
+    TEST_F(pbft_proto_test, test_primary_refuses_requests_past_the_high_water_mark)
+    {
+        this->build_pbft();
+        this->pbft->set_checkpoint_interval(2, 1.0);
+
+        run_transaction_through_primary();
+        prepare_for_checkpoint(2);
+        run_transaction_through_primary();
+
+        auto session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        std::string last_error;
+
+        EXPECT_CALL(*session, send_message(A<std::shared_ptr<std::string>>(), _)).WillRepeatedly(Invoke(
+            [&](auto msg, auto)
+            {
+                database_response response;
+                response.ParseFromString(*msg);
+                last_error = response.error().message();
+            }));
+
+        // sequence 3 waits for the checkpoint at 2 to become stable...
+        this->database_handler(this->request_json, session);
+        EXPECT_EQ(bzn::MSG_TOO_MANY_REQUESTS, last_error);
+    }
+
+    TEST_F(pbft_proto_test, test_primary_refuses_a_forwarded_request_to_the_node_that_forwarded_it)
+    {
+        this->build_pbft();
+        this->pbft->set_max_in_flight(1);
+
+        ASSERT_NE(send_request(), nullptr);
+
+        std::vector<std::pair<unsigned short, pbft_msg>> refusals;
+
+        EXPECT_CALL(*this->mock_node, send_message_str(_, ResultOf(test::is_preprepare, Eq(false)))).WillRepeatedly(Invoke(
+            [&](const auto& ep, auto msg)
+            {
+                refusals.emplace_back(ep.port(), extract_pbft_msg(*msg));
+            }));
+
+        pbft_request request;
+        request.set_type(PBFT_REQ_DATABASE);
+        request.set_timestamp(this->now());
+        request.mutable_operation()->mutable_header()->set_transaction_id(42);
+
+        pbft_msg forward;
+        forward.set_type(PBFT_MSG_FORWARD_REQUEST);
+        forward.set_request(request.SerializeAsString());
+        forward.set_request_hash(this->crypto->hash(forward.request()));
+
+        // only a peer forwards requests...
+        auto from_client = wrap_pbft_msg(forward);
+        from_client.set_sender("not_a_peer");
+        this->message_handler(from_client, nullptr);
+        EXPECT_TRUE(refusals.empty());
+
+        auto from_peer = wrap_pbft_msg(forward);
+        from_peer.set_sender("uuid2");
+        this->message_handler(from_peer, nullptr);
+
+        ASSERT_EQ(size_t(1), refusals.size());
+        EXPECT_EQ(8082, refusals.front().first);
+        EXPECT_EQ(PBFT_MSG_REFUSE_REQUEST, refusals.front().second.type());
+        EXPECT_EQ(forward.request_hash(), refusals.front().second.request_hash());
+    }
+
+    TEST_F(pbft_proto_test, test_primary_answers_a_client_that_claims_its_request_was_forwarded)
+    {
+        this->build_pbft();
+        this->pbft->set_max_in_flight(1);
+
+        ASSERT_NE(send_request(), nullptr);
+
+        auto session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        database_response response;
+
+        EXPECT_CALL(*session, send_message(A<std::shared_ptr<std::string>>(), _)).WillOnce(Invoke(
+            [&](auto msg, auto)
+            {
+                ASSERT_TRUE(response.ParseFromString(*msg));
+            }));
+
+        // whether a request was forwarded is not the client's to say...
+        auto forwarded = this->request_json;
+        forwarded["forwarded"] = true;
+
+        this->database_handler(forwarded, session);
+        EXPECT_EQ(bzn::MSG_TOO_MANY_REQUESTS, response.error().message());
+    }
+
+    TEST_F(pbft_proto_test, test_backup_tells_the_client_when_the_primary_refuses_its_request)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        auto session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        std::string last_error;
+
+        EXPECT_CALL(*session, send_message(A<std::shared_ptr<std::string>>(), _)).WillRepeatedly(Invoke(
+            [&](auto msg, auto)
+            {
+                database_response response;
+                response.ParseFromString(*msg);
+                last_error = response.error().message();
+            }));
+
+        pbft_msg forward;
+        EXPECT_CALL(*this->mock_node, send_message_str(make_endpoint(this->pbft->get_primary()), _)).WillOnce(Invoke(
+            [&](auto, auto msg)
+            {
+                forward = extract_pbft_msg(*msg);
+            }));
+
+        this->database_handler(this->request_json, session);
+        EXPECT_EQ("", last_error);
+        EXPECT_EQ(PBFT_MSG_FORWARD_REQUEST, forward.type());
+
+        pbft_msg refusal;
+        refusal.set_type(PBFT_MSG_REFUSE_REQUEST);
+        refusal.set_request_hash(forward.request_hash());
+
+        // only the primary can refuse it...
+        auto not_primary = wrap_pbft_msg(refusal);
+        not_primary.set_sender("uuid2");
+        this->message_handler(not_primary, nullptr);
+        EXPECT_EQ("", last_error);
+
+        auto from_primary = wrap_pbft_msg(refusal);
+        from_primary.set_sender(this->pbft->get_primary().uuid);
+        this->message_handler(from_primary, nullptr);
+        EXPECT_EQ(bzn::MSG_TOO_MANY_REQUESTS, last_error);
+    }
 }
 
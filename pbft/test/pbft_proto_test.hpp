@@ -65,6 +65,10 @@ namespace bzn
         uint64_t now()
         { return this->pbft->now(); }
 
+        // drop a request the SUT has been sent, as if it had aged out
+        void forget_disseminated_request(const bzn::hash_t& request_hash)
+        { this->pbft->disseminated_requests.erase(request_hash); }
+
         // send request to pbft
         void handle_request(const pbft_request& msg, const bzn::json_message& original_msg, const std::shared_ptr<session_base>& session = nullptr)
         { this->pbft->handle_request(msg, original_msg, session); }
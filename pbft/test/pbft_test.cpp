@@ -44,11 +44,17 @@ namespace bzn::test
         boost::asio::ip::tcp::endpoint msg_sent_to;
         bzn::json_message msg_sent;
 
-        EXPECT_CALL(*mock_node, send_message(_, _)).Times(1).WillRepeatedly(Invoke(
+        EXPECT_CALL(*mock_node, send_message_str(_, _)).Times(1).WillRepeatedly(Invoke(
                 [&](auto ep, auto msg)
                 {
                     EXPECT_EQ(ep, make_endpoint(this->pbft->get_primary()));
-                    EXPECT_EQ((*msg)["bzn-api"], "database");
+
+                    const auto forward = extract_pbft_msg(*msg);
+                    EXPECT_EQ(forward.type(), PBFT_MSG_FORWARD_REQUEST);
+
+                    pbft_request request;
+                    EXPECT_TRUE(request.ParseFromString(forward.request()));
+                    EXPECT_EQ(request.type(), PBFT_REQ_DATABASE);
                 }));
 
         this->uuid = SECOND_NODE_UUID;
@@ -93,6 +99,29 @@ namespace bzn::test
         this->pbft->handle_message(this->preprepare_msg, default_original_msg);
     }
 
+    TEST_F(pbft_test, test_prepares_carry_no_authenticators_when_messages_are_not_signed)
+    {
+        this->build_pbft();
+
+        std::vector<bzn_envelope> sent;
+        EXPECT_CALL(*mock_node, send_message_str(_, ResultOf(is_prepare, Eq(true)))).WillRepeatedly(Invoke(
+            [&](auto, auto wrapped_msg)
+            {
+                sent.emplace_back();
+                sent.back().ParseFromString(*wrapped_msg);
+            }));
+
+        // authenticators are only used alongside signatures, this node has no key to make either with...
+        this->pbft->set_message_authentication(false, true);
+        this->pbft->handle_message(this->preprepare_msg, default_original_msg);
+
+        ASSERT_EQ(TEST_PEER_LIST.size(), sent.size());
+        for (const auto& envelope : sent)
+        {
+            EXPECT_EQ(0, envelope.authenticator_size());
+        }
+    }
+
     TEST_F(pbft_test, test_prepare_contains_uuid)
     {
         this->build_pbft();
@@ -0,0 +1,319 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Measures the throughput and latency of each storage operation across engines, value sizes, database counts and
+// thread counts. Results are written as json, one entry per engine, configuration and operation, so runs can be kept
+// and compared...
+
+#include <include/bluzelle.hpp>
+#include <storage/mem_storage.hpp>
+#include <storage/rocksdb_storage.hpp>
+#include <storage/sharded_mem_storage.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/log/core.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <thread>
+
+
+namespace
+{
+    const std::string BENCHMARK_UUID{"storage-benchmark"};
+
+    using storage_factory = std::function<std::shared_ptr<bzn::storage_base>(const std::string& dir)>;
+
+    const std::map<std::string, storage_factory> ENGINES{
+        {"mem", [](const auto&) { return std::make_shared<bzn::mem_storage>(); }},
+        {"sharded_mem", [](const auto&) { return std::make_shared<bzn::sharded_mem_storage>(); }},
+        {"rocksdb", [](const auto& dir) { return std::make_shared<bzn::rocksdb_storage>(dir, BENCHMARK_UUID); }},
+        {"rocksdb_cf", [](const auto& dir) { return std::make_shared<bzn::rocksdb_storage>(dir, BENCHMARK_UUID, true); }}};
+
+    struct configuration
+    {
+        std::string engine;
+        size_t key_size;
+        size_t value_size;
+        size_t databases;
+        size_t threads;
+    };
+
+    struct run_options
+    {
+        size_t records;
+        size_t scans;
+        std::string dir;
+    };
+
+    bzn::uuid_t
+    database_name(size_t index)
+    {
+        return "db-" + std::to_string(index);
+    }
+
+    // record i lives in database i % databases, its key padded out to the key size...
+    bzn::key_t
+    record_key(size_t record, size_t key_size)
+    {
+        auto key = std::to_string(record);
+
+        return std::string(key.size() < key_size ? key_size - key.size() : 0, '0') + key;
+    }
+
+
+    // runs the operation count times spread over the threads, each thread taking every threads'th index, and
+    // summarises the latency of each call...
+    bzn::json_message
+    measure(size_t threads, size_t count, const std::function<void(size_t)>& operation)
+    {
+        std::vector<std::vector<uint64_t>> latencies(threads);
+        std::vector<std::thread> workers;
+
+        std::promise<void> start;
+        auto started = start.get_future().share();
+
+        for (size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                auto& thread_latencies = latencies[t];
+                thread_latencies.reserve(count / threads + 1);
+
+                started.wait();
+
+                for (size_t i = t; i < count; i += threads)
+                {
+                    const auto begin = std::chrono::steady_clock::now();
+
+                    operation(i);
+
+                    thread_latencies.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - begin).count());
+                }
+            });
+        }
+
+        const auto begin = std::chrono::steady_clock::now();
+
+        start.set_value();
+
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        std::vector<uint64_t> all;
+        all.reserve(count);
+
+        for (const auto& thread_latencies : latencies)
+        {
+            all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+        }
+
+        std::sort(all.begin(), all.end());
+
+        const auto percentile = [&all](double p)
+        {
+            return all.empty() ? uint64_t(0) : all[std::min(all.size() - 1, size_t(p * all.size()))];
+        };
+
+        bzn::json_message result;
+        result["operations"] = Json::UInt64(count);
+        result["seconds"] = elapsed.count();
+        result["ops_per_sec"] = elapsed.count() > 0 ? count / elapsed.count() : 0.0;
+        result["p50_ns"] = Json::UInt64(percentile(0.50));
+        result["p99_ns"] = Json::UInt64(percentile(0.99));
+        result["max_ns"] = Json::UInt64(all.empty() ? 0 : all.back());
+
+        return result;
+    }
+
+
+    // every operation against a fresh storage engine, in an order that leaves each one something to work on...
+    std::vector<bzn::json_message>
+    run(const configuration& config, const run_options& options)
+    {
+        const auto dir = boost::filesystem::path(options.dir).append(config.engine).string();
+
+        boost::filesystem::remove_all(dir);
+        boost::filesystem::create_directories(dir);
+
+        std::vector<bzn::json_message> results;
+
+        {
+            const auto storage = ENGINES.at(config.engine)(dir);
+            const bzn::value_t value(config.value_size, 'v');
+            const bzn::value_t updated_value(config.value_size, 'u');
+
+            const auto db = [&config](size_t i) { return database_name(i % config.databases); };
+            const auto key = [&config](size_t i) { return record_key(i, config.key_size); };
+
+            const auto check = [](bool ok, const char* operation)
+            {
+                if (!ok)
+                {
+                    throw std::runtime_error(std::string("storage benchmark: ") + operation + " failed");
+                }
+            };
+
+            const std::vector<std::pair<std::string, std::function<void(size_t)>>> operations{
+                {"create", [&](size_t i) { check(storage->create(db(i), key(i), value) == bzn::storage_base::result::ok, "create"); }},
+                {"read", [&](size_t i) { check(bool(storage->read(db(i), key(i))), "read"); }},
+                {"update", [&](size_t i) { check(storage->update(db(i), key(i), updated_value) == bzn::storage_base::result::ok, "update"); }},
+                {"get_keys", [&](size_t i) { storage->get_keys(database_name(i % config.databases)); }},
+                {"get_size", [&](size_t i) { storage->get_size(database_name(i % config.databases)); }},
+                {"remove", [&](size_t i) { check(storage->remove(db(i), key(i)) == bzn::storage_base::result::ok, "remove"); }}};
+
+            for (const auto& [name, operation] : operations)
+            {
+                const bool scan = (name == "get_keys" || name == "get_size");
+
+                auto result = measure(config.threads, scan ? options.scans : options.records, operation);
+
+                result["engine"] = config.engine;
+                result["operation"] = name;
+                result["key_size"] = Json::UInt64(config.key_size);
+                result["value_size"] = Json::UInt64(config.value_size);
+                result["databases"] = Json::UInt64(config.databases);
+                result["threads"] = Json::UInt64(config.threads);
+
+                std::cerr << std::left << std::setw(12) << config.engine << std::setw(10) << name
+                    << " value " << std::setw(8) << config.value_size << " dbs " << std::setw(5) << config.databases
+                    << " threads " << std::setw(4) << config.threads << std::right << std::fixed << std::setprecision(0)
+                    << std::setw(12) << result["ops_per_sec"].asDouble() << " ops/s  p50 " << std::setw(9)
+                    << result["p50_ns"].asUInt64() << " ns  p99 " << std::setw(9) << result["p99_ns"].asUInt64() << " ns\n";
+
+                results.emplace_back(std::move(result));
+            }
+        }
+
+        boost::filesystem::remove_all(dir);
+
+        return results;
+    }
+}
+
+
+int
+main(int argc, const char* argv[])
+{
+    namespace po = boost::program_options;
+
+    std::vector<std::string> engines;
+    std::vector<size_t> value_sizes;
+    std::vector<size_t> database_counts;
+    std::vector<size_t> thread_counts;
+    size_t key_size{};
+    run_options options;
+    std::string output;
+
+    po::options_description desc("Storage benchmark options");
+    desc.add_options()
+        ("help,h", "shows this information")
+        ("engines", po::value(&engines)->multitoken()->default_value({"mem", "sharded_mem", "rocksdb", "rocksdb_cf"}, "mem sharded_mem rocksdb rocksdb_cf"),
+            "storage engines to measure")
+        ("value_sizes", po::value(&value_sizes)->multitoken()->default_value({16, 1024, 16384}, "16 1024 16384"), "value sizes in bytes")
+        ("databases", po::value(&database_counts)->multitoken()->default_value({1, 64}, "1 64"), "database counts to spread the records over")
+        ("threads", po::value(&thread_counts)->multitoken()->default_value({1, 4}, "1 4"), "thread counts")
+        ("key_size", po::value(&key_size)->default_value(16), "key size in bytes")
+        ("records", po::value(&options.records)->default_value(10000), "records created, read, updated and removed per run")
+        ("scans", po::value(&options.scans)->default_value(100), "get_keys and get_size calls per run")
+        ("dir", po::value(&options.dir)->default_value("./storage_benchmark"), "where the rocksdb engines keep their files")
+        ("output,o", po::value(&output), "json results file, written to stdout if not given");
+
+    try
+    {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+
+        if (vm.count("help"))
+        {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+
+        po::notify(vm);
+
+        for (const auto& engine : engines)
+        {
+            if (!ENGINES.count(engine))
+            {
+                throw std::runtime_error("unknown storage engine: " + engine);
+            }
+        }
+
+        if (std::count(database_counts.begin(), database_counts.end(), 0) || std::count(thread_counts.begin(), thread_counts.end(), 0))
+        {
+            throw std::runtime_error("database and thread counts must be positive");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n" << desc << std::endl;
+        return 1;
+    }
+
+    // storage errors are reported by the benchmark itself...
+    boost::log::core::get()->set_logging_enabled(false);
+
+    bzn::json_message results(Json::arrayValue);
+
+    try
+    {
+        for (const auto& engine : engines)
+        {
+            for (const auto value_size : value_sizes)
+            {
+                for (const auto databases : database_counts)
+                {
+                    for (const auto threads : thread_counts)
+                    {
+                        for (auto& result : run({engine, key_size, value_size, databases, threads}, options))
+                        {
+                            results.append(std::move(result));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    bzn::json_message report;
+    report["hardware_concurrency"] = std::thread::hardware_concurrency();
+    report["results"] = results;
+
+    if (output.empty())
+    {
+        std::cout << report.toStyledString();
+    }
+    else
+    {
+        std::ofstream(output) << report.toStyledString();
+    }
+
+    return 0;
+}
@@ -0,0 +1,422 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/cached_storage.hpp>
+
+using namespace bzn;
+
+namespace
+{
+    size_t
+    entry_size(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value)
+    {
+        return uuid.size() + key.size() + value.size();
+    }
+}
+
+
+cached_storage::cached_storage(std::shared_ptr<bzn::storage_base> storage, size_t capacity)
+    : storage(std::move(storage))
+    , shard_capacity(capacity / SHARDS)
+{
+}
+
+
+storage_base::result
+cached_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    // only values that exist are cached, so there is nothing to drop...
+    return this->storage->create(uuid, key, value);
+}
+
+
+std::optional<bzn::value_t>
+cached_storage::read(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto& shard = this->get_shard(uuid, key);
+
+    uint64_t generation{};
+
+    if (auto value = this->lookup(shard, uuid, key, generation))
+    {
+        return *value;
+    }
+
+    auto value = this->storage->read(uuid, key);
+
+    if (value)
+    {
+        this->fill(shard, uuid, key, std::make_shared<const bzn::value_t>(*value), generation);
+    }
+
+    return value;
+}
+
+
+std::optional<bzn::value_view_t>
+cached_storage::read_view(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto& shard = this->get_shard(uuid, key);
+
+    uint64_t generation{};
+
+    auto value = this->lookup(shard, uuid, key, generation);
+
+    if (!value)
+    {
+        auto stored_value = this->storage->read(uuid, key);
+
+        if (!stored_value)
+        {
+            return std::nullopt;
+        }
+
+        value = std::make_shared<const bzn::value_t>(std::move(*stored_value));
+
+        this->fill(shard, uuid, key, value, generation);
+    }
+
+    // the view keeps the value alive even if it is evicted or replaced...
+    return bzn::value_view_t{*value, value};
+}
+
+
+storage_base::result
+cached_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    const auto result = this->storage->update(uuid, key, value);
+
+    this->invalidate(uuid, key);
+
+    return result;
+}
+
+
+storage_base::result
+cached_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
+{
+    const auto result = this->storage->remove(uuid, key);
+
+    this->invalidate(uuid, key);
+
+    return result;
+}
+
+
+std::vector<bzn::key_t>
+cached_storage::get_keys(const bzn::uuid_t& uuid)
+{
+    return this->storage->get_keys(uuid);
+}
+
+
+std::vector<bzn::key_t>
+cached_storage::get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
+{
+    return this->storage->get_keys(uuid, start_after, limit, prefix);
+}
+
+
+bool
+cached_storage::has(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto& shard = this->get_shard(uuid, key);
+
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+
+        if (auto db = shard.index.find(uuid); db != shard.index.end() && db->second.count(key))
+        {
+            return true;
+        }
+    }
+
+    return this->storage->has(uuid, key);
+}
+
+
+std::vector<bzn::key_value_t>
+cached_storage::get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+{
+    return this->storage->get_range(uuid, start, end, limit, reverse);
+}
+
+
+std::pair<std::size_t, std::size_t>
+cached_storage::get_size(const bzn::uuid_t& uuid)
+{
+    return this->storage->get_size(uuid);
+}
+
+
+storage_base::result
+cached_storage::remove(const bzn::uuid_t& uuid)
+{
+    const auto result = this->storage->remove(uuid);
+
+    for (auto& shard : this->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+
+        ++shard.generation;
+
+        if (auto db = shard.index.find(uuid); db != shard.index.end())
+        {
+            std::vector<lru_list::iterator> entries;
+
+            for (const auto& cached : db->second)
+            {
+                entries.emplace_back(cached.second);
+            }
+
+            for (const auto& entry : entries)
+            {
+                this->erase(shard, entry);
+            }
+        }
+    }
+
+    return result;
+}
+
+
+storage_base::result
+cached_storage::multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    return this->storage->multi_create(uuid, records);
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+cached_storage::multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
+
+    std::vector<size_t> missed_indexes;
+    std::vector<bzn::key_t> missed_keys;
+    std::vector<uint64_t> generations;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        uint64_t generation{};
+
+        if (auto value = this->lookup(this->get_shard(uuid, keys[i]), uuid, keys[i], generation))
+        {
+            values[i] = *value;
+        }
+        else
+        {
+            missed_indexes.emplace_back(i);
+            missed_keys.emplace_back(keys[i]);
+            generations.emplace_back(generation);
+        }
+    }
+
+    if (missed_keys.empty())
+    {
+        return values;
+    }
+
+    auto stored_values = this->storage->multi_read(uuid, missed_keys);
+
+    for (size_t i = 0; i < missed_keys.size(); ++i)
+    {
+        if (stored_values[i])
+        {
+            this->fill(this->get_shard(uuid, missed_keys[i]), uuid, missed_keys[i], std::make_shared<const bzn::value_t>(*stored_values[i]), generations[i]);
+
+            values[missed_indexes[i]] = std::move(stored_values[i]);
+        }
+    }
+
+    return values;
+}
+
+
+storage_base::result
+cached_storage::multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    const auto result = this->storage->multi_update(uuid, records);
+
+    for (const auto& record : records)
+    {
+        this->invalidate(uuid, record.first);
+    }
+
+    return result;
+}
+
+
+storage_base::result
+cached_storage::multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    const auto result = this->storage->multi_remove(uuid, keys);
+
+    for (const auto& key : keys)
+    {
+        this->invalidate(uuid, key);
+    }
+
+    return result;
+}
+
+
+std::shared_ptr<bzn::storage_snapshot_base>
+cached_storage::get_snapshot()
+{
+    return this->storage->get_snapshot();
+}
+
+
+std::string
+cached_storage::get_name()
+{
+    return "storage_cache";
+}
+
+
+bzn::json_message
+cached_storage::get_status()
+{
+    bzn::json_message status;
+
+    size_t entries{};
+    size_t bytes{};
+
+    for (auto& shard : this->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+
+        entries += shard.lru.size();
+        bytes += shard.bytes;
+    }
+
+    const uint64_t hits = this->hits;
+    const uint64_t misses = this->misses;
+
+    status["capacity"] = Json::UInt64(this->shard_capacity * SHARDS);
+    status["bytes"] = Json::UInt64(bytes);
+    status["entries"] = Json::UInt64(entries);
+    status["hits"] = Json::UInt64(hits);
+    status["misses"] = Json::UInt64(misses);
+    status["hit_ratio"] = (hits + misses) ? double(hits) / (hits + misses) : 0.0;
+
+    return status;
+}
+
+
+cached_storage::shard&
+cached_storage::get_shard(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    const auto hash = std::hash<bzn::uuid_t>{}(uuid) * 31 + std::hash<bzn::key_t>{}(key);
+
+    return this->shards[hash % SHARDS];
+}
+
+
+cached_storage::cached_value
+cached_storage::lookup(shard& shard, const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t& generation)
+{
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    if (auto db = shard.index.find(uuid); db != shard.index.end())
+    {
+        if (auto found = db->second.find(key); found != db->second.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+
+            this->hits.fetch_add(1, std::memory_order_relaxed);
+
+            return found->second->value;
+        }
+    }
+
+    this->misses.fetch_add(1, std::memory_order_relaxed);
+
+    generation = shard.generation;
+
+    return nullptr;
+}
+
+
+void
+cached_storage::fill(shard& shard, const bzn::uuid_t& uuid, const bzn::key_t& key, cached_value value, uint64_t generation)
+{
+    const auto size = entry_size(uuid, key, *value);
+
+    if (size > this->shard_capacity)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    // something was written since the value was read...
+    if (shard.generation != generation)
+    {
+        return;
+    }
+
+    // or another reader got here first...
+    if (auto db = shard.index.find(uuid); db != shard.index.end() && db->second.count(key))
+    {
+        return;
+    }
+
+    while (shard.bytes + size > this->shard_capacity)
+    {
+        this->erase(shard, std::prev(shard.lru.end()));
+    }
+
+    shard.lru.push_front(entry{uuid, key, std::move(value)});
+    shard.index[uuid].emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += size;
+}
+
+
+void
+cached_storage::invalidate(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    auto& shard = this->get_shard(uuid, key);
+
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    ++shard.generation;
+
+    if (auto db = shard.index.find(uuid); db != shard.index.end())
+    {
+        if (auto found = db->second.find(key); found != db->second.end())
+        {
+            this->erase(shard, found->second);
+        }
+    }
+}
+
+
+void
+cached_storage::erase(shard& shard, lru_list::iterator entry)
+{
+    shard.bytes -= entry_size(entry->uuid, entry->key, *entry->value);
+
+    auto db = shard.index.find(entry->uuid);
+
+    db->second.erase(entry->key);
+
+    if (db->second.empty())
+    {
+        shard.index.erase(db);
+    }
+
+    shard.lru.erase(entry);
+}
@@ -0,0 +1,129 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <storage/storage_base.hpp>
+#include <status/status_provider_base.hpp>
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+
+namespace bzn
+{
+    // Keeps recently read values in front of another storage engine. Each write goes to the storage engine first and
+    // then drops the cached copy of what it changed, so the cache never holds a value the storage engine has replaced.
+    class cached_storage : public bzn::storage_base, public bzn::status_provider_base
+    {
+    public:
+        /**
+         * @param storage the storage engine being cached
+         * @param capacity key and value bytes to cache, the least recently read values are evicted beyond it
+         */
+        cached_storage(std::shared_ptr<bzn::storage_base> storage, size_t capacity);
+
+        storage_base::result create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        // hits are sent straight from the cached value...
+        std::optional<bzn::value_view_t> read_view(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        storage_base::result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override;
+
+        bool has(const bzn::uuid_t& uuid, const  std::string& key) override;
+
+        std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override;
+
+        std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid) override;
+
+        storage_base::result multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        storage_base::result multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        storage_base::result multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        // the storage engine's snapshot, the cache only serves live reads...
+        std::shared_ptr<bzn::storage_snapshot_base> get_snapshot() override;
+
+        std::string get_name() override;
+
+        // hits, misses and what the cache holds...
+        bzn::json_message get_status() override;
+
+    private:
+        using cached_value = std::shared_ptr<const bzn::value_t>;
+
+        struct entry
+        {
+            bzn::uuid_t uuid;
+            bzn::key_t key;
+            cached_value value;
+        };
+
+        // most recently read at the front...
+        using lru_list = std::list<entry>;
+
+        // each shard caches the keys hashed onto it, aligned to keep neighbouring shard locks off the same cache line...
+        struct alignas(64) shard
+        {
+            lru_list lru;
+            std::unordered_map<bzn::uuid_t, std::unordered_map<std::string_view, lru_list::iterator>> index; // keys view into the entries
+            size_t bytes = 0;
+
+            // bumped by every invalidation, so a value read from the storage engine before a write finished is not
+            // cached after it...
+            uint64_t generation = 0;
+
+            std::mutex lock;
+        };
+
+        static constexpr size_t SHARDS = 16;
+
+        shard& get_shard(const bzn::uuid_t& uuid, const bzn::key_t& key);
+
+        // the cached value, or nullptr and the generation to fill it at...
+        cached_value lookup(shard& shard, const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t& generation);
+
+        void fill(shard& shard, const bzn::uuid_t& uuid, const bzn::key_t& key, cached_value value, uint64_t generation);
+
+        void invalidate(const bzn::uuid_t& uuid, const bzn::key_t& key);
+
+        void erase(shard& shard, lru_list::iterator entry);
+
+        const std::shared_ptr<bzn::storage_base> storage;
+        const size_t shard_capacity;
+
+        std::array<shard, SHARDS> shards;
+
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+    };
+
+} // bzn
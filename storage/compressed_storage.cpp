@@ -0,0 +1,359 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/compressed_storage.hpp>
+#include <snappy.h>
+
+using namespace bzn;
+
+namespace
+{
+    const size_t FLAG_SIZE = 1;
+}
+
+
+class compressed_storage::snapshot : public bzn::storage_snapshot_base
+{
+public:
+    explicit snapshot(std::shared_ptr<bzn::storage_snapshot_base> stored)
+        : stored(std::move(stored))
+    {
+    }
+
+    std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const bzn::key_t& key) override
+    {
+        if (auto value = this->stored->read(uuid, key))
+        {
+            return compressed_storage::decode(*value);
+        }
+
+        return std::nullopt;
+    }
+
+    bool has(const bzn::uuid_t& uuid, const bzn::key_t& key) override
+    {
+        return this->stored->has(uuid, key);
+    }
+
+    std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override
+    {
+        return this->stored->get_keys(uuid, start_after, limit, prefix);
+    }
+
+    std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override
+    {
+        auto range = this->stored->get_range(uuid, start, end, limit, reverse);
+
+        for (auto& record : range)
+        {
+            record.second = compressed_storage::decode(record.second).value_or(bzn::value_t());
+        }
+
+        return range;
+    }
+
+    std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override
+    {
+        auto values = this->stored->multi_read(uuid, keys);
+
+        for (auto& value : values)
+        {
+            if (value)
+            {
+                value = compressed_storage::decode(*value);
+            }
+        }
+
+        return values;
+    }
+
+    std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override
+    {
+        const auto size = this->stored->get_size(uuid);
+
+        return {size.first, size.second - size.first * FLAG_SIZE};
+    }
+
+private:
+    const std::shared_ptr<bzn::storage_snapshot_base> stored;
+};
+
+
+compressed_storage::compressed_storage(std::shared_ptr<bzn::storage_base> storage, size_t threshold)
+    : storage(std::move(storage))
+    , threshold(threshold)
+{
+}
+
+
+storage_base::result
+compressed_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    return this->storage->create(uuid, key, this->encode(value));
+}
+
+
+std::optional<bzn::value_t>
+compressed_storage::read(const bzn::uuid_t& uuid, const std::string& key)
+{
+    if (auto stored = this->storage->read(uuid, key))
+    {
+        return compressed_storage::decode(*stored);
+    }
+
+    return std::nullopt;
+}
+
+
+std::optional<bzn::value_view_t>
+compressed_storage::read_view(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto view = this->storage->read_view(uuid, key);
+
+    if (!view || view->data.empty())
+    {
+        return std::nullopt;
+    }
+
+    if (view->data.front() == char(encoding::raw))
+    {
+        view->data.remove_prefix(FLAG_SIZE);
+
+        return view;
+    }
+
+    if (auto value = compressed_storage::decode(view->data))
+    {
+        auto owner = std::make_shared<const bzn::value_t>(std::move(*value));
+
+        return bzn::value_view_t{*owner, owner};
+    }
+
+    return std::nullopt;
+}
+
+
+storage_base::result
+compressed_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    return this->storage->update(uuid, key, this->encode(value));
+}
+
+
+storage_base::result
+compressed_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
+{
+    return this->storage->remove(uuid, key);
+}
+
+
+std::vector<bzn::key_t>
+compressed_storage::get_keys(const bzn::uuid_t& uuid)
+{
+    return this->storage->get_keys(uuid);
+}
+
+
+std::vector<bzn::key_t>
+compressed_storage::get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
+{
+    return this->storage->get_keys(uuid, start_after, limit, prefix);
+}
+
+
+bool
+compressed_storage::has(const bzn::uuid_t& uuid, const std::string& key)
+{
+    return this->storage->has(uuid, key);
+}
+
+
+std::vector<bzn::key_value_t>
+compressed_storage::get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+{
+    auto range = this->storage->get_range(uuid, start, end, limit, reverse);
+
+    for (auto& record : range)
+    {
+        // an undecodable value was already logged, it is returned empty rather than dropped from the page...
+        record.second = compressed_storage::decode(record.second).value_or(bzn::value_t());
+    }
+
+    return range;
+}
+
+
+std::pair<std::size_t, std::size_t>
+compressed_storage::get_size(const bzn::uuid_t& uuid)
+{
+    const auto size = this->storage->get_size(uuid);
+
+    return {size.first, size.second - size.first * FLAG_SIZE};
+}
+
+
+storage_base::result
+compressed_storage::remove(const bzn::uuid_t& uuid)
+{
+    return this->storage->remove(uuid);
+}
+
+
+storage_base::result
+compressed_storage::multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (const auto result = storage_base::check_sizes(records, false); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    return this->storage->multi_create(uuid, this->encode(records));
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+compressed_storage::multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    auto values = this->storage->multi_read(uuid, keys);
+
+    for (auto& value : values)
+    {
+        if (value)
+        {
+            value = compressed_storage::decode(*value);
+        }
+    }
+
+    return values;
+}
+
+
+storage_base::result
+compressed_storage::multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (const auto result = storage_base::check_sizes(records, false); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    return this->storage->multi_update(uuid, this->encode(records));
+}
+
+
+storage_base::result
+compressed_storage::multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    return this->storage->multi_remove(uuid, keys);
+}
+
+
+std::shared_ptr<bzn::storage_snapshot_base>
+compressed_storage::get_snapshot()
+{
+    if (auto stored = this->storage->get_snapshot())
+    {
+        return std::make_shared<compressed_storage::snapshot>(std::move(stored));
+    }
+
+    return nullptr;
+}
+
+
+std::string
+compressed_storage::encode(const bzn::value_t& value) const
+{
+    std::string stored;
+
+    if (value.size() >= this->threshold)
+    {
+        stored.resize(FLAG_SIZE + snappy::MaxCompressedLength(value.size()));
+        stored.front() = char(encoding::snappy);
+
+        size_t compressed_size{};
+        snappy::RawCompress(value.data(), value.size(), &stored[FLAG_SIZE], &compressed_size);
+
+        // incompressible values are kept as they are...
+        if (compressed_size < value.size())
+        {
+            stored.resize(FLAG_SIZE + compressed_size);
+
+            return stored;
+        }
+    }
+
+    stored.assign(FLAG_SIZE, char(encoding::raw));
+    stored.append(value);
+
+    return stored;
+}
+
+
+std::optional<bzn::value_t>
+compressed_storage::decode(std::string_view stored)
+{
+    if (!stored.empty())
+    {
+        const auto data = stored.substr(FLAG_SIZE);
+
+        switch (encoding(stored.front()))
+        {
+            case encoding::raw:
+                return bzn::value_t(data);
+
+            case encoding::snappy:
+            {
+                bzn::value_t value;
+
+                if (snappy::Uncompress(data.data(), data.size(), &value))
+                {
+                    return value;
+                }
+
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    LOG(error) << "unable to decode stored value of " << stored.size() << " bytes";
+
+    return std::nullopt;
+}
+
+
+std::vector<bzn::key_value_t>
+compressed_storage::encode(const std::vector<bzn::key_value_t>& records) const
+{
+    std::vector<bzn::key_value_t> encoded;
+    encoded.reserve(records.size());
+
+    for (const auto& record : records)
+    {
+        encoded.emplace_back(record.first, this->encode(record.second));
+    }
+
+    return encoded;
+}
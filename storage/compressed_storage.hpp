@@ -0,0 +1,93 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <storage/storage_base.hpp>
+
+
+namespace bzn
+{
+    // Compresses large values on their way into another storage engine. Every value is stored behind a flag byte
+    // saying how it was encoded, so values written under any threshold can be read back. Sizes are reported without
+    // the flag bytes, compressed values counting as their compressed size.
+    //
+    // Everything in the storage engine must have been written through this class. A value within a byte of
+    // bzn::MAX_VALUE_SIZE that does not compress no longer fits once flagged and is refused.
+    class compressed_storage : public bzn::storage_base
+    {
+    public:
+        /**
+         * @param storage the storage engine holding the encoded values
+         * @param threshold values of at least this many bytes are compressed, as long as it makes them smaller
+         */
+        compressed_storage(std::shared_ptr<bzn::storage_base> storage, size_t threshold);
+
+        storage_base::result create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        // uncompressed values are viewed in place...
+        std::optional<bzn::value_view_t> read_view(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        storage_base::result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override;
+
+        bool has(const bzn::uuid_t& uuid, const  std::string& key) override;
+
+        std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override;
+
+        std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid) override;
+
+        storage_base::result multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        storage_base::result multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        storage_base::result multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        // decodes what it reads from the storage engine's snapshot...
+        std::shared_ptr<bzn::storage_snapshot_base> get_snapshot() override;
+
+        // the flag byte leading each stored value...
+        enum class encoding : char
+        {
+            raw=0,
+            snappy=1
+        };
+
+        // exposed for testing and benchmarking...
+        std::string encode(const bzn::value_t& value) const;
+
+        static std::optional<bzn::value_t> decode(std::string_view stored);
+
+    private:
+        class snapshot;
+
+        std::vector<bzn::key_value_t> encode(const std::vector<bzn::key_value_t>& records) const;
+
+        const std::shared_ptr<bzn::storage_base> storage;
+        const size_t threshold;
+    };
+
+} // bzn
@@ -13,6 +13,7 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <storage/mem_storage.hpp>
+#include <unordered_set>
 
 using namespace bzn;
 
@@ -32,22 +33,7 @@ mem_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::
         return storage_base::result::key_too_large;
     }
 
-    if (auto search = this->kv_store.find(uuid); search != this->kv_store.end())
-    {
-        if (search->second.find(key)!= search->second.end() )
-        {
-            return storage_base::result::exists;
-        }
-    }
-
-    auto& inner_db =  this->kv_store[uuid];
-
-    if (inner_db.find(key) == inner_db.end())
-    {
-        // todo: test if insert failed?
-        inner_db.insert(std::make_pair(key,value));
-    }
-    else
+    if (!mem_table::unshare(this->get_table(uuid)).insert(key, value))
     {
         return storage_base::result::exists;
     }
@@ -69,13 +55,12 @@ mem_storage::read(const bzn::uuid_t& uuid, const std::string& key)
     }
 
     // we have the db, let's see if the key exists
-    auto& inner_db = search->second;
-    auto inner_search = inner_db.find(key);
-    if (inner_search == inner_db.end())
+    if (const auto value = search->second->find(key))
     {
-        return std::nullopt;
+        return bzn::value_t(*value);
     }
-    return inner_search->second;
+
+    return std::nullopt;
 }
 
 
@@ -98,15 +83,11 @@ mem_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::
 
 
     // we have the db, let's see if the key exists
-    auto& inner_db = search->second;
-    auto inner_search = inner_db.find(key);
-
-    if (inner_search == inner_db.end())
+    if (!mem_table::unshare(search->second).assign(key, value))
     {
         return bzn::storage_base::result::not_found;
     }
 
-    inner_search->second = value;
     return storage_base::result::ok;
 }
 
@@ -123,20 +104,39 @@ mem_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
         return storage_base::result::not_found;
     }
 
-    auto record = search->second.find(key);
-
-    if (record == search->second.end())
+    if (!mem_table::unshare(search->second).erase(key))
     {
         return storage_base::result::not_found;
     }
 
-    search->second.erase(record);
     return storage_base::result::ok;
 }
 
 
 std::vector<std::string>
 mem_storage::get_keys(const bzn::uuid_t& uuid)
+{
+    std::shared_ptr<const bzn::mem_table> table;
+    {
+        std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+        auto inner_db = this->kv_store.find(uuid);
+
+        if (inner_db == this->kv_store.end())
+        {
+            return {};
+        }
+
+        table = inner_db->second;
+    }
+
+    // holding the table lets the scan run without the lock, writers copy it rather than wait...
+    return table->keys({}, 0, {});
+}
+
+
+std::vector<std::string>
+mem_storage::get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
 {
     std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
 
@@ -147,25 +147,37 @@ mem_storage::get_keys(const bzn::uuid_t& uuid)
         return {};
     }
 
-    std::vector<std::string> keys;
-    for (const auto& p : inner_db->second)
-    {
-        keys.emplace_back(p.first);
-    }
-
-    return keys;
+    return inner_db->second->keys(start_after, limit, prefix);
 }
 
 
 bool
 mem_storage::has(const bzn::uuid_t& uuid, const std::string& key)
 {
-    const auto v = this->get_keys(uuid);
-    return std::find(v.begin(), v.end(), key) != v.end();
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    auto search = this->kv_store.find(uuid);
+
+    return search != this->kv_store.end() && search->second->contains(key);
+}
+
+
+std::vector<bzn::key_value_t>
+mem_storage::get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    auto inner_db = this->kv_store.find(uuid);
+
+    if (inner_db == this->kv_store.end())
+    {
+        return {};
+    }
+
+    return inner_db->second->range(start, end, limit, reverse);
 }
 
 
-// todo: optimize! Track size as it grows and not iterate over every value!
 std::pair<std::size_t, std::size_t>
 mem_storage::get_size(const bzn::uuid_t& uuid)
 {
@@ -179,16 +191,7 @@ mem_storage::get_size(const bzn::uuid_t& uuid)
         return std::make_pair(0,0);
     }
 
-    std::size_t size{};
-    std::size_t keys{};
-
-    for (const auto& record : it->second)
-    {
-        ++keys;
-        size += record.second.size();
-    }
-
-    return std::make_pair(keys, size);
+    return std::make_pair(it->second->size(), it->second->value_bytes());
 }
 
 
@@ -206,3 +209,171 @@ mem_storage::remove(const bzn::uuid_t& uuid)
 
     return storage_base::result::not_found;
 }
+
+
+storage_base::result
+mem_storage::multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (auto result = storage_base::check_sizes(records, true); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    if (records.empty())
+    {
+        return storage_base::result::ok;
+    }
+
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    const auto search = this->kv_store.find(uuid);
+
+    std::unordered_set<bzn::key_t> batch_keys;
+
+    for (const auto& record : records)
+    {
+        if ((search != this->kv_store.end() && search->second->contains(record.first)) || !batch_keys.insert(record.first).second)
+        {
+            return storage_base::result::exists;
+        }
+    }
+
+    auto& inner_db = mem_table::unshare(this->get_table(uuid));
+
+    for (const auto& record : records)
+    {
+        inner_db.insert(record.first, record.second);
+    }
+
+    return storage_base::result::ok;
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+mem_storage::multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
+
+    if (auto search = this->kv_store.find(uuid); search != this->kv_store.end())
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (const auto value = search->second->find(keys[i]))
+            {
+                values[i] = bzn::value_t(*value);
+            }
+        }
+    }
+
+    return values;
+}
+
+
+storage_base::result
+mem_storage::multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (auto result = storage_base::check_sizes(records, false); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    auto search = this->kv_store.find(uuid);
+
+    if (search == this->kv_store.end())
+    {
+        return records.empty() ? storage_base::result::ok : storage_base::result::not_found;
+    }
+
+    for (const auto& record : records)
+    {
+        if (!search->second->contains(record.first))
+        {
+            return storage_base::result::not_found;
+        }
+    }
+
+    auto& inner_db = mem_table::unshare(search->second);
+
+    for (const auto& record : records)
+    {
+        inner_db.assign(record.first, record.second);
+    }
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+mem_storage::multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    auto search = this->kv_store.find(uuid);
+
+    if (search == this->kv_store.end())
+    {
+        return keys.empty() ? storage_base::result::ok : storage_base::result::not_found;
+    }
+
+    std::unordered_set<bzn::key_t> batch_keys;
+
+    for (const auto& key : keys)
+    {
+        if (!search->second->contains(key) || !batch_keys.insert(key).second)
+        {
+            return storage_base::result::not_found;
+        }
+    }
+
+    auto& inner_db = mem_table::unshare(search->second);
+
+    for (const auto& key : keys)
+    {
+        inner_db.erase(key);
+    }
+
+    return storage_base::result::ok;
+}
+
+
+size_t
+mem_storage::get_memory_used()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    size_t memory_used{};
+
+    for (const auto& db : this->kv_store)
+    {
+        memory_used += db.first.capacity() + db.second->memory_used();
+    }
+
+    return memory_used;
+}
+
+
+std::shared_ptr<bzn::storage_snapshot_base>
+mem_storage::get_snapshot()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    return std::make_shared<bzn::mem_snapshot>(bzn::mem_snapshot::tables_t(this->kv_store.begin(), this->kv_store.end()));
+}
+
+
+std::shared_ptr<bzn::mem_table>&
+mem_storage::get_table(const bzn::uuid_t& uuid)
+{
+    auto& table = this->kv_store[uuid];
+
+    if (!table)
+    {
+        table = std::make_shared<bzn::mem_table>();
+    }
+
+    return table;
+}
@@ -16,6 +16,7 @@
 
 #include <include/bluzelle.hpp>
 #include <storage/storage_base.hpp>
+#include <storage/mem_table.hpp>
 #include <unordered_map>
 #include <shared_mutex>
 
@@ -36,14 +37,37 @@ namespace bzn
 
         std::vector<std::string> get_keys(const bzn::uuid_t& uuid) override;
 
+        std::vector<std::string> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override;
+
         bool has(const bzn::uuid_t& uuid, const  std::string& key) override;
 
+        std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override;
+
         std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
 
         storage_base::result remove(const bzn::uuid_t& uuid) override;
 
+        storage_base::result multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        storage_base::result multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        storage_base::result multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        // copies no records, a table is only copied when it next changes...
+        std::shared_ptr<bzn::storage_snapshot_base> get_snapshot() override;
+
+        // bytes allocated for the records of every database, get_size only counts the values...
+        size_t get_memory_used();
+
     private:
-        std::unordered_map<bzn::uuid_t, std::unordered_map<bzn::key_t, bzn::value_t>> kv_store;
+        // the database's table, created if need be...
+        std::shared_ptr<bzn::mem_table>& get_table(const bzn::uuid_t& uuid);
+
+        // each database's records packed into its own table, which also tracks their count and value bytes. Tables
+        // are shared with the snapshots taken of them...
+        std::unordered_map<bzn::uuid_t, std::shared_ptr<bzn::mem_table>> kv_store;
 
         std::shared_mutex lock; // for multi-reader and single writer access
     };
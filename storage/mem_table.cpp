@@ -0,0 +1,616 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/mem_table.hpp>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+using namespace bzn;
+
+namespace
+{
+    const uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+    const uint32_t ERASED_SLOT = EMPTY_SLOT - 1;
+    const uint64_t FREE_ID = std::numeric_limits<uint64_t>::max();
+
+    const size_t MIN_SLOTS = 16;
+    const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t); // key & value sizes
+
+    // don't bother compacting small arenas...
+    const size_t MIN_COMPACT_BYTES = 64 * 1024;
+}
+
+
+mem_table::mem_table(const mem_table& other)
+{
+    // ordered reads of the other table may be updating its order...
+    std::lock_guard<std::mutex> lock(other.order_lock);
+
+    this->arena = other.arena;
+    this->dead_bytes = other.dead_bytes;
+    this->slots = other.slots;
+    this->used_slots = other.used_slots;
+    this->locations = other.locations;
+    this->free_ids = other.free_ids;
+    this->records = other.records;
+    this->values = other.values;
+    this->ordered = other.ordered;
+    this->sorted = other.sorted;
+    this->added = other.added;
+    this->retired = other.retired;
+}
+
+
+mem_table&
+mem_table::unshare(std::shared_ptr<mem_table>& table)
+{
+    if (table.use_count() > 1)
+    {
+        table = std::make_shared<mem_table>(*table);
+    }
+    else
+    {
+        // pairs with the release of the last snapshot reference, whose reads must be done before the table changes...
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    return *table;
+}
+
+
+std::optional<std::string_view>
+mem_table::find(std::string_view key) const
+{
+    const auto slot = this->find_slot(key, mem_table::hash_of(key));
+
+    if (slot == this->slots.size())
+    {
+        return std::nullopt;
+    }
+
+    return this->value_of(this->slots[slot].id);
+}
+
+
+bool
+mem_table::contains(std::string_view key) const
+{
+    return this->find_slot(key, mem_table::hash_of(key)) != this->slots.size();
+}
+
+
+bool
+mem_table::insert(std::string_view key, std::string_view value)
+{
+    const auto hash = mem_table::hash_of(key);
+
+    if (this->find_slot(key, hash) != this->slots.size())
+    {
+        return false;
+    }
+
+    // keep the index at most three quarters full...
+    if ((this->used_slots + 1) * 4 > this->slots.size() * 3)
+    {
+        this->rebuild_index();
+    }
+
+    const auto id = this->allocate_id();
+    this->locations[id] = this->append(key, value);
+
+    const auto mask = this->slots.size() - 1;
+
+    for (auto i = hash & mask;; i = (i + 1) & mask)
+    {
+        if (this->slots[i].id == EMPTY_SLOT || this->slots[i].id == ERASED_SLOT)
+        {
+            this->used_slots += (this->slots[i].id == EMPTY_SLOT);
+            this->slots[i] = {hash, id};
+            break;
+        }
+    }
+
+    ++this->records;
+    this->values += value.size();
+
+    if (this->ordered)
+    {
+        this->added.emplace_back(id);
+    }
+
+    return true;
+}
+
+
+bool
+mem_table::assign(std::string_view key, std::string_view value)
+{
+    const auto slot = this->find_slot(key, mem_table::hash_of(key));
+
+    if (slot == this->slots.size())
+    {
+        return false;
+    }
+
+    const auto id = this->slots[slot].id;
+    const auto old_size = this->value_of(id).size();
+
+    if (old_size == value.size())
+    {
+        std::memcpy(this->arena.data() + this->locations[id] + RECORD_HEADER_SIZE + key.size(), value.data(), value.size());
+    }
+    else
+    {
+        // the record moves to the end of the arena and leaves a hole behind...
+        this->dead_bytes += this->record_size(id);
+        this->locations[id] = this->append(key, value);
+    }
+
+    this->values = this->values - old_size + value.size();
+
+    this->compact();
+
+    return true;
+}
+
+
+bool
+mem_table::erase(std::string_view key)
+{
+    const auto slot = this->find_slot(key, mem_table::hash_of(key));
+
+    if (slot == this->slots.size())
+    {
+        return false;
+    }
+
+    const auto id = this->slots[slot].id;
+
+    this->slots[slot].id = ERASED_SLOT;
+
+    --this->records;
+    this->values -= this->value_of(id).size();
+    this->dead_bytes += this->record_size(id);
+
+    this->locations[id] = FREE_ID;
+    this->release_id(id);
+
+    this->compact();
+
+    return true;
+}
+
+
+size_t
+mem_table::size() const
+{
+    return this->records;
+}
+
+
+size_t
+mem_table::value_bytes() const
+{
+    return this->values;
+}
+
+
+size_t
+mem_table::memory_used() const
+{
+    std::lock_guard<std::mutex> lock(this->order_lock);
+
+    return sizeof(mem_table) + this->arena.capacity() + this->slots.capacity() * sizeof(slot)
+        + this->locations.capacity() * sizeof(uint64_t)
+        + (this->free_ids.capacity() + this->sorted.capacity() + this->added.capacity() + this->retired.capacity()) * sizeof(uint32_t);
+}
+
+
+std::vector<bzn::key_t>
+mem_table::keys(const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) const
+{
+    const auto& ids = this->ordered_ids();
+
+    const auto first = (prefix > start_after)
+        ? std::lower_bound(ids.begin(), ids.end(), std::string_view(prefix), [this](uint32_t id, std::string_view key) { return this->key_of(id) < key; })
+        : std::upper_bound(ids.begin(), ids.end(), std::string_view(start_after), [this](std::string_view key, uint32_t id) { return key < this->key_of(id); });
+
+    std::vector<bzn::key_t> keys;
+
+    for (auto it = first; it != ids.end() && (!limit || keys.size() < limit); ++it)
+    {
+        const auto key = this->key_of(*it);
+
+        if (key.compare(0, prefix.size(), prefix) != 0)
+        {
+            break;
+        }
+
+        keys.emplace_back(key);
+    }
+
+    return keys;
+}
+
+
+std::vector<bzn::key_value_t>
+mem_table::range(const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) const
+{
+    std::vector<bzn::key_value_t> range;
+
+    if (!end.empty() && end <= start)
+    {
+        return range;
+    }
+
+    const auto& ids = this->ordered_ids();
+
+    const auto lower_bound = [&](std::string_view key)
+    {
+        return std::lower_bound(ids.begin(), ids.end(), key, [this](uint32_t id, std::string_view key) { return this->key_of(id) < key; });
+    };
+
+    const auto first = lower_bound(start);
+    const auto last = end.empty() ? ids.end() : lower_bound(end);
+
+    const auto take = [&](uint32_t id)
+    {
+        range.emplace_back(this->key_of(id), this->value_of(id));
+    };
+
+    if (reverse)
+    {
+        for (auto it = last; it != first && (!limit || range.size() < limit);)
+        {
+            take(*--it);
+        }
+    }
+    else
+    {
+        for (auto it = first; it != last && (!limit || range.size() < limit); ++it)
+        {
+            take(*it);
+        }
+    }
+
+    return range;
+}
+
+
+uint32_t
+mem_table::hash_of(std::string_view key)
+{
+    return static_cast<uint32_t>(std::hash<std::string_view>{}(key));
+}
+
+
+size_t
+mem_table::find_slot(std::string_view key, uint32_t hash) const
+{
+    if (this->slots.empty())
+    {
+        return 0;
+    }
+
+    const auto mask = this->slots.size() - 1;
+
+    for (auto i = hash & mask;; i = (i + 1) & mask)
+    {
+        const auto& slot = this->slots[i];
+
+        if (slot.id == EMPTY_SLOT)
+        {
+            return this->slots.size();
+        }
+
+        if (slot.id != ERASED_SLOT && slot.hash == hash && this->key_of(slot.id) == key)
+        {
+            return i;
+        }
+    }
+}
+
+
+std::string_view
+mem_table::key_of(uint32_t id) const
+{
+    const char* record = this->arena.data() + this->locations[id];
+
+    uint32_t key_size;
+    std::memcpy(&key_size, record, sizeof(key_size));
+
+    return {record + RECORD_HEADER_SIZE, key_size};
+}
+
+
+std::string_view
+mem_table::value_of(uint32_t id) const
+{
+    const char* record = this->arena.data() + this->locations[id];
+
+    uint32_t sizes[2];
+    std::memcpy(sizes, record, sizeof(sizes));
+
+    return {record + RECORD_HEADER_SIZE + sizes[0], sizes[1]};
+}
+
+
+size_t
+mem_table::record_size(uint32_t id) const
+{
+    uint32_t sizes[2];
+    std::memcpy(sizes, this->arena.data() + this->locations[id], sizeof(sizes));
+
+    return RECORD_HEADER_SIZE + sizes[0] + sizes[1];
+}
+
+
+uint64_t
+mem_table::append(std::string_view key, std::string_view value)
+{
+    const uint64_t offset = this->arena.size();
+    const uint32_t sizes[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+
+    const auto header = reinterpret_cast<const char*>(sizes);
+
+    this->arena.insert(this->arena.end(), header, header + sizeof(sizes));
+    this->arena.insert(this->arena.end(), key.begin(), key.end());
+    this->arena.insert(this->arena.end(), value.begin(), value.end());
+
+    return offset;
+}
+
+
+uint32_t
+mem_table::allocate_id()
+{
+    if (!this->free_ids.empty())
+    {
+        const auto id = this->free_ids.back();
+        this->free_ids.pop_back();
+
+        return id;
+    }
+
+    this->locations.emplace_back(FREE_ID);
+
+    return static_cast<uint32_t>(this->locations.size() - 1);
+}
+
+
+void
+mem_table::release_id(uint32_t id)
+{
+    if (!this->ordered)
+    {
+        this->free_ids.emplace_back(id);
+        return;
+    }
+
+    this->retired.emplace_back(id);
+
+    // mostly removing without reading in order, drop the order rather than hold on to the ids...
+    if (this->retired.size() > MIN_SLOTS && this->retired.size() > this->records)
+    {
+        this->free_ids.insert(this->free_ids.end(), this->retired.begin(), this->retired.end());
+
+        this->ordered = false;
+        this->sorted = {};
+        this->added = {};
+        this->retired = {};
+    }
+}
+
+
+void
+mem_table::rebuild_index()
+{
+    size_t capacity = MIN_SLOTS;
+
+    while (capacity < (this->records + 1) * 2)
+    {
+        capacity *= 2;
+    }
+
+    std::vector<slot> old_slots(capacity, slot{0, EMPTY_SLOT});
+    old_slots.swap(this->slots);
+
+    const auto mask = capacity - 1;
+
+    for (const auto& old_slot : old_slots)
+    {
+        if (old_slot.id == EMPTY_SLOT || old_slot.id == ERASED_SLOT)
+        {
+            continue;
+        }
+
+        auto i = old_slot.hash & mask;
+
+        while (this->slots[i].id != EMPTY_SLOT)
+        {
+            i = (i + 1) & mask;
+        }
+
+        this->slots[i] = old_slot;
+    }
+
+    this->used_slots = this->records;
+}
+
+
+void
+mem_table::compact()
+{
+    if (this->dead_bytes < MIN_COMPACT_BYTES || this->dead_bytes * 2 < this->arena.size())
+    {
+        return;
+    }
+
+    std::vector<char> packed;
+    packed.reserve(this->arena.size() - this->dead_bytes);
+
+    for (auto& location : this->locations)
+    {
+        if (location == FREE_ID)
+        {
+            continue;
+        }
+
+        uint32_t sizes[2];
+        std::memcpy(sizes, this->arena.data() + location, sizeof(sizes));
+
+        const auto record = this->arena.data() + location;
+        location = packed.size();
+
+        packed.insert(packed.end(), record, record + RECORD_HEADER_SIZE + sizes[0] + sizes[1]);
+    }
+
+    this->arena.swap(packed);
+    this->dead_bytes = 0;
+}
+
+
+const std::vector<uint32_t>&
+mem_table::ordered_ids() const
+{
+    std::lock_guard<std::mutex> lock(this->order_lock);
+
+    const auto by_key = [this](uint32_t lhs, uint32_t rhs) { return this->key_of(lhs) < this->key_of(rhs); };
+    const auto is_free = [this](uint32_t id) { return this->locations[id] == FREE_ID; };
+
+    if (!this->ordered)
+    {
+        this->sorted.clear();
+        this->sorted.reserve(this->records);
+
+        for (uint32_t id = 0; id < this->locations.size(); ++id)
+        {
+            if (!is_free(id))
+            {
+                this->sorted.emplace_back(id);
+            }
+        }
+
+        std::sort(this->sorted.begin(), this->sorted.end(), by_key);
+
+        this->ordered = true;
+    }
+    else if (!this->added.empty() || !this->retired.empty())
+    {
+        this->sorted.erase(std::remove_if(this->sorted.begin(), this->sorted.end(), is_free), this->sorted.end());
+        this->added.erase(std::remove_if(this->added.begin(), this->added.end(), is_free), this->added.end());
+
+        std::sort(this->added.begin(), this->added.end(), by_key);
+
+        const auto middle = this->sorted.size();
+        this->sorted.insert(this->sorted.end(), this->added.begin(), this->added.end());
+        std::inplace_merge(this->sorted.begin(), this->sorted.begin() + middle, this->sorted.end(), by_key);
+
+        // nothing refers to the removed ids any more...
+        this->free_ids.insert(this->free_ids.end(), this->retired.begin(), this->retired.end());
+
+        this->added.clear();
+        this->retired.clear();
+    }
+
+    return this->sorted;
+}
+
+
+mem_snapshot::mem_snapshot(tables_t tables)
+    : tables(std::move(tables))
+{
+}
+
+
+std::optional<bzn::value_t>
+mem_snapshot::read(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    if (const auto table = this->find_table(uuid))
+    {
+        if (const auto value = table->find(key))
+        {
+            return bzn::value_t(*value);
+        }
+    }
+
+    return std::nullopt;
+}
+
+
+bool
+mem_snapshot::has(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    const auto table = this->find_table(uuid);
+
+    return table && table->contains(key);
+}
+
+
+std::vector<bzn::key_t>
+mem_snapshot::get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
+{
+    const auto table = this->find_table(uuid);
+
+    return table ? table->keys(start_after, limit, prefix) : std::vector<bzn::key_t>();
+}
+
+
+std::vector<bzn::key_value_t>
+mem_snapshot::get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+{
+    const auto table = this->find_table(uuid);
+
+    return table ? table->range(start, end, limit, reverse) : std::vector<bzn::key_value_t>();
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+mem_snapshot::multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
+
+    if (const auto table = this->find_table(uuid))
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (const auto value = table->find(keys[i]))
+            {
+                values[i] = bzn::value_t(*value);
+            }
+        }
+    }
+
+    return values;
+}
+
+
+std::pair<std::size_t, std::size_t>
+mem_snapshot::get_size(const bzn::uuid_t& uuid)
+{
+    const auto table = this->find_table(uuid);
+
+    return table ? std::make_pair(table->size(), table->value_bytes()) : std::make_pair(size_t(0), size_t(0));
+}
+
+
+const bzn::mem_table*
+mem_snapshot::find_table(const bzn::uuid_t& uuid) const
+{
+    const auto table = this->tables.find(uuid);
+
+    return (table == this->tables.end()) ? nullptr : table->second.get();
+}
@@ -0,0 +1,152 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <storage/storage_base.hpp>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace bzn
+{
+    // The records of one in memory database packed into a single arena, each record being its key and value sizes
+    // followed by the key and value bytes. Records are found through an open addressing index of record ids, so there
+    // is no allocation per record. Key order is only worked out when a paged or range read asks for it.
+    //
+    // Like the standard containers, const members may be called concurrently but the others need exclusive access.
+    class mem_table
+    {
+    public:
+        mem_table() = default;
+
+        // a copy is taken when a table shared with a snapshot is about to change...
+        mem_table(const mem_table& other);
+
+        mem_table& operator=(const mem_table&) = delete;
+
+        // the table to change, replaced by a copy first if a snapshot still holds it... the caller must stop others
+        // from taking new references to the table while it checks
+        static mem_table& unshare(std::shared_ptr<mem_table>& table);
+
+        // the value's bytes in the arena, only valid until the next change to the table...
+        std::optional<std::string_view> find(std::string_view key) const;
+
+        bool contains(std::string_view key) const;
+
+        // false if the key exists...
+        bool insert(std::string_view key, std::string_view value);
+
+        // false if the key does not exist...
+        bool assign(std::string_view key, std::string_view value);
+
+        bool erase(std::string_view key);
+
+        size_t size() const;
+
+        size_t value_bytes() const;
+
+        // everything allocated for the records, their index and their order...
+        size_t memory_used() const;
+
+        // as storage_base::get_keys and storage_base::get_range...
+        std::vector<bzn::key_t> keys(const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) const;
+
+        std::vector<bzn::key_value_t> range(const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) const;
+
+    private:
+        struct slot
+        {
+            uint32_t hash;
+            uint32_t id;
+        };
+
+        static uint32_t hash_of(std::string_view key);
+
+        size_t find_slot(std::string_view key, uint32_t hash) const;
+
+        std::string_view key_of(uint32_t id) const;
+
+        std::string_view value_of(uint32_t id) const;
+
+        size_t record_size(uint32_t id) const;
+
+        uint64_t append(std::string_view key, std::string_view value);
+
+        uint32_t allocate_id();
+
+        void release_id(uint32_t id);
+
+        void rebuild_index();
+
+        void compact();
+
+        // ids of the records in key order, brought up to date with the changes since the last ordered read...
+        const std::vector<uint32_t>& ordered_ids() const;
+
+        std::vector<char> arena;
+        size_t dead_bytes = 0; // left behind by updated and removed records
+
+        std::vector<slot> slots;
+        size_t used_slots = 0; // including erased ones
+
+        std::vector<uint64_t> locations; // arena offset of each record id
+        mutable std::vector<uint32_t> free_ids; // ordered reads hand back the retired ids
+
+        size_t records = 0;
+        size_t values = 0;
+
+        // the key order is kept once something reads in order: ids created since are merged in and ids removed
+        // since are not reused until the next ordered read has dropped them...
+        mutable bool ordered = false;
+        mutable std::vector<uint32_t> sorted;
+        mutable std::vector<uint32_t> added;
+        mutable std::vector<uint32_t> retired;
+        mutable std::mutex order_lock; // concurrent ordered reads take turns updating the order
+    };
+
+
+    // The tables of the in memory storage engines as they were when the snapshot was taken. The engines copy a table
+    // before changing it while a snapshot still holds it...
+    class mem_snapshot : public bzn::storage_snapshot_base
+    {
+    public:
+        using tables_t = std::unordered_map<bzn::uuid_t, std::shared_ptr<const bzn::mem_table>>;
+
+        explicit mem_snapshot(tables_t tables);
+
+        std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const bzn::key_t& key) override;
+
+        bool has(const bzn::uuid_t& uuid, const bzn::key_t& key) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override;
+
+        std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override;
+
+        std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
+
+    private:
+        const bzn::mem_table* find_table(const bzn::uuid_t& uuid) const;
+
+        const tables_t tables;
+    };
+
+} // bzn
@@ -0,0 +1,89 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/rocksdb_group_commit.hpp>
+#include <algorithm>
+#include <chrono>
+
+using namespace bzn;
+
+
+rocksdb_group_commit::rocksdb_group_commit(rocksdb::DB* db)
+    : db(db)
+{
+}
+
+
+rocksdb_group_commit::group_t
+rocksdb_group_commit::append(const std::function<void(rocksdb::WriteBatch& batch)>& writes, const std::vector<group_t>& depends_on)
+{
+    std::lock_guard<std::mutex> lock(this->group_lock);
+
+    if (!this->assembling)
+    {
+        this->assembling = std::make_unique<group>();
+        this->assembling_result = this->assembling->result.get_future().share();
+    }
+
+    writes(this->assembling->batch);
+
+    this->assembling->depends_on.insert(this->assembling->depends_on.end(), depends_on.begin(), depends_on.end());
+
+    return this->assembling_result;
+}
+
+
+rocksdb::Status
+rocksdb_group_commit::commit(const group_t& group)
+{
+    std::lock_guard<std::mutex> lock(this->commit_lock);
+
+    // did the leader of our group write it while we waited?
+    if (group.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        return group.get();
+    }
+
+    // groups complete in order while holding the commit lock, so ours must still be the one being assembled...
+    std::unique_ptr<rocksdb_group_commit::group> leading;
+    {
+        std::lock_guard<std::mutex> lock(this->group_lock);
+
+        leading = std::move(this->assembling);
+    }
+
+    // earlier groups have all completed, so a dependency still pending is our own group...
+    const bool dependency_failed = std::any_of(leading->depends_on.begin(), leading->depends_on.end(), [](const group_t& earlier)
+    {
+        return earlier.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !earlier.get().ok();
+    });
+
+    rocksdb::Status status;
+
+    if (dependency_failed)
+    {
+        status = rocksdb::Status::Aborted("an earlier write this group depends on failed");
+    }
+    else
+    {
+        rocksdb::WriteOptions write_options;
+        write_options.sync = true;
+
+        status = this->db->Write(write_options, &leading->batch);
+    }
+
+    leading->result.set_value(status);
+
+    return status;
+}
@@ -0,0 +1,79 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <rocksdb/db.h>
+#include <rocksdb/write_batch.h>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace bzn
+{
+    /*
+     * Coalesces writes from concurrent callers into a single synced rocksdb::WriteBatch.
+     *
+     * Writers append their updates to the group currently being assembled and then call commit(). The first caller
+     * to get into commit() becomes the leader and writes the whole group with one fsync, every other caller of the
+     * same group just waits for the result. Writes arriving while a group is being synced form the next group, so
+     * under load each fsync carries everything that queued up behind the previous one. Groups are written in the
+     * order their writes were appended.
+     *
+     * A group can depend on earlier groups whose writes its own were checked against. If any of those failed, the
+     * group fails too, without being written.
+     */
+    class rocksdb_group_commit
+    {
+    public:
+        using group_t = std::shared_future<rocksdb::Status>;
+
+        explicit rocksdb_group_commit(rocksdb::DB* db);
+
+        /**
+         * Add writes to the group that is being assembled
+         * @param writes called with the group's batch, under the group lock
+         * @param depends_on earlier groups that must have succeeded for these writes to be written
+         * @return the group the writes will be committed with
+         */
+        group_t append(const std::function<void(rocksdb::WriteBatch& batch)>& writes, const std::vector<group_t>& depends_on = {});
+
+        /**
+         * Make sure a group has been written, writing it (and anything appended since) if nobody else has yet
+         * @param group returned by append
+         * @return status of the synced write
+         */
+        rocksdb::Status commit(const group_t& group);
+
+    private:
+        struct group
+        {
+            rocksdb::WriteBatch batch;
+            std::vector<group_t> depends_on;
+            std::promise<rocksdb::Status> result;
+        };
+
+        rocksdb::DB* db;
+
+        std::unique_ptr<group> assembling;
+        group_t assembling_result;
+        std::mutex group_lock;   // guards the group being assembled
+
+        std::mutex commit_lock;  // one synced write at a time
+    };
+
+} // bzn
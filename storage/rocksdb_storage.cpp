@@ -13,231 +13,1318 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <storage/rocksdb_storage.hpp>
+#include <rocksdb/cache.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/statistics.h>
+#include <rocksdb/table.h>
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+#include <sstream>
 #include <thread>
 
 using namespace bzn;
 
 namespace
 {
-    inline bzn::key_t generate_key(const bzn::uuid_t& uuid, const bzn::key_t& key)
+    const std::string METADATA_COLUMN_FAMILY{"metadata"};
+    const std::string DATABASE_COLUMN_FAMILY_PREFIX{"db:"};
+    const size_t DATABASE_KEY_PREFIX_LENGTH{8};
+    const double DATABASE_MEMTABLE_PREFIX_BLOOM_RATIO{0.1};
+
+    rocksdb::ReadOptions read_options(const rocksdb::Snapshot* snapshot)
+    {
+        rocksdb::ReadOptions read_options;
+        read_options.snapshot = snapshot;
+
+        return read_options;
+    }
+
+    rocksdb::ReadOptions scan_options(const rocksdb::Snapshot* snapshot = nullptr)
+    {
+        // per database column families have a prefix extractor, scans must not be restricted to one prefix...
+        rocksdb::ReadOptions read_options;
+        read_options.total_order_seek = true;
+        read_options.snapshot = snapshot;
+
+        return read_options;
+    }
+
+    inline std::string encode_size(const std::pair<std::size_t, std::size_t>& size)
+    {
+        return std::to_string(size.first) + " " + std::to_string(size.second);
+    }
+
+    inline std::pair<std::size_t, std::size_t> decode_size(const std::string& data)
+    {
+        std::pair<std::size_t, std::size_t> size;
+
+        if (!(std::istringstream(data) >> size.first >> size.second))
+        {
+            throw std::runtime_error("Invalid database size record: " + data);
+        }
+
+        return size;
+    }
+
+    rocksdb::CompressionType compression_type(const std::string& name)
+    {
+        static const std::unordered_map<std::string, rocksdb::CompressionType> types{
+            {"none", rocksdb::kNoCompression}, {"snappy", rocksdb::kSnappyCompression}, {"zlib", rocksdb::kZlibCompression},
+            {"bzip2", rocksdb::kBZip2Compression}, {"lz4", rocksdb::kLZ4Compression}, {"lz4hc", rocksdb::kLZ4HCCompression},
+            {"xpress", rocksdb::kXpressCompression}, {"zstd", rocksdb::kZSTD}};
+
+        if (const auto it = types.find(name); it != types.end())
+        {
+            return it->second;
+        }
+
+        throw std::runtime_error("Unknown rocksdb compression: " + name);
+    }
+
+    void apply_compression(const std::vector<std::string>& compression, rocksdb::ColumnFamilyOptions& options)
+    {
+        if (compression.size() == 1)
+        {
+            options.compression = compression_type(compression.front());
+            options.compression_per_level.clear();
+        }
+        else if (!compression.empty())
+        {
+            options.compression_per_level.clear();
+
+            for (const auto& name : compression)
+            {
+                options.compression_per_level.push_back(compression_type(name));
+            }
+        }
+    }
+}
+
+
+class rocksdb_storage::snapshot : public bzn::storage_snapshot_base
+{
+public:
+    snapshot(rocksdb_storage& storage, std::unordered_map<bzn::uuid_t, column_family_t> column_families)
+        : storage(storage)
+        , column_families(std::move(column_families))
+        , db_snapshot(storage.db->GetSnapshot())
+    {
+    }
+
+    ~snapshot()
+    {
+        this->storage.db->ReleaseSnapshot(this->db_snapshot);
+    }
+
+    std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const bzn::key_t& key) override
+    {
+        const auto location = this->locate(uuid);
+
+        return location ? this->storage.read_at(*location, key, this->db_snapshot) : std::nullopt;
+    }
+
+    bool has(const bzn::uuid_t& uuid, const bzn::key_t& key) override
+    {
+        const auto location = this->locate(uuid);
+
+        return location && this->storage.stored_size(location->column_family.get(), location->prefix + key, true, this->db_snapshot);
+    }
+
+    std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override
+    {
+        const auto location = this->locate(uuid);
+
+        return location ? this->storage.keys_at(*location, start_after, limit, prefix, this->db_snapshot) : std::vector<bzn::key_t>();
+    }
+
+    std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override
+    {
+        const auto location = this->locate(uuid);
+
+        return location ? this->storage.range_at(*location, start, end, limit, reverse, this->db_snapshot) : std::vector<bzn::key_value_t>();
+    }
+
+    std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override
+    {
+        if (const auto location = this->locate(uuid))
+        {
+            return this->storage.multi_read_at(*location, keys, this->db_snapshot);
+        }
+
+        return std::vector<std::optional<bzn::value_t>>(keys.size());
+    }
+
+    std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override
+    {
+        if (std::string size; this->storage.db->Get(read_options(this->db_snapshot), this->storage.metadata, uuid, &size).ok())
+        {
+            return decode_size(size);
+        }
+
+        std::pair<std::size_t, std::size_t> size{};
+
+        // an untracked database is counted...
+        if (this->storage.sizes_incomplete && !this->storage.column_family_per_database)
+        {
+            std::unique_ptr<rocksdb::Iterator> iter(this->storage.db->NewIterator(scan_options(this->db_snapshot)));
+
+            for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+            {
+                ++size.first;
+                size.second += iter->value().size();
+            }
+        }
+
+        return size;
+    }
+
+private:
+    std::optional<database_location> locate(const bzn::uuid_t& uuid) const
+    {
+        if (!this->storage.column_family_per_database)
+        {
+            return database_location{this->storage.default_column_family, uuid};
+        }
+
+        if (auto it = this->column_families.find(uuid); it != this->column_families.end())
+        {
+            return database_location{it->second, {}};
+        }
+
+        return std::nullopt;
+    }
+
+    rocksdb_storage& storage;
+
+    // the handles of the databases that existed, a database dropped since is read through the handle kept here...
+    const std::unordered_map<bzn::uuid_t, column_family_t> column_families;
+
+    const rocksdb::Snapshot* const db_snapshot;
+};
+
+
+rocksdb_storage::rocksdb_storage(const std::string& state_dir, const bzn::uuid_t& uuid, bool column_family_per_database,
+    const bzn::rocksdb_tuning& tuning)
+    : column_family_per_database(column_family_per_database)
+{
+    rocksdb::Options options;
+
+    options.IncreaseParallelism(std::thread::hardware_concurrency());
+    options.OptimizeLevelStyleCompaction();
+    options.create_if_missing = true;
+    options.create_missing_column_families = true;
+    options.write_buffer_size = tuning.write_buffer_size;
+    options.max_write_buffer_number = tuning.max_write_buffer_number;
+    apply_compression(tuning.compression, options);
+
+    if (tuning.statistics)
+    {
+        this->statistics = rocksdb::CreateDBStatistics();
+        options.statistics = this->statistics;
+    }
+
+    // one block cache for every column family so its size bounds the memory used for reads, bloom filters let
+    // point lookups (has, create) skip sst files that cannot contain the key...
+    rocksdb::BlockBasedTableOptions table_options;
+
+    if (tuning.block_cache_size)
+    {
+        table_options.block_cache = rocksdb::NewLRUCache(tuning.block_cache_size);
+    }
+    else
+    {
+        table_options.no_block_cache = true;
+    }
+
+    if (tuning.bloom_filter_bits_per_key > 0)
+    {
+        table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(tuning.bloom_filter_bits_per_key, false));
+    }
+
+    options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+
+    // many tenants share the node's memory so each database gets a small memtable, keys are grouped by their
+    // leading bytes for prefix seeks and memtable bloom filters...
+    this->database_options = rocksdb::ColumnFamilyOptions(options);
+    this->database_options.write_buffer_size = tuning.database_write_buffer_size;
+    this->database_options.prefix_extractor.reset(rocksdb::NewCappedPrefixTransform(DATABASE_KEY_PREFIX_LENGTH));
+    this->database_options.memtable_prefix_bloom_size_ratio = DATABASE_MEMTABLE_PREFIX_BLOOM_RATIO;
+
+    const auto path = boost::filesystem::path(state_dir).append(uuid).string();
+
+    std::vector<rocksdb::ColumnFamilyDescriptor> descriptors{
+        {rocksdb::kDefaultColumnFamilyName, options}, {METADATA_COLUMN_FAMILY, options}};
+
+    std::vector<std::string> column_families;
+    if (rocksdb::DB::ListColumnFamilies(options, path, &column_families).ok())
+    {
+        // an existing database without the metadata column family was written before sizes were tracked...
+        this->sizes_incomplete = std::find(column_families.begin(), column_families.end(), METADATA_COLUMN_FAMILY) == column_families.end();
+
+        for (const auto& name : column_families)
+        {
+            if (name.compare(0, DATABASE_COLUMN_FAMILY_PREFIX.size(), DATABASE_COLUMN_FAMILY_PREFIX) == 0)
+            {
+                descriptors.emplace_back(name, this->database_options);
+            }
+        }
+    }
+
+    if (descriptors.size() > 2 && !this->column_family_per_database)
+    {
+        throw std::runtime_error("Database " + path + " stores one column family per database");
+    }
+
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+
+    rocksdb::DB* rocksdb;
+    rocksdb::Status s = rocksdb::DB::Open(options, path, descriptors, &handles, &rocksdb);
+
+    if (!s.ok())
+    {
+        throw std::runtime_error("Could not open database: " + s.ToString());
+    }
+
+    this->db.reset(rocksdb);
+    this->group_commit = std::make_unique<rocksdb_group_commit>(rocksdb);
+
+    // handles[0] is the default column family which is owned by the db...
+    this->db->DestroyColumnFamilyHandle(handles[0]);
+    this->default_column_family = column_family_t(this->db->DefaultColumnFamily(), [](auto*){});
+    this->metadata = handles[1];
+
+    for (size_t i = 2; i < handles.size(); ++i)
+    {
+        this->column_families[descriptors[i].name.substr(DATABASE_COLUMN_FAMILY_PREFIX.size())] = this->adopt(handles[i]);
+    }
+
+    if (this->column_family_per_database)
+    {
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(scan_options()));
+
+        if (iter->SeekToFirst(); iter->Valid())
+        {
+            this->close();
+
+            throw std::runtime_error("Database " + path + " stores all databases in one column family");
+        }
+    }
+
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions(), this->metadata));
+
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next())
+    {
+        auto uuid = iter->key().ToString();
+
+        this->get_stripe(uuid).sizes[uuid] = decode_size(iter->value().ToString());
+    }
+}
+
+
+rocksdb_storage::~rocksdb_storage()
+{
+    this->close();
+}
+
+
+void
+rocksdb_storage::close()
+{
+    if (this->db)
+    {
+        this->column_families.clear();
+        this->default_column_family.reset();
+
+        this->db->DestroyColumnFamilyHandle(this->metadata);
+        this->group_commit.reset();
+        this->db.reset();
+    }
+}
+
+
+rocksdb_storage::write_stripe&
+rocksdb_storage::get_stripe(const bzn::uuid_t& uuid)
+{
+    return this->stripes[std::hash<bzn::uuid_t>{}(uuid) % this->stripes.size()];
+}
+
+
+rocksdb_storage::column_family_t
+rocksdb_storage::adopt(rocksdb::ColumnFamilyHandle* handle)
+{
+    return column_family_t(handle, [db = this->db.get()](rocksdb::ColumnFamilyHandle* handle)
+    {
+        db->DestroyColumnFamilyHandle(handle);
+    });
+}
+
+
+std::optional<rocksdb_storage::database_location>
+rocksdb_storage::locate(const bzn::uuid_t& uuid)
+{
+    if (!this->column_family_per_database)
+    {
+        return database_location{this->default_column_family, uuid};
+    }
+
+    std::shared_lock<std::shared_mutex> lock(this->column_families_lock); // lock for read access
+
+    if (auto it = this->column_families.find(uuid); it != this->column_families.end())
+    {
+        return database_location{it->second, {}};
+    }
+
+    return std::nullopt;
+}
+
+
+std::optional<rocksdb_storage::database_location>
+rocksdb_storage::locate_or_create(const bzn::uuid_t& uuid)
+{
+    // only writers holding the database's stripe lock create its column family, so nobody can race us to it...
+    if (auto location = this->locate(uuid))
+    {
+        return location;
+    }
+
+    rocksdb::ColumnFamilyHandle* handle;
+
+    if (auto s = this->db->CreateColumnFamily(this->database_options, DATABASE_COLUMN_FAMILY_PREFIX + uuid, &handle); !s.ok())
+    {
+        LOG(error) << "failed to create column family for: " << uuid << " - " << s.ToString();
+
+        return std::nullopt;
+    }
+
+    auto column_family = this->adopt(handle);
+
+    std::lock_guard<std::shared_mutex> lock(this->column_families_lock); // lock for write access
+
+    this->column_families[uuid] = column_family;
+
+    return database_location{column_family, {}};
+}
+
+
+std::optional<std::size_t>
+rocksdb_storage::stored_size(rocksdb::ColumnFamilyHandle* column_family, const std::string& db_key, bool expect_missing,
+    const rocksdb::Snapshot* snapshot)
+{
+    if (expect_missing)
+    {
+        bool value_found{};
+        bzn::value_t value;
+
+        // consults the memtables, block cache and bloom filters only... false is definitive
+        if (!this->db->KeyMayExist(read_options(snapshot), column_family, db_key, &value, &value_found))
+        {
+            return std::nullopt;
+        }
+
+        if (value_found)
+        {
+            return value.size();
+        }
+    }
+
+    // pinned so the value is not copied out of the block cache just to learn its size...
+    rocksdb::PinnableSlice pinned;
+
+    if (!this->db->Get(read_options(snapshot), column_family, db_key, &pinned).ok())
+    {
+        return std::nullopt;
+    }
+
+    return pinned.size();
+}
+
+
+std::optional<std::size_t>
+rocksdb_storage::value_size(write_stripe& stripe, rocksdb::ColumnFamilyHandle* column_family, const std::string& db_key, bool expect_missing)
+{
+    // queued writes are not in rocksdb yet but decide the outcome of the writes after them, so they must land first...
+    if (auto it = stripe.pending.find({column_family->GetID(), db_key}); it != stripe.pending.end())
+    {
+        const auto& group = it->second.group;
+
+        if (group.wait_for(std::chrono::seconds(0)) == std::future_status::ready ? group.get().ok() : this->group_commit->commit(group).ok())
+        {
+            return it->second.value_size;
+        }
+
+        // ...and one that failed leaves whatever rocksdb had
+        stripe.pending.erase(it);
+    }
+
+    return this->stored_size(column_family, db_key, expect_missing);
+}
+
+
+std::pair<std::size_t, std::size_t>&
+rocksdb_storage::db_size(write_stripe& stripe, const bzn::uuid_t& uuid)
+{
+    this->settle_size(stripe, uuid);
+
+    if (auto it = stripe.sizes.find(uuid); it != stripe.sizes.end())
+    {
+        return it->second;
+    }
+
+    std::pair<std::size_t, std::size_t> size{};
+
+    // fall back to counting an untracked database once, the result is persisted with the next write...
+    if (this->sizes_incomplete && !this->column_family_per_database)
+    {
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(scan_options()));
+
+        for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+        {
+            ++size.first;
+            size.second += iter->value().size();
+        }
+    }
+
+    return stripe.sizes.emplace(uuid, size).first->second;
+}
+
+
+void
+rocksdb_storage::settle_size(write_stripe& stripe, const bzn::uuid_t& uuid)
+{
+    const auto it = stripe.size_groups.find(uuid);
+
+    if (it == stripe.size_groups.end() || it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return;
+    }
+
+    if (!it->second.get().ok())
+    {
+        stripe.sizes.erase(uuid);
+
+        if (std::string size; this->db->Get(rocksdb::ReadOptions(), this->metadata, uuid, &size).ok())
+        {
+            stripe.sizes[uuid] = decode_size(size);
+        }
+    }
+
+    stripe.size_groups.erase(it);
+}
+
+
+rocksdb_storage::queued_write
+rocksdb_storage::enqueue(write_stripe& stripe, const bzn::uuid_t& uuid, rocksdb::ColumnFamilyHandle* column_family,
+    const std::vector<key_write>& writes, const std::pair<std::size_t, std::size_t>& size)
+{
+    // the size persisted with these writes builds on the one queued before it, which must land first...
+    std::vector<rocksdb_group_commit::group_t> depends_on;
+
+    if (auto it = stripe.size_groups.find(uuid); it != stripe.size_groups.end())
+    {
+        depends_on.emplace_back(it->second);
+    }
+
+    auto group = this->group_commit->append([&](rocksdb::WriteBatch& batch)
+    {
+        for (const auto& [db_key, value] : writes)
+        {
+            if (value)
+            {
+                batch.Put(column_family, db_key, *value);
+            }
+            else
+            {
+                batch.Delete(column_family, db_key);
+            }
+        }
+
+        batch.Put(this->metadata, uuid, encode_size(size));
+    }, depends_on);
+
+    stripe.sizes[uuid] = size;
+    stripe.size_groups[uuid] = group;
+
+    queued_write write{std::move(group), {}, ++stripe.next_write_id};
+    write.keys.reserve(writes.size());
+
+    for (const auto& [db_key, value] : writes)
+    {
+        write.keys.emplace_back(column_family->GetID(), db_key);
+
+        stripe.pending[write.keys.back()] = {value ? std::optional<std::size_t>(value->size()) : std::nullopt, write.id, write.group};
+    }
+
+    return write;
+}
+
+
+storage_base::result
+rocksdb_storage::commit(write_stripe& stripe, const bzn::uuid_t& uuid, const queued_write& write)
+{
+    const auto s = this->group_commit->commit(write.group);
+
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    // rocksdb has the keys now, unless later writes to them have been queued in the meantime...
+    for (const auto& key : write.keys)
+    {
+        if (auto it = stripe.pending.find(key); it != stripe.pending.end() && it->second.id == write.id)
+        {
+            stripe.pending.erase(it);
+        }
+    }
+
+    this->settle_size(stripe, uuid);
+
+    if (!s.ok())
+    {
+        LOG(error) << "write failed: " << uuid << " - " << s.ToString();
+
+        return storage_base::result::not_saved;
+    }
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+rocksdb_storage::flush(write_stripe& stripe)
+{
+    if (stripe.pending.empty())
+    {
+        return storage_base::result::ok;
+    }
+
+    // holding the stripe lock, so nothing can be queued behind the writes we are waiting for...
+    if (auto s = this->group_commit->commit(this->group_commit->append([](auto&){})); !s.ok())
+    {
+        LOG(error) << "flush failed: " << s.ToString();
+
+        return storage_base::result::not_saved;
+    }
+
+    stripe.pending.clear();
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+rocksdb_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    if (key.size() > bzn::MAX_KEY_SIZE)
+    {
+        return storage_base::result::key_too_large;
+    }
+
+    auto& stripe = this->get_stripe(uuid);
+
+    queued_write write;
+    {
+        std::lock_guard<std::mutex> lock(stripe.lock);
+
+        const auto location = this->locate_or_create(uuid);
+
+        if (!location)
+        {
+            return storage_base::result::not_saved;
+        }
+
+        const auto db_key = location->prefix + key;
+
+        if (this->value_size(stripe, location->column_family.get(), db_key, true))
+        {
+            return storage_base::result::exists;
+        }
+
+        auto size = this->db_size(stripe, uuid);
+
+        ++size.first;
+        size.second += value.size();
+
+        write = this->enqueue(stripe, uuid, location->column_family.get(), {{db_key, &value}}, size);
+    }
+
+    if (auto result = this->commit(stripe, uuid, write); result != storage_base::result::ok)
+    {
+        LOG(error) << "save failed: " << uuid << ":" << key << ":" << value.substr(0,MAX_MESSAGE_SIZE) << "...";
+
+        return result;
+    }
+
+    return storage_base::result::ok;
+}
+
+
+std::optional<bzn::value_t>
+rocksdb_storage::read(const bzn::uuid_t& uuid, const std::string& key)
+{
+    const auto location = this->locate(uuid);
+
+    if (!location)
+    {
+        return std::nullopt;
+    }
+
+    return this->read_at(*location, key, nullptr);
+}
+
+
+std::optional<bzn::value_view_t>
+rocksdb_storage::read_view(const bzn::uuid_t& uuid, const std::string& key)
+{
+    const auto location = this->locate(uuid);
+
+    if (!location)
+    {
+        return std::nullopt;
+    }
+
+    // values found in an sst block stay pinned in the block cache rather than being copied...
+    auto pinned = std::make_shared<rocksdb::PinnableSlice>();
+
+    if (!this->db->Get(rocksdb::ReadOptions(), location->column_family.get(), location->prefix + key, pinned.get()).ok())
+    {
+        return std::nullopt;
+    }
+
+    return bzn::value_view_t{std::string_view(pinned->data(), pinned->size()), pinned};
+}
+
+
+storage_base::result
+rocksdb_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    auto& stripe = this->get_stripe(uuid);
+
+    queued_write write;
+    {
+        std::lock_guard<std::mutex> lock(stripe.lock);
+
+        const auto location = this->locate(uuid);
+
+        if (!location)
+        {
+            return storage_base::result::not_found;
+        }
+
+        const auto db_key = location->prefix + key;
+
+        const auto existing = this->value_size(stripe, location->column_family.get(), db_key, false);
+
+        if (!existing)
+        {
+            return storage_base::result::not_found;
+        }
+
+        auto size = this->db_size(stripe, uuid);
+
+        size.second = size.second - *existing + value.size();
+
+        write = this->enqueue(stripe, uuid, location->column_family.get(), {{db_key, &value}}, size);
+    }
+
+    if (auto result = this->commit(stripe, uuid, write); result != storage_base::result::ok)
+    {
+        LOG(error) << "update failed: " << uuid << ":" << key << ":" << value.substr(0,MAX_MESSAGE_SIZE) << "...";
+
+        return result;
+    }
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+rocksdb_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto& stripe = this->get_stripe(uuid);
+
+    queued_write write;
+    {
+        std::lock_guard<std::mutex> lock(stripe.lock);
+
+        const auto location = this->locate(uuid);
+
+        if (!location)
+        {
+            return storage_base::result::not_found;
+        }
+
+        const auto db_key = location->prefix + key;
+
+        const auto existing = this->value_size(stripe, location->column_family.get(), db_key, false);
+
+        if (!existing)
+        {
+            return storage_base::result::not_found;
+        }
+
+        auto size = this->db_size(stripe, uuid);
+
+        --size.first;
+        size.second -= *existing;
+
+        write = this->enqueue(stripe, uuid, location->column_family.get(), {{db_key, nullptr}}, size);
+    }
+
+    if (this->commit(stripe, uuid, write) != storage_base::result::ok)
     {
-        return uuid+key;
+        return storage_base::result::not_found;
     }
+
+    return storage_base::result::ok;
 }
 
 
-rocksdb_storage::rocksdb_storage(const std::string& state_dir, const bzn::uuid_t& uuid)
+std::vector<bzn::key_t>
+rocksdb_storage::get_keys(const bzn::uuid_t& uuid)
 {
-    rocksdb::Options options;
+    const auto location = this->locate(uuid);
 
-    options.IncreaseParallelism(std::thread::hardware_concurrency());
-    options.OptimizeLevelStyleCompaction();
-    options.create_if_missing = true;
+    if (!location)
+    {
+        return {};
+    }
 
-    rocksdb::DB* rocksdb;
-    rocksdb::Status s = rocksdb::DB::Open(options, boost::filesystem::path(state_dir).append(uuid).string(), &rocksdb);
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(scan_options(), location->column_family.get()));
 
-    if (!s.ok())
+    std::vector<bzn::key_t> v;
+    for (iter->Seek(location->prefix); iter->Valid() && iter->key().starts_with(location->prefix); iter->Next())
     {
-        throw std::runtime_error("Could not open database: " + s.ToString());
+        v.emplace_back(iter->key().ToString().substr(location->prefix.size()));
     }
 
-    this->db.reset(rocksdb);
+    return v;
 }
 
 
-storage_base::result
-rocksdb_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+std::vector<bzn::key_t>
+rocksdb_storage::get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
 {
-    if (value.size() > bzn::MAX_VALUE_SIZE)
+    const auto location = this->locate(uuid);
+
+    if (!location)
     {
-        return storage_base::result::value_too_large;
+        return {};
     }
 
-    if (key.size() > bzn::MAX_KEY_SIZE)
+    return this->keys_at(*location, start_after, limit, prefix, nullptr);
+}
+
+
+bool
+rocksdb_storage::has(const bzn::uuid_t& uuid, const std::string& key)
+{
+    const auto location = this->locate(uuid);
+
+    return location && this->stored_size(location->column_family.get(), location->prefix + key, true);
+}
+
+
+std::vector<bzn::key_value_t>
+rocksdb_storage::get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+{
+    const auto location = this->locate(uuid);
+
+    if (!location)
     {
-        return storage_base::result::key_too_large;
+        return {};
+    }
+
+    return this->range_at(*location, start, end, limit, reverse, nullptr);
+}
+
+
+std::pair<std::size_t, std::size_t>
+rocksdb_storage::get_size(const bzn::uuid_t& uuid)
+{
+    auto& stripe = this->get_stripe(uuid);
+
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    this->settle_size(stripe, uuid);
+
+    if (auto it = stripe.sizes.find(uuid); it != stripe.sizes.end())
+    {
+        return it->second;
+    }
+
+    if (!this->sizes_incomplete)
+    {
+        // database not found...
+        return std::make_pair(0,0);
+    }
+
+    return this->db_size(stripe, uuid);
+}
+
+
+storage_base::result
+rocksdb_storage::remove(const bzn::uuid_t& uuid)
+{
+    auto& stripe = this->get_stripe(uuid);
+
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    // queued writes to this database must land before it is removed...
+    if (auto result = this->flush(stripe); result != storage_base::result::ok)
+    {
+        return result;
     }
 
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    std::size_t keys_removed{};
 
-    if (!this->has(uuid, key))
+    if (this->column_family_per_database)
     {
-        std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+        const auto location = this->locate(uuid);
 
-        auto s = this->db->Put(write_options, generate_key(uuid,key), value);
+        if (!location)
+        {
+            return storage_base::result::not_found;
+        }
 
-        if (!s.ok())
+        // dropping the column family is a metadata operation, its files are reclaimed in the background... readers
+        // still holding the handle finish against the dropped column family
+        if (auto s = this->db->DropColumnFamily(location->column_family.get()); !s.ok())
         {
-            LOG(error) << "save failed: " << uuid << ":" << key << ":" <<
-                value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
+            LOG(error) << "drop column family failed: " << uuid << ":" <<  s.ToString();
 
             return storage_base::result::not_saved;
         }
 
-        return storage_base::result::ok;
+        {
+            std::lock_guard<std::shared_mutex> lock(this->column_families_lock); // lock for write access
+
+            this->column_families.erase(uuid);
+        }
+
+        ++keys_removed;
+    }
+
+    if (!this->column_family_per_database)
+    {
+        // a single seek finds out if there is anything to remove, the range delete covers every record without
+        // visiting them, so writers queueing behind us are not held up for a scan of the whole database...
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(scan_options()));
+
+        if (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid))
+        {
+            ++keys_removed;
+        }
+    }
+
+    const auto end = storage_base::prefix_end(uuid);
+
+    auto group = this->group_commit->append([&](rocksdb::WriteBatch& batch)
+    {
+        if (!this->column_family_per_database && keys_removed)
+        {
+            batch.DeleteRange(this->default_column_family.get(), uuid, end);
+        }
+
+        batch.Delete(this->metadata, uuid);
+    });
+
+    // the sizes still describe what is on disk if the removal did not make it there...
+    if (auto s = this->group_commit->commit(group); !s.ok())
+    {
+        LOG(error) << "delete failed: " << uuid << ":" <<  s.ToString();
+
+        return storage_base::result::not_saved;
     }
 
-    return storage_base::result::exists;
+    stripe.sizes.erase(uuid);
+    stripe.size_groups.erase(uuid);
+
+    return (keys_removed) ? storage_base::result::ok : storage_base::result::not_found;
 }
 
 
-std::optional<bzn::value_t>
-rocksdb_storage::read(const bzn::uuid_t& uuid, const std::string& key)
+storage_base::result
+rocksdb_storage::multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
 {
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    if (auto result = storage_base::check_sizes(records, true); result != storage_base::result::ok)
+    {
+        return result;
+    }
 
-    bzn::value_t value;
-    auto s = this->db->Get(rocksdb::ReadOptions(), generate_key(uuid, key), &value);
+    if (records.empty())
+    {
+        return storage_base::result::ok;
+    }
 
-    if (!s.ok())
+    auto& stripe = this->get_stripe(uuid);
+
+    queued_write write;
     {
-        return std::nullopt;
+        std::lock_guard<std::mutex> lock(stripe.lock);
+
+        const auto location = this->locate_or_create(uuid);
+
+        if (!location)
+        {
+            return storage_base::result::not_saved;
+        }
+
+        auto size = this->db_size(stripe, uuid);
+
+        std::vector<key_write> writes;
+        writes.reserve(records.size());
+
+        std::unordered_set<std::string> batch_keys;
+
+        for (const auto& [key, value] : records)
+        {
+            auto db_key = location->prefix + key;
+
+            if (this->value_size(stripe, location->column_family.get(), db_key, true) || !batch_keys.insert(db_key).second)
+            {
+                return storage_base::result::exists;
+            }
+
+            ++size.first;
+            size.second += value.size();
+
+            writes.emplace_back(std::move(db_key), &value);
+        }
+
+        write = this->enqueue(stripe, uuid, location->column_family.get(), writes, size);
     }
 
-    return value;
+    if (auto result = this->commit(stripe, uuid, write); result != storage_base::result::ok)
+    {
+        LOG(error) << "batch save failed: " << uuid << ": " << records.size() << " records";
+
+        return result;
+    }
+
+    return storage_base::result::ok;
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+rocksdb_storage::multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    const auto location = this->locate(uuid);
+
+    if (!location)
+    {
+        return std::vector<std::optional<bzn::value_t>>(keys.size());
+    }
+
+    return this->multi_read_at(*location, keys, nullptr);
 }
 
 
 storage_base::result
-rocksdb_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+rocksdb_storage::multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
 {
-    if (value.size() > bzn::MAX_VALUE_SIZE)
+    if (auto result = storage_base::check_sizes(records, false); result != storage_base::result::ok)
     {
-        return storage_base::result::value_too_large;
+        return result;
+    }
+
+    if (records.empty())
+    {
+        return storage_base::result::ok;
     }
 
-    if (this->has(uuid,key))
+    auto& stripe = this->get_stripe(uuid);
+
+    queued_write write;
     {
-        std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+        std::lock_guard<std::mutex> lock(stripe.lock);
 
-        rocksdb::WriteOptions write_options;
-        write_options.sync = true;
+        const auto location = this->locate(uuid);
 
-        auto s = this->db->Put(write_options, generate_key(uuid, key), value);
+        if (!location)
+        {
+            return storage_base::result::not_found;
+        }
+
+        auto size = this->db_size(stripe, uuid);
 
-        if (!s.ok())
+        std::vector<key_write> writes;
+        writes.reserve(records.size());
+
+        // a key updated twice in one batch replaces the value written earlier in the batch...
+        std::unordered_map<std::string, std::size_t> batch_sizes;
+
+        for (const auto& [key, value] : records)
         {
-            LOG(error) << "update failed: " << uuid << ":" << key << ":" <<
-                value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
+            auto db_key = location->prefix + key;
 
-            return storage_base::result::not_saved;
+            const auto batch_size = batch_sizes.find(db_key);
+
+            const auto existing = (batch_size != batch_sizes.end())
+                ? std::optional<std::size_t>(batch_size->second) : this->value_size(stripe, location->column_family.get(), db_key, false);
+
+            if (!existing)
+            {
+                return storage_base::result::not_found;
+            }
+
+            size.second = size.second - *existing + value.size();
+            batch_sizes[db_key] = value.size();
+
+            writes.emplace_back(std::move(db_key), &value);
         }
 
-        return storage_base::result::ok;
+        write = this->enqueue(stripe, uuid, location->column_family.get(), writes, size);
+    }
+
+    if (auto result = this->commit(stripe, uuid, write); result != storage_base::result::ok)
+    {
+        LOG(error) << "batch update failed: " << uuid << ": " << records.size() << " records";
+
+        return result;
     }
 
-    return storage_base::result::not_found;
+    return storage_base::result::ok;
 }
 
 
 storage_base::result
-rocksdb_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
+rocksdb_storage::multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
 {
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    if (keys.empty())
+    {
+        return storage_base::result::ok;
+    }
 
-    if (this->has(uuid, key))
+    auto& stripe = this->get_stripe(uuid);
+
+    queued_write write;
     {
-        std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+        std::lock_guard<std::mutex> lock(stripe.lock);
 
-        auto s = this->db->Delete(write_options, generate_key(uuid, key));
+        const auto location = this->locate(uuid);
 
-        if (!s.ok())
+        if (!location)
         {
             return storage_base::result::not_found;
         }
 
-        return storage_base::result::ok;
+        auto size = this->db_size(stripe, uuid);
+
+        std::vector<key_write> writes;
+        writes.reserve(keys.size());
+
+        std::unordered_set<std::string> batch_keys;
+
+        for (const auto& key : keys)
+        {
+            auto db_key = location->prefix + key;
+
+            const auto existing = this->value_size(stripe, location->column_family.get(), db_key, false);
+
+            if (!existing || !batch_keys.insert(db_key).second)
+            {
+                return storage_base::result::not_found;
+            }
+
+            --size.first;
+            size.second -= *existing;
+
+            writes.emplace_back(std::move(db_key), nullptr);
+        }
+
+        write = this->enqueue(stripe, uuid, location->column_family.get(), writes, size);
     }
 
-    return storage_base::result::not_found;
+    if (this->commit(stripe, uuid, write) != storage_base::result::ok)
+    {
+        return storage_base::result::not_found;
+    }
+
+    return storage_base::result::ok;
 }
 
 
-std::vector<bzn::key_t>
-rocksdb_storage::get_keys(const bzn::uuid_t& uuid)
+std::shared_ptr<bzn::storage_snapshot_base>
+rocksdb_storage::get_snapshot()
 {
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    // the handles are copied under the lock so no database is created or dropped between them and the snapshot...
+    std::shared_lock<std::shared_mutex> lock(this->column_families_lock); // lock for read access
+
+    return std::make_shared<rocksdb_storage::snapshot>(*this, this->column_families);
+}
 
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
 
-    std::vector<bzn::key_t> v;
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+std::optional<bzn::value_t>
+rocksdb_storage::read_at(const database_location& location, const bzn::key_t& key, const rocksdb::Snapshot* snapshot)
+{
+    bzn::value_t value;
+    auto s = this->db->Get(read_options(snapshot), location.column_family.get(), location.prefix + key, &value);
+
+    if (!s.ok())
     {
-        v.emplace_back(iter->key().ToString().substr(uuid.size()));
+        return std::nullopt;
     }
 
-    return v;
+    return value;
 }
 
 
-bool
-rocksdb_storage::has(const bzn::uuid_t& uuid, const std::string& key)
+std::vector<bzn::key_t>
+rocksdb_storage::keys_at(const database_location& location, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix,
+    const rocksdb::Snapshot* snapshot)
 {
-    const bzn::key_t has_key = generate_key(uuid, key);
+    const auto key_prefix = location.prefix + prefix;
 
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(scan_options(snapshot), location.column_family.get()));
 
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    std::vector<bzn::key_t> keys;
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    // keys are ordered bytewise so the page starts at whichever of the prefix and the cursor sorts last...
+    for (iter->Seek(location.prefix + std::max(prefix, start_after));
+        iter->Valid() && iter->key().starts_with(key_prefix) && (!limit || keys.size() < limit); iter->Next())
     {
-        if (iter->key() == has_key)
+        bzn::key_t key(iter->key().data() + location.prefix.size(), iter->key().size() - location.prefix.size());
+
+        if (key != start_after)
         {
-            return true;
+            keys.emplace_back(std::move(key));
         }
     }
 
-    return false;
+    return keys;
 }
 
 
-std::pair<std::size_t, std::size_t>
-rocksdb_storage::get_size(const bzn::uuid_t& uuid)
+std::vector<bzn::key_value_t>
+rocksdb_storage::range_at(const database_location& location, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse,
+    const rocksdb::Snapshot* snapshot)
 {
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    if (!end.empty() && end <= start)
+    {
+        return {};
+    }
 
-    std::size_t size{};
-    std::size_t keys{};
+    const auto lower = location.prefix + start;
+    const auto upper = end.empty() ? storage_base::prefix_end(location.prefix) : location.prefix + end; // empty when unbounded
 
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(scan_options(snapshot), location.column_family.get()));
+
+    std::vector<bzn::key_value_t> range;
+
+    const auto add = [&]()
+    {
+        range.emplace_back(bzn::key_t(iter->key().data() + location.prefix.size(), iter->key().size() - location.prefix.size()),
+            iter->value().ToString());
+    };
+
+    if (reverse)
+    {
+        // position on the last key below the upper bound...
+        if (upper.empty())
+        {
+            iter->SeekToLast();
+        }
+        else if (iter->Seek(upper); iter->Valid())
+        {
+            iter->Prev();
+        }
+        else
+        {
+            iter->SeekToLast();
+        }
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+        for (; iter->Valid() && iter->key().compare(lower) >= 0 && (!limit || range.size() < limit); iter->Prev())
+        {
+            add();
+        }
+    }
+    else
     {
-        ++keys;
-        size += iter->value().size();
+        for (iter->Seek(lower); iter->Valid() && (upper.empty() || iter->key().compare(upper) < 0) && (!limit || range.size() < limit); iter->Next())
+        {
+            add();
+        }
     }
 
-    return std::make_pair(keys, size);
+    return range;
 }
 
 
-storage_base::result
-rocksdb_storage::remove(const bzn::uuid_t& uuid)
+std::vector<std::optional<bzn::value_t>>
+rocksdb_storage::multi_read_at(const database_location& location, const std::vector<bzn::key_t>& keys, const rocksdb::Snapshot* snapshot)
 {
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
 
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    std::vector<std::string> db_keys;
+    db_keys.reserve(keys.size());
 
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+    for (const auto& key : keys)
+    {
+        db_keys.emplace_back(location.prefix + key);
+    }
 
-    std::size_t keys_removed{};
+    std::vector<bzn::value_t> found;
+    const auto statuses = this->db->MultiGet(read_options(snapshot),
+        std::vector<rocksdb::ColumnFamilyHandle*>(keys.size(), location.column_family.get()),
+        std::vector<rocksdb::Slice>(db_keys.begin(), db_keys.end()), &found);
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    for (size_t i = 0; i < keys.size(); ++i)
     {
-        auto s = this->db->Delete(write_options, iter->key());
+        if (statuses[i].ok())
+        {
+            values[i] = std::move(found[i]);
+        }
+    }
 
-        if (!s.ok())
+    return values;
+}
+
+
+std::string
+rocksdb_storage::get_name()
+{
+    return "rocksdb";
+}
+
+
+bzn::json_message
+rocksdb_storage::get_status()
+{
+    bzn::json_message status;
+
+    // summed over every column family...
+    for (const auto& property : {rocksdb::DB::Properties::kBlockCacheUsage, rocksdb::DB::Properties::kCurSizeAllMemTables,
+        rocksdb::DB::Properties::kEstimateTableReadersMem, rocksdb::DB::Properties::kEstimateNumKeys,
+        rocksdb::DB::Properties::kTotalSstFilesSize})
+    {
+        if (uint64_t value; this->db->GetAggregatedIntProperty(property, &value))
         {
-            LOG(error) << "delete failed: " << uuid << ":" <<  s.ToString();
+            status[property.substr(property.find('.') + 1)] = Json::UInt64(value);
         }
+    }
 
-        ++keys_removed;
+    if (this->statistics)
+    {
+        for (const auto& ticker : std::vector<std::pair<std::string, rocksdb::Tickers>>{
+            {"block-cache-hit", rocksdb::BLOCK_CACHE_HIT}, {"block-cache-miss", rocksdb::BLOCK_CACHE_MISS},
+            {"bloom-filter-useful", rocksdb::BLOOM_FILTER_USEFUL}, {"memtable-hit", rocksdb::MEMTABLE_HIT},
+            {"memtable-miss", rocksdb::MEMTABLE_MISS}, {"bytes-read", rocksdb::BYTES_READ},
+            {"bytes-written", rocksdb::BYTES_WRITTEN}, {"compact-read-bytes", rocksdb::COMPACT_READ_BYTES},
+            {"compact-write-bytes", rocksdb::COMPACT_WRITE_BYTES}, {"wal-file-synced", rocksdb::WAL_FILE_SYNCED}})
+        {
+            status["statistics"][ticker.first] = Json::UInt64(this->statistics->getTickerCount(ticker.second));
+        }
     }
 
-    return (keys_removed) ? storage_base::result::ok : storage_base::result::not_found;
+    return status;
 }
@@ -17,37 +17,181 @@
 #include <include/bluzelle.hpp>
 #include <storage/storage_base.hpp>
 #include <options/options_base.hpp>
+#include <storage/rocksdb_group_commit.hpp>
+#include <storage/rocksdb_tuning.hpp>
+#include <status/status_provider_base.hpp>
 #include <rocksdb/db.h>
+#include <rocksdb/write_batch.h>
+#include <array>
+#include <map>
+#include <mutex>
 #include <shared_mutex>
+#include <unordered_map>
 
 
 namespace bzn
 {
-    class rocksdb_storage : public bzn::storage_base
+    class rocksdb_storage : public bzn::storage_base, public bzn::status_provider_base
     {
     public:
-        rocksdb_storage(const std::string& state_dir, const bzn::uuid_t& uuid);
+        /**
+         * @param column_family_per_database store each database in its own column family instead of prefixing its
+         *        keys with the database uuid. Deleting a database then drops its column family in constant time. The
+         *        layout is fixed when the database directory is first created.
+         * @param tuning cache, filter, compression and memtable settings
+         */
+        rocksdb_storage(const std::string& state_dir, const bzn::uuid_t& uuid, bool column_family_per_database = false,
+            const bzn::rocksdb_tuning& tuning = bzn::rocksdb_tuning());
+
+        ~rocksdb_storage();
 
         storage_base::result create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
 
         std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
 
+        std::optional<bzn::value_view_t> read_view(const bzn::uuid_t& uuid, const std::string& key) override;
+
         storage_base::result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
 
         storage_base::result remove(const bzn::uuid_t& uuid, const std::string& key) override;
 
         std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid) override;
 
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override;
+
         bool has(const bzn::uuid_t& uuid, const  std::string& key) override;
 
+        std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override;
+
         std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
 
         storage_base::result remove(const bzn::uuid_t& uuid) override;
 
+        storage_base::result multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        storage_base::result multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        storage_base::result multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        // reads at a rocksdb snapshot, which pins the versions it sees until it is released...
+        std::shared_ptr<bzn::storage_snapshot_base> get_snapshot() override;
+
+        std::string get_name() override;
+
+        // memory use and, when statistics are enabled, cache and filter effectiveness...
+        bzn::json_message get_status() override;
+
     private:
+        // handles are released once nobody uses them, so a reader can finish with a database that was just dropped...
+        using column_family_t = std::shared_ptr<rocksdb::ColumnFamilyHandle>;
+
+        // where the records of a database live: its column family and the prefix added to each key...
+        struct database_location
+        {
+            column_family_t column_family;
+            std::string prefix;
+        };
+
+        std::optional<database_location> locate(const bzn::uuid_t& uuid);
+
+        std::optional<database_location> locate_or_create(const bzn::uuid_t& uuid);
+
+        column_family_t adopt(rocksdb::ColumnFamilyHandle* handle);
+
+        class snapshot;
+
+        // reads of a located database, at the snapshot if one is given...
+        std::optional<bzn::value_t> read_at(const database_location& location, const bzn::key_t& key, const rocksdb::Snapshot* snapshot);
+
+        std::vector<bzn::key_t> keys_at(const database_location& location, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix,
+            const rocksdb::Snapshot* snapshot);
+
+        std::vector<bzn::key_value_t> range_at(const database_location& location, const bzn::key_t& start, const bzn::key_t& end, size_t limit,
+            bool reverse, const rocksdb::Snapshot* snapshot);
+
+        std::vector<std::optional<bzn::value_t>> multi_read_at(const database_location& location, const std::vector<bzn::key_t>& keys,
+            const rocksdb::Snapshot* snapshot);
+
+        // a write that has been queued for the next group commit but may not be in rocksdb yet...
+        struct pending_write
+        {
+            std::optional<std::size_t> value_size; // nullopt when the key is being deleted
+            uint64_t id;
+            rocksdb_group_commit::group_t group;
+        };
+
+        using pending_key = std::pair<uint32_t, std::string>; // column family id & key
+
+        struct queued_write
+        {
+            rocksdb_group_commit::group_t group;
+            std::vector<pending_key> keys;
+            uint64_t id;
+        };
+
+        using key_write = std::pair<std::string, const bzn::value_t*>; // key & value, a null value deletes the key
+
+        // writers of the databases hashed onto a stripe take turns checking and queueing their updates, the stripe
+        // also holds what they have queued and the sizes of its databases. Readers never take a stripe lock... aligned
+        // to keep neighbouring stripe locks off the same cache line
+        struct alignas(64) write_stripe
+        {
+            std::map<pending_key, pending_write> pending;
+            std::unordered_map<bzn::uuid_t, std::pair<std::size_t, std::size_t>> sizes;
+            std::unordered_map<bzn::uuid_t, rocksdb_group_commit::group_t> size_groups; // last to write each size
+            uint64_t next_write_id = 0;
+
+            std::mutex lock;
+        };
+
+        static constexpr size_t WRITE_STRIPES = 64;
+
+        write_stripe& get_stripe(const bzn::uuid_t& uuid);
+
+        void close();
+
+        // size of the value stored for a key in a single lookup... callers that expect the key to be absent (creates)
+        // let the bloom filters answer, callers that expect it to exist (updates, deletes) go straight to a pinned Get
+        std::optional<std::size_t> stored_size(rocksdb::ColumnFamilyHandle* column_family, const std::string& db_key, bool expect_missing,
+            const rocksdb::Snapshot* snapshot = nullptr);
+
+        // as above but including writes queued on the stripe, which the caller has locked... a queued write to the key
+        // is waited for, since whether it lands decides the outcome of ours
+        std::optional<std::size_t> value_size(write_stripe& stripe, rocksdb::ColumnFamilyHandle* column_family, const std::string& db_key,
+            bool expect_missing);
+
+        std::pair<std::size_t, std::size_t>& db_size(write_stripe& stripe, const bzn::uuid_t& uuid);
+
+        // once the last write queued for a database has landed its size is persisted... if that write failed, the
+        // sizes queued since the last good one never will be, so the persisted size is loaded again
+        void settle_size(write_stripe& stripe, const bzn::uuid_t& uuid);
+
+        queued_write enqueue(write_stripe& stripe, const bzn::uuid_t& uuid, rocksdb::ColumnFamilyHandle* column_family,
+            const std::vector<key_write>& writes, const std::pair<std::size_t, std::size_t>& size);
+
+        storage_base::result commit(write_stripe& stripe, const bzn::uuid_t& uuid, const queued_write& write);
+
+        storage_base::result flush(write_stripe& stripe);
+
         std::unique_ptr<rocksdb::DB> db;
+        std::shared_ptr<rocksdb::Statistics> statistics;
+
+        // writers check and queue their updates under their stripe's lock but wait for the synced write without it,
+        // rocksdb itself is safe for concurrent use...
+        std::unique_ptr<rocksdb_group_commit> group_commit;
+        std::array<write_stripe, WRITE_STRIPES> stripes;
+
+        // per database key & byte counts, persisted in the metadata column family alongside every write...
+        rocksdb::ColumnFamilyHandle* metadata = nullptr;
+        bool sizes_incomplete = false; // opened a database that predates size tracking
 
-        std::shared_mutex lock; // for multi-reader and single writer access
+        const bool column_family_per_database;
+        rocksdb::ColumnFamilyOptions database_options;
+        column_family_t default_column_family;
+        std::unordered_map<bzn::uuid_t, column_family_t> column_families;
+        std::shared_mutex column_families_lock; // only held to look up, add or drop a handle
     };
 
 } // bzn
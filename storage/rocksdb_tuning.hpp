@@ -0,0 +1,48 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace bzn
+{
+    // deployment specific rocksdb settings, the defaults match what rocksdb_storage has always used...
+    struct rocksdb_tuning
+    {
+        // shared by every column family, 0 disables the block cache...
+        size_t block_cache_size = 8 * 1024 * 1024;
+
+        // 0 disables the sst bloom filters used by point lookups...
+        int bloom_filter_bits_per_key = 10;
+
+        // one entry for every level or one entry per level ("none", "snappy", "zlib", "bzip2", "lz4", "lz4hc",
+        // "xpress" or "zstd"), empty keeps rocksdb's choice...
+        std::vector<std::string> compression;
+
+        // memtable size and count for the node's own column families...
+        size_t write_buffer_size = 128 * 1024 * 1024;
+        int max_write_buffer_number = 6;
+
+        // memtable size for each database's column family...
+        size_t database_write_buffer_size = 4 * 1024 * 1024;
+
+        // collect rocksdb's tickers and histograms (costs a few percent of throughput)...
+        bool statistics = false;
+    };
+
+} // bzn
@@ -0,0 +1,428 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/sharded_mem_storage.hpp>
+#include <unordered_set>
+
+using namespace bzn;
+
+
+sharded_mem_storage::sharded_mem_storage(size_t shard_count)
+{
+    // hardware_concurrency() may return 0 if it cannot be determined...
+    shard_count = std::max(shard_count, size_t(1));
+
+    this->shards.reserve(shard_count);
+
+    for (size_t i = 0; i < shard_count; ++i)
+    {
+        this->shards.emplace_back(std::make_unique<shard>());
+    }
+}
+
+
+sharded_mem_storage::shard&
+sharded_mem_storage::get_shard(const bzn::uuid_t& uuid)
+{
+    return *this->shards[std::hash<bzn::uuid_t>{}(uuid) % this->shards.size()];
+}
+
+
+size_t
+sharded_mem_storage::shard_count() const
+{
+    return this->shards.size();
+}
+
+
+storage_base::result
+sharded_mem_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    if (key.size() > bzn::MAX_KEY_SIZE)
+    {
+        return storage_base::result::key_too_large;
+    }
+
+    auto& shard = this->get_shard(uuid);
+
+    std::lock_guard<std::shared_mutex> lock(shard.lock); // lock for write access
+
+    if (!mem_table::unshare(shard.get_table(uuid)).insert(key, value))
+    {
+        return storage_base::result::exists;
+    }
+
+    return storage_base::result::ok;
+}
+
+
+std::optional<bzn::value_t>
+sharded_mem_storage::read(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::shared_lock<std::shared_mutex> lock(shard.lock); // lock for read access
+
+    auto search = shard.kv_store.find(uuid);
+
+    if (search == shard.kv_store.end())
+    {
+        return std::nullopt;
+    }
+
+    if (const auto value = search->second->find(key))
+    {
+        return bzn::value_t(*value);
+    }
+
+    return std::nullopt;
+}
+
+
+storage_base::result
+sharded_mem_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    auto& shard = this->get_shard(uuid);
+
+    std::lock_guard<std::shared_mutex> lock(shard.lock); // lock for write access
+
+    auto search = shard.kv_store.find(uuid);
+
+    if (search == shard.kv_store.end())
+    {
+        return storage_base::result::not_found;
+    }
+
+    if (!mem_table::unshare(search->second).assign(key, value))
+    {
+        return storage_base::result::not_found;
+    }
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+sharded_mem_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::lock_guard<std::shared_mutex> lock(shard.lock); // lock for write access
+
+    auto search = shard.kv_store.find(uuid);
+
+    if (search == shard.kv_store.end())
+    {
+        return storage_base::result::not_found;
+    }
+
+    if (!mem_table::unshare(search->second).erase(key))
+    {
+        return storage_base::result::not_found;
+    }
+
+    return storage_base::result::ok;
+}
+
+
+std::vector<std::string>
+sharded_mem_storage::get_keys(const bzn::uuid_t& uuid)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::shared_ptr<const bzn::mem_table> table;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.lock); // lock for read access
+
+        auto inner_db = shard.kv_store.find(uuid);
+
+        if (inner_db == shard.kv_store.end())
+        {
+            return {};
+        }
+
+        table = inner_db->second;
+    }
+
+    // holding the table lets the scan run without the lock, writers copy it rather than wait...
+    return table->keys({}, 0, {});
+}
+
+
+std::vector<std::string>
+sharded_mem_storage::get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::shared_lock<std::shared_mutex> lock(shard.lock); // lock for read access
+
+    auto inner_db = shard.kv_store.find(uuid);
+
+    if (inner_db == shard.kv_store.end())
+    {
+        return {};
+    }
+
+    return inner_db->second->keys(start_after, limit, prefix);
+}
+
+
+bool
+sharded_mem_storage::has(const bzn::uuid_t& uuid, const std::string& key)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::shared_lock<std::shared_mutex> lock(shard.lock); // lock for read access
+
+    auto search = shard.kv_store.find(uuid);
+
+    return search != shard.kv_store.end() && search->second->contains(key);
+}
+
+
+std::vector<bzn::key_value_t>
+sharded_mem_storage::get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::shared_lock<std::shared_mutex> lock(shard.lock); // lock for read access
+
+    auto inner_db = shard.kv_store.find(uuid);
+
+    if (inner_db == shard.kv_store.end())
+    {
+        return {};
+    }
+
+    return inner_db->second->range(start, end, limit, reverse);
+}
+
+
+std::pair<std::size_t, std::size_t>
+sharded_mem_storage::get_size(const bzn::uuid_t& uuid)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::shared_lock<std::shared_mutex> lock(shard.lock); // lock for read access
+
+    auto it = shard.kv_store.find(uuid);
+
+    if (it == shard.kv_store.end())
+    {
+        // database not found...
+        return std::make_pair(0,0);
+    }
+
+    return std::make_pair(it->second->size(), it->second->value_bytes());
+}
+
+
+storage_base::result
+sharded_mem_storage::remove(const bzn::uuid_t& uuid)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::lock_guard<std::shared_mutex> lock(shard.lock); // lock for write access
+
+    if (shard.kv_store.erase(uuid))
+    {
+        return storage_base::result::ok;
+    }
+
+    return storage_base::result::not_found;
+}
+
+
+storage_base::result
+sharded_mem_storage::multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (auto result = storage_base::check_sizes(records, true); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    if (records.empty())
+    {
+        return storage_base::result::ok;
+    }
+
+    auto& shard = this->get_shard(uuid);
+
+    std::lock_guard<std::shared_mutex> lock(shard.lock); // lock for write access
+
+    const auto search = shard.kv_store.find(uuid);
+
+    std::unordered_set<bzn::key_t> batch_keys;
+
+    for (const auto& record : records)
+    {
+        if ((search != shard.kv_store.end() && search->second->contains(record.first)) || !batch_keys.insert(record.first).second)
+        {
+            return storage_base::result::exists;
+        }
+    }
+
+    auto& inner_db = mem_table::unshare(shard.get_table(uuid));
+
+    for (const auto& record : records)
+    {
+        inner_db.insert(record.first, record.second);
+    }
+
+    return storage_base::result::ok;
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+sharded_mem_storage::multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::shared_lock<std::shared_mutex> lock(shard.lock); // lock for read access
+
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
+
+    if (auto search = shard.kv_store.find(uuid); search != shard.kv_store.end())
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (const auto value = search->second->find(keys[i]))
+            {
+                values[i] = bzn::value_t(*value);
+            }
+        }
+    }
+
+    return values;
+}
+
+
+storage_base::result
+sharded_mem_storage::multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (auto result = storage_base::check_sizes(records, false); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    auto& shard = this->get_shard(uuid);
+
+    std::lock_guard<std::shared_mutex> lock(shard.lock); // lock for write access
+
+    auto search = shard.kv_store.find(uuid);
+
+    if (search == shard.kv_store.end())
+    {
+        return records.empty() ? storage_base::result::ok : storage_base::result::not_found;
+    }
+
+    for (const auto& record : records)
+    {
+        if (!search->second->contains(record.first))
+        {
+            return storage_base::result::not_found;
+        }
+    }
+
+    auto& inner_db = mem_table::unshare(search->second);
+
+    for (const auto& record : records)
+    {
+        inner_db.assign(record.first, record.second);
+    }
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+sharded_mem_storage::multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    auto& shard = this->get_shard(uuid);
+
+    std::lock_guard<std::shared_mutex> lock(shard.lock); // lock for write access
+
+    auto search = shard.kv_store.find(uuid);
+
+    if (search == shard.kv_store.end())
+    {
+        return keys.empty() ? storage_base::result::ok : storage_base::result::not_found;
+    }
+
+    std::unordered_set<bzn::key_t> batch_keys;
+
+    for (const auto& key : keys)
+    {
+        if (!search->second->contains(key) || !batch_keys.insert(key).second)
+        {
+            return storage_base::result::not_found;
+        }
+    }
+
+    auto& inner_db = mem_table::unshare(search->second);
+
+    for (const auto& key : keys)
+    {
+        inner_db.erase(key);
+    }
+
+    return storage_base::result::ok;
+}
+
+
+std::shared_ptr<bzn::storage_snapshot_base>
+sharded_mem_storage::get_snapshot()
+{
+    // every stripe is held at once so the snapshot is of a single moment, always locked in the same order...
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(this->shards.size());
+
+    for (auto& shard : this->shards)
+    {
+        locks.emplace_back(shard->lock);
+    }
+
+    bzn::mem_snapshot::tables_t tables;
+
+    for (const auto& shard : this->shards)
+    {
+        tables.insert(shard->kv_store.begin(), shard->kv_store.end());
+    }
+
+    return std::make_shared<bzn::mem_snapshot>(std::move(tables));
+}
+
+
+std::shared_ptr<bzn::mem_table>&
+sharded_mem_storage::shard::get_table(const bzn::uuid_t& uuid)
+{
+    auto& table = this->kv_store[uuid];
+
+    if (!table)
+    {
+        table = std::make_shared<bzn::mem_table>();
+    }
+
+    return table;
+}
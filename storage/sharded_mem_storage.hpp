@@ -0,0 +1,86 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <storage/storage_base.hpp>
+#include <storage/mem_table.hpp>
+#include <unordered_map>
+#include <shared_mutex>
+#include <memory>
+#include <thread>
+
+
+namespace bzn
+{
+    // In memory storage where each database uuid is hashed onto one of a fixed set of lock stripes, so writers to
+    // one database do not block readers and writers of databases living on other stripes.
+    class sharded_mem_storage : public bzn::storage_base
+    {
+    public:
+        explicit sharded_mem_storage(size_t shard_count = std::thread::hardware_concurrency());
+
+        storage_base::result create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        storage_base::result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        std::vector<std::string> get_keys(const bzn::uuid_t& uuid) override;
+
+        std::vector<std::string> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override;
+
+        bool has(const bzn::uuid_t& uuid, const  std::string& key) override;
+
+        std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override;
+
+        std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid) override;
+
+        storage_base::result multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        storage_base::result multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        storage_base::result multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        // copies no records, a table is only copied when it next changes...
+        std::shared_ptr<bzn::storage_snapshot_base> get_snapshot() override;
+
+        size_t shard_count() const;
+
+    private:
+        // aligned to keep neighbouring stripe locks off the same cache line...
+        struct alignas(64) shard
+        {
+            // the database's table, created if need be...
+            std::shared_ptr<bzn::mem_table>& get_table(const bzn::uuid_t& uuid);
+
+            // tables are shared with the snapshots taken of them...
+            std::unordered_map<bzn::uuid_t, std::shared_ptr<bzn::mem_table>> kv_store;
+
+            std::shared_mutex lock; // for multi-reader and single writer access
+        };
+
+        shard& get_shard(const bzn::uuid_t& uuid);
+
+        std::vector<std::unique_ptr<shard>> shards;
+    };
+
+} // bzn
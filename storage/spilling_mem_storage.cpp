@@ -0,0 +1,793 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/spilling_mem_storage.hpp>
+#include <algorithm>
+#include <iterator>
+#include <unordered_set>
+
+using namespace bzn;
+
+
+spilling_mem_storage::spilling_mem_storage(std::shared_ptr<bzn::storage_base> cold_storage, size_t memory_budget)
+    : cold_storage(std::move(cold_storage))
+    , memory_budget(memory_budget)
+{
+}
+
+
+storage_base::result
+spilling_mem_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    if (key.size() > bzn::MAX_KEY_SIZE)
+    {
+        return storage_base::result::key_too_large;
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (this->find_hot(uuid, key) || this->cold_storage->has(uuid, key))
+    {
+        return storage_base::result::exists;
+    }
+
+    auto& size = this->db_size(uuid);
+
+    this->insert_hot(uuid, key, value, true, false);
+
+    ++size.first;
+    size.second += value.size();
+
+    this->evict();
+
+    return storage_base::result::ok;
+}
+
+
+std::optional<bzn::value_t>
+spilling_mem_storage::read(const bzn::uuid_t& uuid, const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (auto record = this->find_hot(uuid, key))
+    {
+        this->touch(*record);
+
+        return record->value;
+    }
+
+    auto value = this->cold_storage->read(uuid, key);
+
+    if (value)
+    {
+        // keep it in memory in case it is read again, it can be dropped again without writing it out...
+        this->insert_hot(uuid, key, *value, false, true);
+        this->evict();
+    }
+
+    return value;
+}
+
+
+storage_base::result
+spilling_mem_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_base::result::value_too_large;
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (auto record = this->find_hot(uuid, key))
+    {
+        auto& size = this->db_size(uuid);
+
+        size.second = size.second - record->value.size() + value.size();
+
+        this->assign_hot(*record, value);
+    }
+    else
+    {
+        const auto old_value = this->cold_storage->read(uuid, key);
+
+        if (!old_value)
+        {
+            return storage_base::result::not_found;
+        }
+
+        auto& size = this->db_size(uuid);
+
+        size.second = size.second - old_value->size() + value.size();
+
+        this->insert_hot(uuid, key, value, true, true);
+    }
+
+    this->evict();
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+spilling_mem_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    auto record = this->find_hot(uuid, key);
+
+    std::size_t value_size{};
+
+    if (record)
+    {
+        value_size = record->value.size();
+    }
+    else if (const auto value = this->cold_storage->read(uuid, key))
+    {
+        value_size = value->size();
+    }
+    else
+    {
+        return storage_base::result::not_found;
+    }
+
+    // sizes are seeded from cold storage, so before changing it...
+    auto& size = this->db_size(uuid);
+
+    if (!record || record->spilled)
+    {
+        if (const auto result = this->cold_storage->remove(uuid, key); result != storage_base::result::ok)
+        {
+            return result;
+        }
+    }
+
+    if (record)
+    {
+        this->erase_hot(uuid, key);
+    }
+
+    --size.first;
+    size.second -= value_size;
+
+    return storage_base::result::ok;
+}
+
+
+std::vector<bzn::key_t>
+spilling_mem_storage::get_keys(const bzn::uuid_t& uuid)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    auto keys = this->cold_storage->get_keys(uuid);
+
+    auto db = this->hot.find(uuid);
+
+    if (db == this->hot.end())
+    {
+        return keys;
+    }
+
+    std::vector<bzn::key_t> hot_keys;
+
+    for (const auto& record : db->second)
+    {
+        hot_keys.emplace_back(record.first);
+    }
+
+    std::vector<bzn::key_t> all_keys;
+
+    std::set_union(std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()),
+        std::make_move_iterator(hot_keys.begin()), std::make_move_iterator(hot_keys.end()), std::back_inserter(all_keys));
+
+    return all_keys;
+}
+
+
+std::vector<bzn::key_t>
+spilling_mem_storage::get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    auto keys = this->cold_storage->get_keys(uuid, start_after, limit, prefix);
+
+    auto db = this->hot.find(uuid);
+
+    if (db == this->hot.end())
+    {
+        return keys;
+    }
+
+    // a page from each tier covers the merged page...
+    auto hot_keys = storage_base::page_of_keys(db->second, start_after, limit, prefix);
+
+    std::vector<bzn::key_t> all_keys;
+
+    std::set_union(std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()),
+        std::make_move_iterator(hot_keys.begin()), std::make_move_iterator(hot_keys.end()), std::back_inserter(all_keys));
+
+    if (limit && all_keys.size() > limit)
+    {
+        all_keys.resize(limit);
+    }
+
+    return all_keys;
+}
+
+
+bool
+spilling_mem_storage::has(const bzn::uuid_t& uuid, const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    return this->find_hot(uuid, key) || this->cold_storage->has(uuid, key);
+}
+
+
+std::vector<bzn::key_value_t>
+spilling_mem_storage::get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    auto range = this->cold_storage->get_range(uuid, start, end, limit, reverse);
+
+    auto db = this->hot.find(uuid);
+
+    if (db == this->hot.end())
+    {
+        return range;
+    }
+
+    // records in memory are newer than any copy in cold storage... scans don't count as use, so they don't push the
+    // working set out of memory
+    std::map<bzn::key_t, bzn::value_t> records(std::make_move_iterator(range.begin()), std::make_move_iterator(range.end()));
+
+    if (end.empty() || start < end)
+    {
+        const auto first = db->second.lower_bound(start);
+        const auto last = end.empty() ? db->second.end() : db->second.lower_bound(end);
+
+        size_t taken{};
+
+        if (reverse)
+        {
+            for (auto it = last; it != first && (!limit || taken < limit); ++taken)
+            {
+                --it;
+                records.insert_or_assign(it->first, it->second.value);
+            }
+        }
+        else
+        {
+            for (auto it = first; it != last && (!limit || taken < limit); ++it, ++taken)
+            {
+                records.insert_or_assign(it->first, it->second.value);
+            }
+        }
+    }
+
+    range.clear();
+
+    const auto take = [&](auto first, auto last)
+    {
+        for (auto it = first; it != last && (!limit || range.size() < limit); ++it)
+        {
+            range.emplace_back(std::move(*it));
+        }
+    };
+
+    if (reverse)
+    {
+        take(std::make_move_iterator(records.rbegin()), std::make_move_iterator(records.rend()));
+    }
+    else
+    {
+        take(std::make_move_iterator(records.begin()), std::make_move_iterator(records.end()));
+    }
+
+    return range;
+}
+
+
+std::pair<std::size_t, std::size_t>
+spilling_mem_storage::get_size(const bzn::uuid_t& uuid)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (auto size = this->sizes.find(uuid); size != this->sizes.end())
+    {
+        return size->second;
+    }
+
+    return this->cold_storage->get_size(uuid);
+}
+
+
+storage_base::result
+spilling_mem_storage::remove(const bzn::uuid_t& uuid)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    bool found = false;
+
+    if (auto db = this->hot.find(uuid); db != this->hot.end())
+    {
+        for (const auto& record : db->second)
+        {
+            this->memory_used -= record.first.size() + record.second.value.size();
+            this->lru.erase(record.second.lru);
+        }
+
+        this->hot.erase(db);
+
+        found = true;
+    }
+
+    this->sizes.erase(uuid);
+
+    const auto result = this->cold_storage->remove(uuid);
+
+    if (result == storage_base::result::not_found && found)
+    {
+        return storage_base::result::ok;
+    }
+
+    return result;
+}
+
+
+storage_base::result
+spilling_mem_storage::multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (auto result = storage_base::check_sizes(records, true); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    if (records.empty())
+    {
+        return storage_base::result::ok;
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    std::unordered_set<bzn::key_t> batch_keys;
+
+    for (const auto& record : records)
+    {
+        if (!batch_keys.insert(record.first).second || this->find_hot(uuid, record.first) || this->cold_storage->has(uuid, record.first))
+        {
+            return storage_base::result::exists;
+        }
+    }
+
+    auto& size = this->db_size(uuid);
+
+    for (const auto& record : records)
+    {
+        this->insert_hot(uuid, record.first, record.second, true, false);
+
+        ++size.first;
+        size.second += record.second.size();
+    }
+
+    this->evict();
+
+    return storage_base::result::ok;
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+spilling_mem_storage::multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
+
+    std::vector<size_t> cold_indexes;
+    std::vector<bzn::key_t> cold_keys;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (auto record = this->find_hot(uuid, keys[i]))
+        {
+            this->touch(*record);
+
+            values[i] = record->value;
+        }
+        else
+        {
+            cold_indexes.emplace_back(i);
+            cold_keys.emplace_back(keys[i]);
+        }
+    }
+
+    if (cold_keys.empty())
+    {
+        return values;
+    }
+
+    auto cold_values = this->cold_storage->multi_read(uuid, cold_keys);
+
+    for (size_t i = 0; i < cold_keys.size(); ++i)
+    {
+        if (cold_values[i])
+        {
+            // the same key may be asked for twice...
+            if (!this->find_hot(uuid, cold_keys[i]))
+            {
+                this->insert_hot(uuid, cold_keys[i], *cold_values[i], false, true);
+            }
+
+            values[cold_indexes[i]] = std::move(cold_values[i]);
+        }
+    }
+
+    this->evict();
+
+    return values;
+}
+
+
+storage_base::result
+spilling_mem_storage::multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records)
+{
+    if (auto result = storage_base::check_sizes(records, false); result != storage_base::result::ok)
+    {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    std::vector<bzn::key_t> cold_keys;
+
+    for (const auto& record : records)
+    {
+        if (!this->find_hot(uuid, record.first))
+        {
+            cold_keys.emplace_back(record.first);
+        }
+    }
+
+    // sizes of the values being replaced in cold storage...
+    std::unordered_map<bzn::key_t, std::size_t> cold_sizes;
+
+    if (!cold_keys.empty())
+    {
+        const auto cold_values = this->cold_storage->multi_read(uuid, cold_keys);
+
+        for (size_t i = 0; i < cold_keys.size(); ++i)
+        {
+            if (!cold_values[i])
+            {
+                return storage_base::result::not_found;
+            }
+
+            cold_sizes[cold_keys[i]] = cold_values[i]->size();
+        }
+    }
+
+    if (records.empty())
+    {
+        return storage_base::result::ok;
+    }
+
+    auto& size = this->db_size(uuid);
+
+    for (const auto& record : records)
+    {
+        if (auto hot_record = this->find_hot(uuid, record.first))
+        {
+            size.second = size.second - hot_record->value.size() + record.second.size();
+
+            this->assign_hot(*hot_record, record.second);
+        }
+        else
+        {
+            size.second = size.second - cold_sizes[record.first] + record.second.size();
+
+            this->insert_hot(uuid, record.first, record.second, true, true);
+        }
+    }
+
+    this->evict();
+
+    return storage_base::result::ok;
+}
+
+
+storage_base::result
+spilling_mem_storage::multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    std::unordered_set<bzn::key_t> batch_keys;
+
+    std::vector<bzn::key_t> cold_keys;    // copies to remove from cold storage
+    std::vector<bzn::key_t> missing_keys; // not in memory
+    std::size_t removed_bytes{};
+
+    for (const auto& key : keys)
+    {
+        if (!batch_keys.insert(key).second)
+        {
+            return storage_base::result::not_found;
+        }
+
+        if (auto record = this->find_hot(uuid, key))
+        {
+            removed_bytes += record->value.size();
+
+            if (record->spilled)
+            {
+                cold_keys.emplace_back(key);
+            }
+        }
+        else
+        {
+            missing_keys.emplace_back(key);
+        }
+    }
+
+    if (!missing_keys.empty())
+    {
+        for (auto& value : this->cold_storage->multi_read(uuid, missing_keys))
+        {
+            if (!value)
+            {
+                return storage_base::result::not_found;
+            }
+
+            removed_bytes += value->size();
+        }
+
+        std::move(missing_keys.begin(), missing_keys.end(), std::back_inserter(cold_keys));
+    }
+
+    if (keys.empty())
+    {
+        return storage_base::result::ok;
+    }
+
+    // sizes are seeded from cold storage, so before changing it...
+    auto& size = this->db_size(uuid);
+
+    if (!cold_keys.empty())
+    {
+        if (const auto result = this->cold_storage->multi_remove(uuid, cold_keys); result != storage_base::result::ok)
+        {
+            return result;
+        }
+    }
+
+    for (const auto& key : keys)
+    {
+        if (this->find_hot(uuid, key))
+        {
+            this->erase_hot(uuid, key);
+        }
+    }
+
+    size.first -= keys.size();
+    size.second -= removed_bytes;
+
+    return storage_base::result::ok;
+}
+
+
+std::shared_ptr<bzn::storage_snapshot_base>
+spilling_mem_storage::get_snapshot()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    // removals already reach cold storage, so once every change held in memory is written out it has the lot... the
+    // records stay in memory, now clean
+    bool written = true;
+
+    for (const auto& db : this->hot)
+    {
+        std::vector<bzn::key_value_t> creates;
+        std::vector<bzn::key_value_t> updates;
+
+        for (const auto& record : db.second)
+        {
+            if (record.second.dirty)
+            {
+                (record.second.spilled ? updates : creates).emplace_back(record.first, record.second.value);
+            }
+        }
+
+        written = this->spill(db.first, creates, false) && written;
+        written = this->spill(db.first, updates, true) && written;
+    }
+
+    if (!written)
+    {
+        return nullptr;
+    }
+
+    return this->cold_storage->get_snapshot();
+}
+
+
+size_t
+spilling_mem_storage::get_memory_used()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    return this->memory_used;
+}
+
+
+spilling_mem_storage::hot_record*
+spilling_mem_storage::find_hot(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    auto db = this->hot.find(uuid);
+
+    if (db == this->hot.end())
+    {
+        return nullptr;
+    }
+
+    auto record = db->second.find(key);
+
+    return (record == db->second.end()) ? nullptr : &record->second;
+}
+
+
+void
+spilling_mem_storage::insert_hot(const bzn::uuid_t& uuid, const bzn::key_t& key, bzn::value_t value, bool dirty, bool spilled)
+{
+    auto db = this->hot.try_emplace(uuid).first;
+    auto record = db->second.emplace(key, hot_record{std::move(value), dirty, spilled, {}}).first;
+
+    this->memory_used += record->first.size() + record->second.value.size();
+
+    this->lru.emplace_front(&db->first, &record->first);
+    record->second.lru = this->lru.begin();
+}
+
+
+void
+spilling_mem_storage::assign_hot(hot_record& record, const bzn::value_t& value)
+{
+    this->memory_used = this->memory_used - record.value.size() + value.size();
+
+    record.value = value;
+    record.dirty = true;
+
+    this->touch(record);
+}
+
+
+void
+spilling_mem_storage::erase_hot(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    auto db = this->hot.find(uuid);
+    auto record = db->second.find(key);
+
+    this->memory_used -= record->first.size() + record->second.value.size();
+    this->lru.erase(record->second.lru);
+
+    db->second.erase(record);
+
+    if (db->second.empty())
+    {
+        this->hot.erase(db);
+    }
+}
+
+
+void
+spilling_mem_storage::touch(const hot_record& record)
+{
+    this->lru.splice(this->lru.begin(), this->lru, record.lru);
+}
+
+
+std::pair<std::size_t, std::size_t>&
+spilling_mem_storage::db_size(const bzn::uuid_t& uuid)
+{
+    auto size = this->sizes.find(uuid);
+
+    if (size == this->sizes.end())
+    {
+        size = this->sizes.emplace(uuid, this->cold_storage->get_size(uuid)).first;
+    }
+
+    return size->second;
+}
+
+
+void
+spilling_mem_storage::evict()
+{
+    if (this->memory_used <= this->memory_budget)
+    {
+        return;
+    }
+
+    // pick the victims first so each database's records go out in one batch...
+    std::vector<lru_list::value_type> victims;
+    std::unordered_map<bzn::uuid_t, std::pair<std::vector<bzn::key_value_t>, std::vector<bzn::key_value_t>>> writes; // creates & updates
+
+    size_t freed{};
+
+    for (auto it = this->lru.rbegin(); it != this->lru.rend() && this->memory_used - freed > this->memory_budget; ++it)
+    {
+        const auto& record = *this->find_hot(*it->first, *it->second);
+
+        victims.emplace_back(*it);
+        freed += it->second->size() + record.value.size();
+
+        if (record.dirty)
+        {
+            auto& db_writes = writes[*it->first];
+
+            (record.spilled ? db_writes.second : db_writes.first).emplace_back(*it->second, record.value);
+        }
+    }
+
+    for (const auto& db_writes : writes)
+    {
+        this->spill(db_writes.first, db_writes.second.first, false);
+        this->spill(db_writes.first, db_writes.second.second, true);
+    }
+
+    for (const auto& victim : victims)
+    {
+        if (!this->find_hot(*victim.first, *victim.second)->dirty)
+        {
+            // copy, the database and key go away with the record...
+            const auto uuid = *victim.first;
+            const auto key = *victim.second;
+
+            this->erase_hot(uuid, key);
+        }
+    }
+}
+
+
+bool
+spilling_mem_storage::spill(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& batch, bool spilled)
+{
+    if (batch.empty())
+    {
+        return true;
+    }
+
+    const auto result = spilled ? this->cold_storage->multi_update(uuid, batch) : this->cold_storage->multi_create(uuid, batch);
+
+    if (result != storage_base::result::ok)
+    {
+        // keep them in memory rather than lose them...
+        LOG(error) << "failed to spill " << batch.size() << " records of: " << uuid << " - " << uint32_t(result);
+        return false;
+    }
+
+    for (const auto& written : batch)
+    {
+        auto record = this->find_hot(uuid, written.first);
+
+        record->dirty = false;
+        record->spilled = true;
+    }
+
+    return true;
+}
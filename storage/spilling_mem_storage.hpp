@@ -0,0 +1,119 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <storage/storage_base.hpp>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace bzn
+{
+    // in memory storage that keeps its most recently used records within a byte budget and spills the rest to a
+    // slower storage engine, records are only written out when they are evicted...
+    class spilling_mem_storage : public bzn::storage_base
+    {
+    public:
+        /**
+         * @param cold_storage where evicted records are kept, it should start out empty as the records it holds are
+         *        only ever known through this storage
+         * @param memory_budget key and value bytes to keep in memory
+         */
+        spilling_mem_storage(std::shared_ptr<bzn::storage_base> cold_storage, size_t memory_budget);
+
+        storage_base::result create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        storage_base::result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) override;
+
+        bool has(const bzn::uuid_t& uuid, const  std::string& key) override;
+
+        std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) override;
+
+        std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
+
+        storage_base::result remove(const bzn::uuid_t& uuid) override;
+
+        storage_base::result multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        storage_base::result multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) override;
+
+        storage_base::result multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        // writes out the changes held in memory and snapshots cold storage, nullptr if they could not be written...
+        std::shared_ptr<bzn::storage_snapshot_base> get_snapshot() override;
+
+        // key and value bytes currently held in memory...
+        size_t get_memory_used();
+
+    private:
+        // database & key of each record in memory, least recently used at the back...
+        using lru_list = std::list<std::pair<const bzn::uuid_t*, const bzn::key_t*>>;
+
+        struct hot_record
+        {
+            bzn::value_t value;
+            bool dirty;   // changed since it was last written to cold storage
+            bool spilled; // cold storage holds a (possibly stale) copy
+            lru_list::iterator lru;
+        };
+
+        using hot_database = std::map<bzn::key_t, hot_record>;
+
+        hot_record* find_hot(const bzn::uuid_t& uuid, const bzn::key_t& key);
+
+        void insert_hot(const bzn::uuid_t& uuid, const bzn::key_t& key, bzn::value_t value, bool dirty, bool spilled);
+
+        void assign_hot(hot_record& record, const bzn::value_t& value);
+
+        void erase_hot(const bzn::uuid_t& uuid, const bzn::key_t& key);
+
+        void touch(const hot_record& record);
+
+        std::pair<std::size_t, std::size_t>& db_size(const bzn::uuid_t& uuid);
+
+        // write out the least recently used records until memory use is back within the budget...
+        void evict();
+
+        // write records held in memory to cold storage, creating them there unless already spilled... false if the
+        // records could not be written and are still dirty
+        bool spill(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& batch, bool spilled);
+
+        const std::shared_ptr<bzn::storage_base> cold_storage;
+        const size_t memory_budget;
+
+        std::unordered_map<bzn::uuid_t, hot_database> hot;
+        lru_list lru;
+        size_t memory_used = 0;
+
+        // key & byte counts over both tiers...
+        std::unordered_map<bzn::uuid_t, std::pair<std::size_t, std::size_t>> sizes;
+
+        std::mutex lock; // even reads reorder the lru list
+    };
+
+} // bzn
@@ -15,7 +15,9 @@
 #pragma once
 
 #include <include/bluzelle.hpp>
+#include <memory>
 #include <optional>
+#include <string_view>
 #include <vector>
 
 
@@ -24,6 +26,39 @@ namespace bzn
     const size_t MAX_KEY_SIZE   = 4096;
     const size_t MAX_VALUE_SIZE = 256000;
 
+    using key_value_t = std::pair<bzn::key_t, bzn::value_t>;
+
+    // a value that may still live in the storage engine's own buffers, valid while the owner is held (and the
+    // storage engine is open)...
+    struct value_view_t
+    {
+        std::string_view data;
+        std::shared_ptr<const void> owner;
+    };
+
+    // A read only view of every database as it was when the snapshot was taken. Reads through it never see later
+    // writes and don't hold up the writers, so a long scan and the reads that follow it agree with each other. Valid
+    // while the storage engine is open...
+    class storage_snapshot_base
+    {
+    public:
+        virtual ~storage_snapshot_base() = default;
+
+        virtual std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const bzn::key_t& key) = 0;
+
+        virtual bool has(const bzn::uuid_t& uuid, const bzn::key_t& key) = 0;
+
+        // as storage_base::get_keys and storage_base::get_range...
+        virtual std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) = 0;
+
+        virtual std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) = 0;
+
+        virtual std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) = 0;
+
+        virtual std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) = 0;
+    };
+
+
     class storage_base
     {
     public:
@@ -45,17 +80,135 @@ namespace bzn
 
         virtual std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) = 0;
 
+        // read without copying the value out of the storage engine when it can avoid it...
+        virtual std::optional<bzn::value_view_t> read_view(const bzn::uuid_t& uuid, const std::string& key)
+        {
+            auto value = this->read(uuid, key);
+
+            if (!value)
+            {
+                return std::nullopt;
+            }
+
+            auto owner = std::make_shared<const bzn::value_t>(std::move(*value));
+
+            return bzn::value_view_t{*owner, owner};
+        }
+
         virtual storage_base::result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) = 0;
 
         virtual storage_base::result remove(const bzn::uuid_t& uuid, const std::string& key) = 0;
 
         virtual std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid) = 0;
+
+        // keys in order, up to limit (0 for no limit) of them that start with prefix and sort after start_after...
+        virtual std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix) = 0;
         
         virtual bool has(const bzn::uuid_t& uuid, const  std::string& key) = 0;
 
+        // records with start <= key < end (no upper bound if end is empty) in key order, or from the top of the range
+        // when reversed, up to limit (0 for no limit) of them...
+        virtual std::vector<bzn::key_value_t> get_range(const bzn::uuid_t& uuid, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse) = 0;
+
         virtual std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) = 0;
 
         virtual storage_base::result remove(const bzn::uuid_t& uuid) = 0;
+
+        // batched operations are all or nothing: if any record fails the whole batch is rejected with its result...
+
+        virtual storage_base::result multi_create(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) = 0;
+
+        virtual std::vector<std::optional<bzn::value_t>> multi_read(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) = 0;
+
+        virtual storage_base::result multi_update(const bzn::uuid_t& uuid, const std::vector<bzn::key_value_t>& records) = 0;
+
+        virtual storage_base::result multi_remove(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) = 0;
+
+        // nullptr if the storage engine could not take one...
+        virtual std::shared_ptr<bzn::storage_snapshot_base> get_snapshot() = 0;
+
+        // the end of the range holding every key that starts with prefix, empty if there is no upper bound...
+        static bzn::key_t prefix_end(bzn::key_t prefix)
+        {
+            while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xff)
+            {
+                prefix.pop_back();
+            }
+
+            if (!prefix.empty())
+            {
+                prefix.back() = static_cast<char>(static_cast<unsigned char>(prefix.back()) + 1);
+            }
+
+            return prefix;
+        }
+
+    protected:
+
+        static storage_base::result check_sizes(const std::vector<bzn::key_value_t>& records, bool check_keys)
+        {
+            for (const auto& record : records)
+            {
+                if (record.second.size() > bzn::MAX_VALUE_SIZE)
+                {
+                    return storage_base::result::value_too_large;
+                }
+
+                if (check_keys && record.first.size() > bzn::MAX_KEY_SIZE)
+                {
+                    return storage_base::result::key_too_large;
+                }
+            }
+
+            return storage_base::result::ok;
+        }
+
+        // a page of keys from an ordered map...
+        template<typename T>
+        static std::vector<bzn::key_t> page_of_keys(const T& records, const bzn::key_t& start_after, size_t limit, const bzn::key_t& prefix)
+        {
+            std::vector<bzn::key_t> keys;
+
+            for (auto it = (prefix > start_after) ? records.lower_bound(prefix) : records.upper_bound(start_after);
+                it != records.end() && it->first.compare(0, prefix.size(), prefix) == 0 && (!limit || keys.size() < limit); ++it)
+            {
+                keys.emplace_back(it->first);
+            }
+
+            return keys;
+        }
+
+        // a range of records from an ordered map...
+        template<typename T>
+        static std::vector<bzn::key_value_t> range_of_records(const T& records, const bzn::key_t& start, const bzn::key_t& end, size_t limit, bool reverse)
+        {
+            std::vector<bzn::key_value_t> range;
+
+            if (!end.empty() && end <= start)
+            {
+                return range;
+            }
+
+            const auto first = records.lower_bound(start);
+            const auto last = end.empty() ? records.end() : records.lower_bound(end);
+
+            if (reverse)
+            {
+                for (auto it = last; it != first && (!limit || range.size() < limit);)
+                {
+                    range.emplace_back(*--it);
+                }
+            }
+            else
+            {
+                for (auto it = first; it != last && (!limit || range.size() < limit); ++it)
+                {
+                    range.emplace_back(*it);
+                }
+            }
+
+            return range;
+        }
     };
 
 } // bzn
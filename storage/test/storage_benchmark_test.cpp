@@ -0,0 +1,445 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/compressed_storage.hpp>
+#include <storage/mem_storage.hpp>
+#include <storage/rocksdb_storage.hpp>
+#include <storage/sharded_mem_storage.hpp>
+#include <gtest/gtest.h>
+#include <boost/format.hpp>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+
+using namespace ::testing;
+
+namespace
+{
+    const bzn::uuid_t NODE_UUID = "3f2b9e1c-8d2a-4c4e-9a51-0c1fb2d9a6e4";
+    const bzn::uuid_t SMALL_DB = "small-db";
+    const bzn::uuid_t LARGE_DB = "large-db";
+    const size_t SMALL_DB_KEYS = 100;
+    const size_t LARGE_DB_KEYS = 10000;
+    const size_t LOOKUPS = 20000;
+    const size_t MUTATIONS = 1000;
+    const size_t MAX_WRITERS = 16;
+    const size_t WRITES_PER_WRITER = 200;
+    const size_t LARGE_VALUE_SIZE = bzn::MAX_VALUE_SIZE;
+    const size_t LARGE_VALUE_KEYS = 16;
+    const size_t LARGE_VALUE_READS = 2000;
+    const size_t SMALL_RECORDS = 500000;
+    const size_t SMALL_RECORD_READS = 500000;
+    const size_t JSON_VALUES = 2000;
+    const size_t JSON_ITEMS = 40;
+    const size_t COMPRESSION_THRESHOLD = 1024;
+
+    template<class T>
+    std::shared_ptr<bzn::storage_base> create_storage()
+    {
+        return std::make_shared<T>();
+    }
+
+    template<>
+    std::shared_ptr<bzn::storage_base> create_storage<bzn::rocksdb_storage>()
+    {
+        return std::make_shared<bzn::rocksdb_storage>("./", NODE_UUID);
+    }
+
+    // rocksdb_storage with one column family per database...
+    struct rocksdb_cf_storage {};
+
+    template<>
+    std::shared_ptr<bzn::storage_base> create_storage<rocksdb_cf_storage>()
+    {
+        return std::make_shared<bzn::rocksdb_storage>("./", NODE_UUID, true);
+    }
+
+    // counts what a container asks of the heap, leaving out the allocator's own overhead...
+    size_t allocated_bytes = 0;
+
+    template<typename T>
+    struct counting_allocator
+    {
+        using value_type = T;
+
+        counting_allocator() = default;
+
+        template<typename U>
+        counting_allocator(const counting_allocator<U>&) {}
+
+        T* allocate(size_t n)
+        {
+            allocated_bytes += n * sizeof(T);
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            allocated_bytes -= n * sizeof(T);
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        template<typename U>
+        bool operator==(const counting_allocator<U>&) const { return true; }
+
+        template<typename U>
+        bool operator!=(const counting_allocator<U>&) const { return false; }
+    };
+
+    // how mem_storage used to hold a database...
+    using counted_string = std::basic_string<char, std::char_traits<char>, counting_allocator<char>>;
+
+    struct counted_less
+    {
+        using is_transparent = void;
+
+        bool operator()(std::string_view lhs, std::string_view rhs) const { return lhs < rhs; }
+    };
+
+    using counted_map = std::map<counted_string, counted_string, counted_less, counting_allocator<std::pair<const counted_string, counted_string>>>;
+
+    // a document of the shape clients store, repeated field names around varied values...
+    std::string
+    json_document(size_t id, std::mt19937& gen)
+    {
+        std::uniform_int_distribution<size_t> number(0, 99999);
+
+        auto document = boost::str(boost::format(R"({"id":%d,"owner":"user-%05d","items":[)") % id % number(gen));
+
+        for (size_t i = 0; i < JSON_ITEMS; ++i)
+        {
+            document += boost::str(boost::format(R"(%s{"sku":"SKU-%06d","name":"item %d","price":%d.%02d,"tags":["bulk","retail"],"in_stock":%s})")
+                % (i ? "," : "") % number(gen) % number(gen) % (number(gen) % 1000) % (number(gen) % 100)
+                % ((number(gen) % 2) ? "true" : "false"));
+        }
+
+        return document + "]}";
+    }
+
+
+    template<typename F>
+    double
+    average_ns(size_t iterations, F&& f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            f(i);
+        }
+
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+    }
+}
+
+
+template<typename T>
+class storage_benchmark_test : public Test
+{
+public:
+    storage_benchmark_test()
+    {
+        system(std::string("rm -r -f " + NODE_UUID).c_str());
+        this->storage = create_storage<T>();
+    }
+
+    ~storage_benchmark_test()
+    {
+        this->storage.reset();
+        system(std::string("rm -r -f " + NODE_UUID).c_str());
+    }
+
+    void populate(const bzn::uuid_t& uuid, size_t keys)
+    {
+        for (size_t i = 0; i < keys; ++i)
+        {
+            this->storage->create(uuid, "key-" + std::to_string(i), "value");
+        }
+    }
+
+    std::shared_ptr<bzn::storage_base> storage;
+};
+
+using Implementations = Types<bzn::mem_storage, bzn::sharded_mem_storage, bzn::rocksdb_storage, rocksdb_cf_storage>;
+
+TYPED_TEST_CASE(storage_benchmark_test, Implementations);
+
+
+TYPED_TEST(storage_benchmark_test, test_has_latency_does_not_grow_with_database_size)
+{
+    this->populate(SMALL_DB, SMALL_DB_KEYS);
+    this->populate(LARGE_DB, LARGE_DB_KEYS);
+
+    const auto lookup = [this](const bzn::uuid_t& uuid, size_t keys)
+    {
+        return average_ns(LOOKUPS, [&](size_t i)
+        {
+            // alternate between hits and misses...
+            EXPECT_EQ(i % 2 == 0, this->storage->has(uuid, (i % 2 ? "missing-" : "key-") + std::to_string(i % keys)));
+        });
+    };
+
+    const auto small_ns = lookup(SMALL_DB, SMALL_DB_KEYS);
+    const auto large_ns = lookup(LARGE_DB, LARGE_DB_KEYS);
+
+    std::cout << "[          ] has(): " << SMALL_DB_KEYS << " keys: " << size_t(small_ns) << " ns, "
+              << LARGE_DB_KEYS << " keys: " << size_t(large_ns) << " ns" << std::endl;
+
+    // a scan would be ~100x slower on the large database, allow plenty of headroom for noisy machines...
+    EXPECT_LT(large_ns, small_ns * 10);
+}
+
+
+TYPED_TEST(storage_benchmark_test, test_remove_database_latency)
+{
+    this->populate(LARGE_DB, LARGE_DB_KEYS);
+
+    const auto elapsed_ns = average_ns(1, [this](size_t)
+    {
+        EXPECT_EQ(bzn::storage_base::result::ok, this->storage->remove(LARGE_DB));
+    });
+
+    std::cout << "[          ] remove(uuid): " << LARGE_DB_KEYS << " keys: " << size_t(elapsed_ns / 1000) << " us" << std::endl;
+
+    EXPECT_TRUE(this->storage->get_keys(LARGE_DB).empty());
+}
+
+
+TYPED_TEST(storage_benchmark_test, test_mutation_latency)
+{
+    // each mutation checks for the key with a single lookup under the write lock...
+    this->populate(LARGE_DB, LARGE_DB_KEYS);
+
+    const auto key = [](size_t i) { return "key-" + std::to_string(i * (LARGE_DB_KEYS / MUTATIONS)); };
+
+    const auto rejected_create_ns = average_ns(MUTATIONS, [&](size_t i)
+    {
+        EXPECT_EQ(bzn::storage_base::result::exists, this->storage->create(LARGE_DB, key(i), "value"));
+    });
+
+    const auto rejected_update_ns = average_ns(MUTATIONS, [&](size_t i)
+    {
+        EXPECT_EQ(bzn::storage_base::result::not_found, this->storage->update(LARGE_DB, "missing-" + std::to_string(i), "value"));
+    });
+
+    const auto create_ns = average_ns(MUTATIONS, [&](size_t i)
+    {
+        EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(LARGE_DB, "new-" + std::to_string(i), "value"));
+    });
+
+    const auto update_ns = average_ns(MUTATIONS, [&](size_t i)
+    {
+        EXPECT_EQ(bzn::storage_base::result::ok, this->storage->update(LARGE_DB, key(i), "new-value"));
+    });
+
+    const auto remove_ns = average_ns(MUTATIONS, [&](size_t i)
+    {
+        EXPECT_EQ(bzn::storage_base::result::ok, this->storage->remove(LARGE_DB, key(i)));
+    });
+
+    std::cout << "[          ] create: " << size_t(create_ns) << " ns, update: " << size_t(update_ns)
+              << " ns, remove: " << size_t(remove_ns) << " ns, rejected create: " << size_t(rejected_create_ns)
+              << " ns, rejected update: " << size_t(rejected_update_ns) << " ns" << std::endl;
+
+    // the removes took out the updated keys, net of the creates nothing changed...
+    EXPECT_EQ(std::make_pair(LARGE_DB_KEYS, LARGE_DB_KEYS * 5), this->storage->get_size(LARGE_DB));
+}
+
+
+TYPED_TEST(storage_benchmark_test, test_concurrent_writer_throughput)
+{
+    // every rocksdb write is synced, so with group commit throughput should climb with the number of writers...
+    for (size_t writers = 1; writers <= MAX_WRITERS; writers *= 2)
+    {
+        const bzn::uuid_t uuid = "writers-" + std::to_string(writers);
+        std::vector<std::thread> threads;
+
+        const auto elapsed_ns = average_ns(1, [&](size_t)
+        {
+            for (size_t w = 0; w < writers; ++w)
+            {
+                threads.emplace_back([this, &uuid, w]
+                {
+                    for (size_t i = 0; i < WRITES_PER_WRITER; ++i)
+                    {
+                        EXPECT_EQ(bzn::storage_base::result::ok,
+                            this->storage->create(uuid, std::to_string(w) + "-" + std::to_string(i), "value"));
+                    }
+                });
+            }
+
+            for (auto& t : threads)
+            {
+                t.join();
+            }
+        });
+
+        std::cout << "[          ] " << writers << " writer(s): "
+                  << size_t(writers * WRITES_PER_WRITER / (elapsed_ns / 1e9)) << " writes/sec" << std::endl;
+
+        EXPECT_EQ(std::make_pair(writers * WRITES_PER_WRITER, writers * WRITES_PER_WRITER * 5), this->storage->get_size(uuid));
+    }
+}
+
+
+TYPED_TEST(storage_benchmark_test, test_large_value_read_throughput)
+{
+    const bzn::value_t value(LARGE_VALUE_SIZE, 'x');
+
+    for (size_t i = 0; i < LARGE_VALUE_KEYS; ++i)
+    {
+        ASSERT_EQ(bzn::storage_base::result::ok, this->storage->create(LARGE_DB, "key-" + std::to_string(i), value));
+    }
+
+    const auto key = [](size_t i) { return "key-" + std::to_string(i % LARGE_VALUE_KEYS); };
+
+    size_t bytes = 0;
+
+    const auto read_ns = average_ns(LARGE_VALUE_READS, [&](size_t i)
+    {
+        bytes += this->storage->read(LARGE_DB, key(i))->size();
+    });
+
+    const auto read_view_ns = average_ns(LARGE_VALUE_READS, [&](size_t i)
+    {
+        // hold the view for as long as a send would...
+        const auto view = this->storage->read_view(LARGE_DB, key(i));
+        bytes += view->data.size();
+    });
+
+    const auto mb_per_sec = [](double ns) { return size_t(LARGE_VALUE_SIZE / ns * 1e9 / (1024 * 1024)); };
+
+    std::cout << "[          ] " << LARGE_VALUE_SIZE << " byte values, read: " << mb_per_sec(read_ns)
+              << " MB/s, read_view: " << mb_per_sec(read_view_ns) << " MB/s" << std::endl;
+
+    EXPECT_EQ(LARGE_VALUE_SIZE * LARGE_VALUE_READS * 2, bytes);
+}
+
+
+TEST(mem_storage_benchmark, test_small_record_memory_use_and_read_latency)
+{
+    // keys and values of the sizes used for counters, flags and indexes...
+    const auto key = [](size_t i) { return boost::str(boost::format("key-%012d") % i); };
+    const bzn::value_t value(24, 'v');
+
+    bzn::mem_storage storage;
+    counted_map baseline;
+
+    for (size_t i = 0; i < SMALL_RECORDS; ++i)
+    {
+        ASSERT_EQ(bzn::storage_base::result::ok, storage.create(LARGE_DB, key(i), value));
+
+        const auto k = key(i);
+        baseline.emplace(counted_string(k.begin(), k.end()), counted_string(value.begin(), value.end()));
+    }
+
+    const double bytes_per_record = double(storage.get_memory_used()) / SMALL_RECORDS;
+    const double baseline_bytes_per_record = double(allocated_bytes) / SMALL_RECORDS;
+
+    std::mt19937 gen;
+    std::vector<bzn::key_t> keys;
+
+    for (size_t i = 0; i < SMALL_RECORD_READS; ++i)
+    {
+        keys.emplace_back(key(std::uniform_int_distribution<size_t>(0, SMALL_RECORDS - 1)(gen)));
+    }
+
+    size_t found = 0;
+
+    const auto read_ns = average_ns(SMALL_RECORD_READS, [&](size_t i)
+    {
+        found += storage.read(LARGE_DB, keys[i]).has_value();
+    });
+
+    const auto baseline_read_ns = average_ns(SMALL_RECORD_READS, [&](size_t i)
+    {
+        found += baseline.count(std::string_view(keys[i]));
+    });
+
+    std::cout << "[          ] " << SMALL_RECORDS << " records of " << key(0).size() + value.size() << " bytes, mem_storage: "
+              << size_t(bytes_per_record) << " bytes/record " << size_t(read_ns) << " ns/read, std::map: "
+              << size_t(baseline_bytes_per_record) << " bytes/record " << size_t(baseline_read_ns) << " ns/read" << std::endl;
+
+    EXPECT_EQ(SMALL_RECORD_READS * 2, found);
+    EXPECT_LT(bytes_per_record, baseline_bytes_per_record);
+}
+
+
+TEST(compressed_storage_benchmark, test_compressible_json_throughput_and_bytes_written)
+{
+    std::mt19937 gen;
+    std::vector<bzn::value_t> documents;
+    size_t document_bytes = 0;
+
+    for (size_t i = 0; i < JSON_VALUES; ++i)
+    {
+        documents.emplace_back(json_document(i, gen));
+        document_bytes += documents.back().size();
+    }
+
+    const auto key = [](size_t i) { return "doc-" + std::to_string(i); };
+    const auto mb_per_sec = [&](double ns) { return size_t(document_bytes / JSON_VALUES / ns * 1e9 / (1024 * 1024)); };
+
+    // write and read every document, returning the bytes the storage engine ended up holding...
+    const auto run = [&](const std::string& name, bzn::storage_base& storage, bzn::storage_base& engine)
+    {
+        const auto write_ns = average_ns(JSON_VALUES, [&](size_t i)
+        {
+            EXPECT_EQ(bzn::storage_base::result::ok, storage.create(LARGE_DB, key(i), documents[i]));
+        });
+
+        size_t matched = 0;
+
+        const auto read_ns = average_ns(JSON_VALUES, [&](size_t i)
+        {
+            matched += (storage.read(LARGE_DB, key(i)) == documents[i]);
+        });
+
+        EXPECT_EQ(JSON_VALUES, matched);
+
+        const auto written = engine.get_size(LARGE_DB).second;
+
+        std::cout << "[          ] " << name << ": write: " << mb_per_sec(write_ns) << " MB/s, read: " << mb_per_sec(read_ns)
+                  << " MB/s, " << written << " bytes written" << std::endl;
+
+        return written;
+    };
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    size_t plain_bytes;
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID);
+        plain_bytes = run("rocksdb_storage", storage, storage);
+    }
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    size_t compressed_bytes;
+    {
+        auto engine = std::make_shared<bzn::rocksdb_storage>("./", NODE_UUID);
+        bzn::compressed_storage storage(engine, COMPRESSION_THRESHOLD);
+        compressed_bytes = run("compressed_storage", storage, *engine);
+    }
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    std::cout << "[          ] " << JSON_VALUES << " json documents of " << document_bytes / JSON_VALUES << " bytes, compressed to "
+              << size_t(100.0 * compressed_bytes / plain_bytes) << "% of the bytes written" << std::endl;
+
+    EXPECT_EQ(document_bytes, plain_bytes);
+    EXPECT_LT(compressed_bytes * 2, plain_bytes);
+}
@@ -0,0 +1,249 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/mem_storage.hpp>
+#include <storage/rocksdb_storage.hpp>
+#include <storage/sharded_mem_storage.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace ::testing;
+
+namespace
+{
+    const size_t OPS_PER_THREAD = 20000;
+    const size_t KEYS_PER_DB = 1000;
+    const std::string VALUE(64, 'v');
+    const bzn::uuid_t NODE_UUID = "9c1d4e2a-6b7f-4a8e-8f3d-2e5b7c9a0d16";
+    const size_t READS_PER_READER = 20000;
+
+    size_t
+    worker_count()
+    {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    template<class T>
+    std::shared_ptr<bzn::storage_base> create_storage()
+    {
+        return std::make_shared<T>();
+    }
+}
+
+
+template<typename T>
+class storage_concurrency_test : public Test
+{
+public:
+    // each worker owns one database and issues 1 write for every 4 reads against it, which is what a busy node with
+    // one client per database looks like from the storage engine's point of view...
+    double run_mixed_workload(size_t threads)
+    {
+        this->storage = create_storage<T>();
+
+        for (size_t t = 0; t < threads; ++t)
+        {
+            for (size_t k = 0; k < KEYS_PER_DB; ++k)
+            {
+                this->storage->create("db-" + std::to_string(t), "key-" + std::to_string(k), VALUE);
+            }
+        }
+
+        std::atomic<size_t> failures{};
+        std::vector<std::thread> workers;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([this, t, &failures]
+            {
+                const bzn::uuid_t uuid = "db-" + std::to_string(t);
+
+                for (size_t i = 0; i < OPS_PER_THREAD; ++i)
+                {
+                    const bzn::key_t key = "key-" + std::to_string(i % KEYS_PER_DB);
+
+                    if (i % 5 == 0)
+                    {
+                        if (this->storage->update(uuid, key, VALUE) != bzn::storage_base::result::ok)
+                        {
+                            ++failures;
+                        }
+                    }
+                    else if (!this->storage->read(uuid, key))
+                    {
+                        ++failures;
+                    }
+                }
+            });
+        }
+
+        for (auto& t : workers)
+        {
+            t.join();
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        EXPECT_EQ(size_t(0), failures.load());
+
+        for (size_t t = 0; t < threads; ++t)
+        {
+            EXPECT_EQ(KEYS_PER_DB, this->storage->get_size("db-" + std::to_string(t)).first);
+        }
+
+        return (threads * OPS_PER_THREAD) / elapsed.count();
+    }
+
+    std::shared_ptr<bzn::storage_base> storage;
+};
+
+using Implementations = Types<bzn::mem_storage, bzn::sharded_mem_storage>;
+
+TYPED_TEST_CASE(storage_concurrency_test, Implementations);
+
+
+TYPED_TEST(storage_concurrency_test, test_mixed_read_write_throughput_scales_with_worker_threads)
+{
+    for (size_t threads = 1; threads <= worker_count(); threads *= 2)
+    {
+        const auto ops_per_sec = this->run_mixed_workload(threads);
+
+        std::cout << "[          ] " << threads << " thread(s): " << size_t(ops_per_sec) << " ops/sec" << std::endl;
+    }
+}
+
+
+TYPED_TEST(storage_concurrency_test, test_concurrent_creates_into_same_database_are_all_stored)
+{
+    this->storage = create_storage<TypeParam>();
+
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < worker_count(); ++t)
+    {
+        workers.emplace_back([this, t]
+        {
+            for (size_t k = 0; k < KEYS_PER_DB; ++k)
+            {
+                EXPECT_EQ(bzn::storage_base::result::ok,
+                    this->storage->create("shared-db", std::to_string(t) + "-" + std::to_string(k), VALUE));
+            }
+        });
+    }
+
+    for (auto& t : workers)
+    {
+        t.join();
+    }
+
+    EXPECT_EQ(worker_count() * KEYS_PER_DB, this->storage->get_keys("shared-db").size());
+    EXPECT_EQ(worker_count() * KEYS_PER_DB * VALUE.size(), this->storage->get_size("shared-db").second);
+}
+
+
+TEST(rocksdb_storage_concurrency, test_reads_do_not_wait_for_synced_writes)
+{
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    auto storage = std::make_shared<bzn::rocksdb_storage>("./", NODE_UUID);
+
+    for (size_t k = 0; k < KEYS_PER_DB; ++k)
+    {
+        storage->create("read-db", "key-" + std::to_string(k), VALUE);
+    }
+
+    // half the threads read while the other half keep rocksdb busy with synced writes, writers restart numbering
+    // their keys each run so use a fresh database per run...
+    size_t run = 0;
+
+    const auto read_latency = [&](size_t readers, size_t writers)
+    {
+        std::atomic<bool> reading{true};
+        std::atomic<size_t> failures{};
+        std::atomic<size_t> writes{};
+        std::vector<std::thread> threads;
+
+        ++run;
+
+        for (size_t w = 0; w < writers; ++w)
+        {
+            threads.emplace_back([&, w]
+            {
+                const bzn::uuid_t uuid = "write-db-" + std::to_string(run) + "-" + std::to_string(w);
+
+                for (size_t i = 0; reading; ++i, ++writes)
+                {
+                    EXPECT_EQ(bzn::storage_base::result::ok, storage->create(uuid, "key-" + std::to_string(i), VALUE));
+                }
+            });
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> reader_threads;
+
+        for (size_t r = 0; r < readers; ++r)
+        {
+            reader_threads.emplace_back([&]
+            {
+                for (size_t i = 0; i < READS_PER_READER; ++i)
+                {
+                    if (!storage->read("read-db", "key-" + std::to_string(i % KEYS_PER_DB)))
+                    {
+                        ++failures;
+                    }
+                }
+            });
+        }
+
+        for (auto& t : reader_threads)
+        {
+            t.join();
+        }
+
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        reading = false;
+
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+
+        EXPECT_EQ(size_t(0), failures.load());
+
+        return std::make_pair(elapsed.count() / READS_PER_READER, writes.load());
+    };
+
+    const size_t readers = std::max(worker_count() / 2, size_t(1));
+    const size_t writers = std::max(worker_count() - readers, size_t(1));
+
+    const auto idle = read_latency(readers, 0);
+    const auto busy = read_latency(readers, writers);
+
+    std::cout << "[          ] " << readers << " reader(s): " << size_t(idle.first) << " ns/read idle, "
+              << size_t(busy.first) << " ns/read alongside " << writers << " writer(s) (" << busy.second
+              << " synced writes)" << std::endl;
+
+    // a read stuck behind an fsync would cost milliseconds...
+    EXPECT_LT(busy.first, 100000.0);
+
+    storage.reset();
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
@@ -12,14 +12,20 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
+#include <storage/cached_storage.hpp>
+#include <storage/compressed_storage.hpp>
 #include <storage/mem_storage.hpp>
+#include <storage/mem_table.hpp>
 #include <storage/rocksdb_storage.hpp>
+#include <storage/sharded_mem_storage.hpp>
+#include <storage/spilling_mem_storage.hpp>
 #include <mocks/mock_node_base.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <cstdlib>
+#include <limits>
 
 using namespace ::testing;
 
@@ -58,11 +64,46 @@ namespace
         return std::make_shared<bzn::mem_storage>();
     }
 
+    template<>
+    std::shared_ptr<bzn::storage_base> create_storage<bzn::sharded_mem_storage>()
+    {
+        return std::make_shared<bzn::sharded_mem_storage>();
+    }
+
     template<>
     std::shared_ptr<bzn::storage_base> create_storage<bzn::rocksdb_storage>()
     {
         return std::make_shared<bzn::rocksdb_storage>("./", NODE_UUID);
     }
+
+    template<>
+    std::shared_ptr<bzn::storage_base> create_storage<bzn::cached_storage>()
+    {
+        return std::make_shared<bzn::cached_storage>(std::make_shared<bzn::mem_storage>(), 64 * 1024);
+    }
+
+    // the test values stay below the threshold so the sizes reported are unchanged, compression is tested below...
+    template<>
+    std::shared_ptr<bzn::storage_base> create_storage<bzn::compressed_storage>()
+    {
+        return std::make_shared<bzn::compressed_storage>(std::make_shared<bzn::mem_storage>(), 1024);
+    }
+
+    // a budget of a couple of records, so nearly every operation spills or reloads records...
+    template<>
+    std::shared_ptr<bzn::storage_base> create_storage<bzn::spilling_mem_storage>()
+    {
+        return std::make_shared<bzn::spilling_mem_storage>(std::make_shared<bzn::mem_storage>(), 256);
+    }
+
+    // rocksdb_storage with one column family per database...
+    struct rocksdb_cf_storage {};
+
+    template<>
+    std::shared_ptr<bzn::storage_base> create_storage<rocksdb_cf_storage>()
+    {
+        return std::make_shared<bzn::rocksdb_storage>("./", NODE_UUID, true);
+    }
 }
 
 
@@ -87,7 +128,7 @@ public:
     std::shared_ptr<bzn::storage_base> storage;
 };
 
-using Implementations = Types<bzn::mem_storage, bzn::rocksdb_storage>;
+using Implementations = Types<bzn::mem_storage, bzn::sharded_mem_storage, bzn::spilling_mem_storage, bzn::cached_storage, bzn::compressed_storage, bzn::rocksdb_storage, rocksdb_cf_storage>;
 
 TYPED_TEST_CASE(storageTest, Implementations);
 
@@ -124,6 +165,23 @@ TYPED_TEST(storageTest, test_that_attempting_to_read_a_record_from_storage_that_
 }
 
 
+TYPED_TEST(storageTest, test_read_view_stays_valid_while_held)
+{
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(USER_UUID, KEY, value));
+
+    auto view = this->storage->read_view(USER_UUID, KEY);
+    ASSERT_TRUE(view);
+
+    // changing the record doesn't pull the value out from under the view...
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->update(USER_UUID, KEY, "new value"));
+    EXPECT_EQ(value, std::string(view->data));
+
+    EXPECT_EQ("new value", std::string(this->storage->read_view(USER_UUID, KEY)->data));
+    EXPECT_FALSE(this->storage->read_view(USER_UUID, "nokey"));
+    EXPECT_FALSE(this->storage->read_view("nodb", KEY));
+}
+
+
 TYPED_TEST(storageTest, test_that_storage_can_update_an_existing_record)
 {
     const std::string updated_value = "I have changed the value of the text";
@@ -264,3 +322,518 @@ TYPED_TEST(storageTest, test_that_storage_can_remove_all_keys_values_associated_
     EXPECT_EQ(bzn::storage_base::result::ok, this->storage->remove(USER_UUID));
     EXPECT_EQ(std::nullopt, this->storage->read(USER_UUID, KEY));
 }
+
+
+TYPED_TEST(storageTest, test_get_size_tracks_creates_updates_and_removes)
+{
+    EXPECT_EQ(std::make_pair(size_t(0), size_t(0)), this->storage->get_size(USER_UUID));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(USER_UUID, "key1", "12345"));
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(USER_UUID, "key2", "123"));
+    EXPECT_EQ(bzn::storage_base::result::exists, this->storage->create(USER_UUID, "key2", "123456789"));
+    EXPECT_EQ(std::make_pair(size_t(2), size_t(8)), this->storage->get_size(USER_UUID));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->update(USER_UUID, "key1", "1"));
+    EXPECT_EQ(bzn::storage_base::result::not_found, this->storage->update(USER_UUID, "key3", "123"));
+    EXPECT_EQ(std::make_pair(size_t(2), size_t(4)), this->storage->get_size(USER_UUID));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->remove(USER_UUID, "key2"));
+    EXPECT_EQ(bzn::storage_base::result::not_found, this->storage->remove(USER_UUID, "key2"));
+    EXPECT_EQ(std::make_pair(size_t(1), size_t(1)), this->storage->get_size(USER_UUID));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->remove(USER_UUID));
+    EXPECT_EQ(std::make_pair(size_t(0), size_t(0)), this->storage->get_size(USER_UUID));
+}
+
+
+TYPED_TEST(storageTest, test_get_keys_pages_through_keys_in_order)
+{
+    for (const auto& key : {"b2", "a1", "b3", "c1", "b1", "b"})
+    {
+        EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(USER_UUID, key, "value"));
+    }
+
+    using keys_t = std::vector<bzn::key_t>;
+
+    EXPECT_EQ(keys_t({"a1", "b", "b1", "b2", "b3", "c1"}), this->storage->get_keys(USER_UUID, "", 0, ""));
+    EXPECT_EQ(keys_t({"a1", "b"}), this->storage->get_keys(USER_UUID, "", 2, ""));
+    EXPECT_EQ(keys_t({"b1", "b2"}), this->storage->get_keys(USER_UUID, "b", 2, ""));
+    EXPECT_EQ(keys_t({"c1"}), this->storage->get_keys(USER_UUID, "b3", 2, ""));
+    EXPECT_EQ(keys_t(), this->storage->get_keys(USER_UUID, "c1", 2, ""));
+
+    // prefix filtering, with the cursor before, inside and after the prefix...
+    EXPECT_EQ(keys_t({"b", "b1", "b2", "b3"}), this->storage->get_keys(USER_UUID, "", 0, "b"));
+    EXPECT_EQ(keys_t({"b", "b1"}), this->storage->get_keys(USER_UUID, "a1", 2, "b"));
+    EXPECT_EQ(keys_t({"b2", "b3"}), this->storage->get_keys(USER_UUID, "b1", 0, "b"));
+    EXPECT_EQ(keys_t(), this->storage->get_keys(USER_UUID, "b3", 0, "b"));
+    EXPECT_EQ(keys_t(), this->storage->get_keys(USER_UUID, "", 0, "d"));
+
+    EXPECT_EQ(keys_t(), this->storage->get_keys("unknown-uuid", "", 0, ""));
+}
+
+
+TYPED_TEST(storageTest, test_get_range_returns_records_in_order)
+{
+    for (const auto& key : {"t:03", "t:01", "u:01", "t:02", "s:09"})
+    {
+        EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(USER_UUID, key, std::string("v") + key));
+    }
+
+    using range_t = std::vector<bzn::key_value_t>;
+
+    EXPECT_EQ(range_t({{"t:01", "vt:01"}, {"t:02", "vt:02"}}), this->storage->get_range(USER_UUID, "t:01", "t:03", 0, false));
+    EXPECT_EQ(range_t({{"t:02", "vt:02"}, {"t:01", "vt:01"}}), this->storage->get_range(USER_UUID, "t:01", "t:03", 0, true));
+    EXPECT_EQ(range_t({{"t:01", "vt:01"}}), this->storage->get_range(USER_UUID, "t", "t:03", 1, false));
+    EXPECT_EQ(range_t({{"u:01", "vu:01"}, {"t:03", "vt:03"}}), this->storage->get_range(USER_UUID, "t:03", "", 0, true));
+    EXPECT_EQ(range_t({{"u:01", "vu:01"}}), this->storage->get_range(USER_UUID, "", "", 1, true));
+    EXPECT_EQ(range_t({{"s:09", "vs:09"}}), this->storage->get_range(USER_UUID, "", "", 1, false));
+    EXPECT_EQ(5u, this->storage->get_range(USER_UUID, "", "", 0, false).size());
+
+    // empty and inverted ranges...
+    EXPECT_EQ(range_t(), this->storage->get_range(USER_UUID, "t:02", "t:02", 0, false));
+    EXPECT_EQ(range_t(), this->storage->get_range(USER_UUID, "t:03", "t:01", 0, true));
+    EXPECT_EQ(range_t(), this->storage->get_range(USER_UUID, "v", "", 0, true));
+    EXPECT_EQ(range_t(), this->storage->get_range("unknown-uuid", "", "", 0, false));
+
+    // prefix queries...
+    EXPECT_EQ(range_t({{"t:03", "vt:03"}, {"t:02", "vt:02"}, {"t:01", "vt:01"}}),
+        this->storage->get_range(USER_UUID, "t:", bzn::storage_base::prefix_end("t:"), 0, true));
+    EXPECT_EQ(bzn::key_t("t;"), bzn::storage_base::prefix_end("t:"));
+    EXPECT_EQ(bzn::key_t("u"), bzn::storage_base::prefix_end("t\xff\xff"));
+    EXPECT_EQ(bzn::key_t(), bzn::storage_base::prefix_end("\xff"));
+}
+
+
+TYPED_TEST(storageTest, test_multi_operations_are_all_or_nothing)
+{
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->multi_create(USER_UUID, {{"key1", "1"}, {"key2", "22"}}));
+
+    // one existing or repeated key fails the whole batch...
+    EXPECT_EQ(bzn::storage_base::result::exists, this->storage->multi_create(USER_UUID, {{"key3", "333"}, {"key1", "1"}}));
+    EXPECT_EQ(bzn::storage_base::result::exists, this->storage->multi_create(USER_UUID, {{"key3", "333"}, {"key3", "333"}}));
+    EXPECT_EQ(bzn::storage_base::result::key_too_large,
+        this->storage->multi_create(USER_UUID, {{"key3", "333"}, {std::string(bzn::MAX_KEY_SIZE + 1, 'k'), "1"}}));
+    EXPECT_FALSE(this->storage->has(USER_UUID, "key3"));
+    EXPECT_EQ(std::make_pair(size_t(2), size_t(3)), this->storage->get_size(USER_UUID));
+
+    EXPECT_EQ(bzn::storage_base::result::not_found, this->storage->multi_update(USER_UUID, {{"key1", "1111"}, {"key3", "3"}}));
+    EXPECT_EQ(bzn::storage_base::result::value_too_large,
+        this->storage->multi_update(USER_UUID, {{"key1", "1111"}, {"key2", std::string(bzn::MAX_VALUE_SIZE + 1, 'v')}}));
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->multi_update(USER_UUID, {{"key1", "1111"}, {"key2", "2"}}));
+    EXPECT_EQ(std::make_pair(size_t(2), size_t(5)), this->storage->get_size(USER_UUID));
+
+    const auto values = this->storage->multi_read(USER_UUID, {"key1", "key3", "key2"});
+    ASSERT_EQ(size_t(3), values.size());
+    EXPECT_EQ(bzn::value_t("1111"), values[0]);
+    EXPECT_FALSE(values[1]);
+    EXPECT_EQ(bzn::value_t("2"), values[2]);
+
+    EXPECT_EQ(bzn::storage_base::result::not_found, this->storage->multi_remove(USER_UUID, {"key1", "key3"}));
+    EXPECT_EQ(bzn::storage_base::result::not_found, this->storage->multi_remove(USER_UUID, {"key1", "key1"}));
+    EXPECT_TRUE(this->storage->has(USER_UUID, "key1"));
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->multi_remove(USER_UUID, {"key1", "key2"}));
+    EXPECT_TRUE(this->storage->get_keys(USER_UUID).empty());
+    EXPECT_EQ(std::make_pair(size_t(0), size_t(0)), this->storage->get_size(USER_UUID));
+}
+
+
+TYPED_TEST(storageTest, test_that_a_snapshot_does_not_see_later_writes)
+{
+    const bzn::uuid_t OTHER_UUID{"other-uuid"};
+
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->multi_create(USER_UUID, {{"key1", "1"}, {"key2", "22"}, {"key3", "333"}}));
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(OTHER_UUID, "key", "value"));
+
+    auto snapshot = this->storage->get_snapshot();
+    ASSERT_TRUE(snapshot);
+
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->update(USER_UUID, "key1", "1111"));
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->remove(USER_UUID, "key2"));
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->create(USER_UUID, "key4", "4444"));
+    EXPECT_EQ(bzn::storage_base::result::ok, this->storage->remove(OTHER_UUID));
+
+    // the snapshot is as it was...
+    EXPECT_EQ(bzn::value_t("1"), snapshot->read(USER_UUID, "key1"));
+    EXPECT_TRUE(snapshot->has(USER_UUID, "key2"));
+    EXPECT_FALSE(snapshot->has(USER_UUID, "key4"));
+    EXPECT_EQ(std::vector<bzn::key_t>({"key1", "key2", "key3"}), snapshot->get_keys(USER_UUID, "", 0, ""));
+    EXPECT_EQ(std::vector<bzn::key_t>({"key2"}), snapshot->get_keys(USER_UUID, "key1", 1, ""));
+    EXPECT_EQ(std::vector<bzn::key_value_t>({{"key3", "333"}, {"key2", "22"}}), snapshot->get_range(USER_UUID, "key2", "", 0, true));
+    EXPECT_EQ(std::make_pair(size_t(3), size_t(6)), snapshot->get_size(USER_UUID));
+    EXPECT_EQ(bzn::value_t("value"), snapshot->read(OTHER_UUID, "key"));
+
+    const auto values = snapshot->multi_read(USER_UUID, {"key2", "key4"});
+    ASSERT_EQ(size_t(2), values.size());
+    EXPECT_EQ(bzn::value_t("22"), values[0]);
+    EXPECT_FALSE(values[1]);
+
+    EXPECT_FALSE(snapshot->read("unknown-uuid", "key"));
+    EXPECT_TRUE(snapshot->get_keys("unknown-uuid", "", 0, "").empty());
+
+    // while the storage moved on...
+    EXPECT_EQ(bzn::value_t("1111"), this->storage->read(USER_UUID, "key1"));
+    EXPECT_EQ(std::vector<bzn::key_t>({"key1", "key3", "key4"}), this->storage->get_keys(USER_UUID));
+    EXPECT_EQ(std::make_pair(size_t(3), size_t(11)), this->storage->get_size(USER_UUID));
+    EXPECT_FALSE(this->storage->has(OTHER_UUID, "key"));
+
+    // and a new snapshot sees where it is now...
+    snapshot = this->storage->get_snapshot();
+    ASSERT_TRUE(snapshot);
+    EXPECT_EQ(bzn::value_t("4444"), snapshot->read(USER_UUID, "key4"));
+    EXPECT_FALSE(snapshot->has(OTHER_UUID, "key"));
+}
+
+
+TEST(rocksdb_storage, test_that_database_sizes_are_persisted)
+{
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID);
+
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.create(USER_UUID, "key1", "12345"));
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.create(USER_UUID, "key2", "123"));
+    }
+
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID);
+
+        EXPECT_EQ(std::make_pair(size_t(2), size_t(8)), storage.get_size(USER_UUID));
+    }
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
+
+
+TEST(rocksdb_storage, test_that_tuning_is_applied_and_statistics_reported)
+{
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    bzn::rocksdb_tuning tuning;
+    tuning.compression = {"bogus"};
+
+    EXPECT_THROW(bzn::rocksdb_storage("./", NODE_UUID, false, tuning), std::runtime_error);
+
+    tuning.block_cache_size = 0;
+    tuning.bloom_filter_bits_per_key = 0;
+    tuning.compression = {"none", "none", "snappy"};
+    tuning.statistics = true;
+
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID, true, tuning);
+
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.create(USER_UUID, "key1", "value1"));
+        EXPECT_EQ("value1", *storage.read(USER_UUID, "key1"));
+
+        const auto status = storage.get_status();
+        EXPECT_EQ("rocksdb", storage.get_name());
+        EXPECT_TRUE(status.isMember("cur-size-all-mem-tables"));
+        EXPECT_TRUE(status["statistics"].isMember("block-cache-miss"));
+        EXPECT_TRUE(status["statistics"].isMember("bytes-written"));
+    }
+
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID, true);
+
+        EXPECT_EQ("value1", *storage.read(USER_UUID, "key1"));
+        EXPECT_FALSE(storage.get_status().isMember("statistics"));
+    }
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
+
+
+TEST(rocksdb_storage, test_that_column_family_per_database_layout_survives_restart_and_drops_databases)
+{
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID, true);
+
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.create(USER_UUID, "key1", "value1"));
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.create(NODE_UUID, "key1", "value2"));
+    }
+
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID, true);
+
+        EXPECT_EQ("value1", *storage.read(USER_UUID, "key1"));
+        EXPECT_EQ("value2", *storage.read(NODE_UUID, "key1"));
+
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.remove(USER_UUID));
+        EXPECT_EQ(bzn::storage_base::result::not_found, storage.remove(USER_UUID));
+        EXPECT_EQ(std::nullopt, storage.read(USER_UUID, "key1"));
+        EXPECT_TRUE(storage.get_keys(USER_UUID).empty());
+        EXPECT_EQ("value2", *storage.read(NODE_UUID, "key1"));
+
+        // database can be recreated after being dropped...
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.create(USER_UUID, "key1", "value3"));
+        EXPECT_EQ("value3", *storage.read(USER_UUID, "key1"));
+    }
+
+    // the layout cannot be changed once created...
+    EXPECT_THROW(bzn::rocksdb_storage("./", NODE_UUID, false), std::runtime_error);
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    {
+        bzn::rocksdb_storage storage("./", NODE_UUID, false);
+
+        EXPECT_EQ(bzn::storage_base::result::ok, storage.create(USER_UUID, "key1", "value1"));
+    }
+
+    EXPECT_THROW(bzn::rocksdb_storage("./", NODE_UUID, true), std::runtime_error);
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
+
+
+TEST(spilling_mem_storage, test_that_cold_records_are_spilled_and_reloaded_within_the_memory_budget)
+{
+    const size_t BUDGET = 4096;
+    const size_t RECORDS = 200;
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    auto cold_storage = std::make_shared<bzn::rocksdb_storage>("./", NODE_UUID);
+    bzn::spilling_mem_storage storage(cold_storage, BUDGET);
+
+    std::map<bzn::key_t, bzn::value_t> expected;
+
+    for (size_t i = 0; i < RECORDS; ++i)
+    {
+        const auto key = boost::str(boost::format("key%03d") % i);
+
+        expected[key] = generate_test_string();
+        ASSERT_EQ(bzn::storage_base::result::ok, storage.create(USER_UUID, key, expected[key]));
+        EXPECT_LE(storage.get_memory_used(), BUDGET);
+    }
+
+    // the oldest records went out to cold storage, the newest are still only in memory...
+    EXPECT_TRUE(cold_storage->has(USER_UUID, "key000"));
+    EXPECT_FALSE(cold_storage->has(USER_UUID, boost::str(boost::format("key%03d") % (RECORDS - 1))));
+
+    // updates and removes of spilled records...
+    expected["key000"] = generate_test_string();
+    EXPECT_EQ(bzn::storage_base::result::ok, storage.update(USER_UUID, "key000", expected["key000"]));
+    EXPECT_EQ(bzn::storage_base::result::ok, storage.remove(USER_UUID, "key001"));
+    expected.erase("key001");
+    EXPECT_EQ(bzn::storage_base::result::exists, storage.create(USER_UUID, "key002", "value"));
+
+    for (const auto& record : expected)
+    {
+        EXPECT_EQ(record.second, storage.read(USER_UUID, record.first));
+        EXPECT_LE(storage.get_memory_used(), BUDGET);
+    }
+
+    std::vector<bzn::key_value_t> records(expected.begin(), expected.end());
+
+    EXPECT_EQ(records, storage.get_range(USER_UUID, "", "", 0, false));
+    EXPECT_EQ(std::vector<bzn::key_value_t>(records.begin(), records.begin() + 10), storage.get_range(USER_UUID, "", "", 10, false));
+    EXPECT_EQ(records.size(), storage.get_keys(USER_UUID).size());
+    EXPECT_EQ(std::make_pair(records.size(), records.size() * 100), storage.get_size(USER_UUID));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, storage.remove(USER_UUID));
+    EXPECT_EQ(std::make_pair(size_t(0), size_t(0)), storage.get_size(USER_UUID));
+    EXPECT_FALSE(cold_storage->has(USER_UUID, "key000"));
+    EXPECT_EQ(size_t(0), storage.get_memory_used());
+
+    cold_storage.reset();
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
+
+
+TEST(mem_table, test_that_order_and_values_survive_churn_and_compaction)
+{
+    bzn::mem_table table;
+    std::map<bzn::key_t, bzn::value_t> expected;
+
+    boost::random::uniform_int_distribution<> key_dist(0, 499);
+    boost::random::uniform_int_distribution<> op_dist(0, 9);
+    boost::random::uniform_int_distribution<> size_dist(0, 2000);
+
+    const auto sorted_records = [&]
+    {
+        return std::vector<bzn::key_value_t>(expected.begin(), expected.end());
+    };
+
+    for (size_t i = 0; i < 20000; ++i)
+    {
+        const auto key = "key" + std::to_string(key_dist(gen));
+        const auto value = generate_test_string(size_dist(gen));
+        const auto op = op_dist(gen);
+
+        if (op < 4)
+        {
+            EXPECT_EQ(expected.emplace(key, value).second, table.insert(key, value));
+        }
+        else if (op < 7)
+        {
+            const auto found = expected.find(key);
+
+            EXPECT_EQ(found != expected.end(), table.assign(key, value));
+
+            if (found != expected.end())
+            {
+                found->second = value;
+            }
+        }
+        else if (op < 9)
+        {
+            EXPECT_EQ(expected.erase(key) == 1, table.erase(key));
+        }
+        else
+        {
+            // ordered reads after every kind of change...
+            ASSERT_EQ(sorted_records(), table.range("", "", 0, false));
+        }
+
+        ASSERT_EQ(expected.size(), table.size());
+    }
+
+    size_t value_bytes = 0;
+
+    for (const auto& record : expected)
+    {
+        EXPECT_EQ(record.second, table.find(record.first));
+        value_bytes += record.second.size();
+    }
+
+    EXPECT_EQ(value_bytes, table.value_bytes());
+    EXPECT_EQ(sorted_records(), table.range("", "", 0, false));
+
+    std::vector<bzn::key_t> page;
+
+    for (auto it = expected.lower_bound("key3"); it != expected.end() && it->first.compare(0, 4, "key3") == 0 && page.size() < 10; ++it)
+    {
+        page.emplace_back(it->first);
+    }
+
+    EXPECT_EQ(page, table.keys("key2", 10, "key3"));
+
+    // the arena doesn't keep the churn, only the live records and some growing room...
+    EXPECT_LT(table.memory_used(), 4 * (value_bytes + expected.size() * 64));
+}
+
+
+TEST(cached_storage, test_that_reads_are_served_from_the_cache_until_written)
+{
+    const size_t CAPACITY = 16 * 1024;
+
+    auto storage = std::make_shared<bzn::mem_storage>();
+    bzn::cached_storage cache(storage, CAPACITY);
+
+    EXPECT_EQ(bzn::storage_base::result::ok, cache.create(USER_UUID, KEY, "value"));
+    EXPECT_EQ("value", cache.read(USER_UUID, KEY));
+
+    // a change behind the cache's back shows the value now comes from the cache...
+    EXPECT_EQ(bzn::storage_base::result::ok, storage->update(USER_UUID, KEY, "behind"));
+    EXPECT_EQ("value", cache.read(USER_UUID, KEY));
+    EXPECT_EQ("value", cache.read_view(USER_UUID, KEY)->data);
+
+    // writes through the cache drop the cached copy...
+    EXPECT_EQ(bzn::storage_base::result::ok, cache.update(USER_UUID, KEY, "updated"));
+    EXPECT_EQ("updated", cache.read(USER_UUID, KEY));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, cache.multi_update(USER_UUID, {{KEY, "multi"}}));
+    EXPECT_EQ(std::vector<std::optional<bzn::value_t>>{bzn::value_t("multi")}, cache.multi_read(USER_UUID, {KEY}));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, cache.remove(USER_UUID, KEY));
+    EXPECT_EQ(std::nullopt, cache.read(USER_UUID, KEY));
+    EXPECT_FALSE(cache.has(USER_UUID, KEY));
+
+    EXPECT_EQ(bzn::storage_base::result::ok, cache.create(USER_UUID, KEY, "value"));
+    EXPECT_EQ("value", cache.read(USER_UUID, KEY));
+    EXPECT_EQ(bzn::storage_base::result::ok, cache.remove(USER_UUID));
+    EXPECT_EQ(std::nullopt, cache.read(USER_UUID, KEY));
+
+    auto status = cache.get_status();
+
+    EXPECT_EQ(2u, status["hits"].asUInt64());
+    EXPECT_EQ(6u, status["misses"].asUInt64());
+    EXPECT_DOUBLE_EQ(0.25, status["hit_ratio"].asDouble());
+    EXPECT_EQ(0u, status["entries"].asUInt64());
+
+    // reading more than fits keeps the cache within its capacity...
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        const auto key = std::to_string(i);
+
+        EXPECT_EQ(bzn::storage_base::result::ok, cache.create(USER_UUID, key, generate_test_string()));
+        EXPECT_TRUE(cache.read(USER_UUID, key));
+    }
+
+    status = cache.get_status();
+
+    EXPECT_GT(status["entries"].asUInt64(), 0u);
+    EXPECT_LT(status["entries"].asUInt64(), 1000u);
+    EXPECT_LE(status["bytes"].asUInt64(), CAPACITY);
+    EXPECT_EQ("storage_cache", cache.get_name());
+}
+
+
+TEST(compressed_storage, test_that_large_values_are_stored_compressed_and_read_back_whatever_their_encoding)
+{
+    auto storage = std::make_shared<bzn::mem_storage>();
+    bzn::compressed_storage compressed(storage, 1024);
+
+    std::string json = "[";
+
+    for (size_t i = 0; i < 200; ++i)
+    {
+        json += boost::str(boost::format(R"({"id":%d,"name":"record %d","active":true},)") % i % (i * 7));
+    }
+
+    json.back() = ']';
+
+    const auto small = std::string(R"({"id":1})");
+    const auto incompressible = generate_test_string(4096);
+
+    ASSERT_EQ(bzn::storage_base::result::ok, compressed.create(USER_UUID, "json", json));
+    ASSERT_EQ(bzn::storage_base::result::ok, compressed.create(USER_UUID, "small", small));
+    ASSERT_EQ(bzn::storage_base::result::ok, compressed.create(USER_UUID, "random", incompressible));
+
+    // each value sits behind its flag byte...
+    const auto stored_json = *storage->read(USER_UUID, "json");
+    EXPECT_EQ(char(bzn::compressed_storage::encoding::snappy), stored_json.front());
+    EXPECT_LT(stored_json.size() * 4, json.size());
+
+    EXPECT_EQ(char(bzn::compressed_storage::encoding::raw), storage->read(USER_UUID, "small")->front());
+    EXPECT_EQ(char(bzn::compressed_storage::encoding::raw), storage->read(USER_UUID, "random")->front());
+
+    EXPECT_EQ(json, *compressed.read(USER_UUID, "json"));
+    EXPECT_EQ(json, compressed.read_view(USER_UUID, "json")->data);
+    EXPECT_EQ(small, compressed.read_view(USER_UUID, "small")->data);
+    EXPECT_EQ(incompressible, *compressed.read(USER_UUID, "random"));
+
+    // sizes leave out the flag bytes...
+    EXPECT_EQ(std::make_pair(size_t(3), stored_json.size() - 1 + small.size() + incompressible.size()), compressed.get_size(USER_UUID));
+
+    // values written under another threshold read back the same...
+    bzn::compressed_storage uncompressed(storage, std::numeric_limits<size_t>::max());
+    ASSERT_EQ(bzn::storage_base::result::ok, uncompressed.update(USER_UUID, "small", json));
+    ASSERT_EQ(bzn::storage_base::result::ok, uncompressed.multi_create(USER_UUID, {{"more", json}}));
+
+    const auto range = compressed.get_range(USER_UUID, "", "", 0, false);
+    ASSERT_EQ(size_t(4), range.size());
+
+    for (const auto& record : range)
+    {
+        EXPECT_EQ(record.first == "random" ? incompressible : json, record.second);
+    }
+
+    const auto values = compressed.multi_read(USER_UUID, {"json", "more", "missing"});
+    EXPECT_EQ(json, values[0]);
+    EXPECT_EQ(json, values[1]);
+    EXPECT_FALSE(values[2]);
+
+    // the limit is on the value as the client sent it...
+    EXPECT_EQ(bzn::storage_base::result::value_too_large, compressed.create(USER_UUID, "big", std::string(bzn::MAX_VALUE_SIZE + 1, 'x')));
+    EXPECT_EQ(bzn::storage_base::result::ok, compressed.create(USER_UUID, "big", std::string(bzn::MAX_VALUE_SIZE, 'x')));
+    EXPECT_EQ(std::string(bzn::MAX_VALUE_SIZE, 'x'), compressed.read(USER_UUID, "big"));
+
+    // an unknown flag is not mistaken for a value...
+    ASSERT_EQ(bzn::storage_base::result::ok, storage->update(USER_UUID, "json", "\x7fjunk"));
+    EXPECT_FALSE(compressed.read(USER_UUID, "json"));
+    EXPECT_FALSE(compressed.read_view(USER_UUID, "json"));
+}
@@ -30,8 +30,12 @@
 #include <pbft/pbft_failure_detector.hpp>
 #include <raft/raft.hpp>
 #include <status/status.hpp>
+#include <storage/cached_storage.hpp>
+#include <storage/compressed_storage.hpp>
 #include <storage/mem_storage.hpp>
 #include <storage/rocksdb_storage.hpp>
+#include <storage/sharded_mem_storage.hpp>
+#include <storage/spilling_mem_storage.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/support/date_time.hpp>
@@ -160,6 +164,74 @@ print_banner(const bzn::options& options, double eth_balance)
 }
 
 
+std::shared_ptr<bzn::storage_base>
+create_storage(const bzn::options& options, bzn::status::status_provider_list_t& status_providers)
+{
+    if (options.get_mem_storage())
+    {
+        if (const auto budget = options.get_mem_storage_budget())
+        {
+            // the spilled records are only meaningful to the storage that wrote them...
+            const auto spill_uuid = options.get_uuid() + "-spill";
+            boost::filesystem::remove_all(boost::filesystem::path(options.get_state_dir()).append(spill_uuid));
+
+            LOG(info) << "Using in-memory testing storage limited to " << budget << " bytes";
+            return std::make_shared<bzn::spilling_mem_storage>(std::make_shared<bzn::rocksdb_storage>(options.get_state_dir(), spill_uuid), budget);
+        }
+
+        if (const auto shards = options.get_simple_options().get<size_t>(bzn::option_names::MEM_STORAGE_SHARDS); shards != 1)
+        {
+            LOG(info) << "Using sharded in-memory testing storage";
+            return std::make_shared<bzn::sharded_mem_storage>(shards ? shards : std::thread::hardware_concurrency());
+        }
+
+        LOG(info) << "Using in-memory testing storage";
+        return std::make_shared<bzn::mem_storage>();
+    }
+
+    LOG(info) << "Using RocksDB storage";
+    auto storage = std::make_shared<bzn::rocksdb_storage>(options.get_state_dir(), options.get_uuid(),
+        options.get_simple_options().get<bool>(bzn::option_names::ROCKSDB_CF_PER_DB), options.get_rocksdb_tuning());
+
+    status_providers.push_back(storage);
+
+    std::shared_ptr<bzn::storage_base> values = storage;
+
+    if (const auto threshold = options.get_storage_compression_threshold())
+    {
+        LOG(info) << "Compressing values of at least " << threshold << " bytes";
+
+        values = std::make_shared<bzn::compressed_storage>(storage, threshold);
+    }
+
+    if (const auto cache_size = options.get_storage_cache_size())
+    {
+        LOG(info) << "Caching " << cache_size << " bytes of recently read values";
+
+        // the cache holds the values uncompressed...
+        auto cache = std::make_shared<bzn::cached_storage>(values, cache_size);
+        status_providers.push_back(cache);
+
+        return cache;
+    }
+
+    return values;
+}
+
+
+std::shared_ptr<bzn::storage_base>
+create_pbft_request_storage(const bzn::options& options)
+{
+    if (options.get_mem_storage())
+    {
+        return std::make_shared<bzn::mem_storage>();
+    }
+
+    // requests are written once and read back in order, rocksdb's defaults suit the log well...
+    return std::make_shared<bzn::rocksdb_storage>(options.get_state_dir(), options.get_uuid() + "-pbft-requests");
+}
+
+
 void
 start_worker_threads_and_wait(std::shared_ptr<bzn::asio::io_context_base> io_context)
 {
@@ -241,17 +313,28 @@ main(int argc, const char* argv[])
         {
             auto failure_detector = std::make_shared<bzn::pbft_failure_detector>(io_context);
 
-            // todo: for now use mem storage instead of rocksdb...
-            auto unstable_storage = std::make_shared<bzn::mem_storage>();
-            auto stable_storage = std::make_shared<bzn::mem_storage>();
-            auto crud = std::make_shared<bzn::crud>(stable_storage, std::make_shared<bzn::subscription_manager>(io_context));
+            bzn::status::status_provider_list_t status_providers;
+
+            // requests agreed on but not executed yet survive a restart in the request log...
+            auto unstable_storage = create_pbft_request_storage(*options);
+            auto stable_storage = create_storage(*options, status_providers);
+            auto crud = std::make_shared<bzn::crud>(io_context, stable_storage, std::make_shared<bzn::subscription_manager>(io_context));
 
             auto pbft = std::make_shared<bzn::pbft>(node, io_context, peers.get_peers(), options->get_uuid(),
                 std::make_shared<bzn::database_pbft_service>(io_context, unstable_storage, crud, options->get_uuid()), failure_detector, crypto);
 
             pbft->set_audit_enabled(options->get_simple_options().get<bool>(bzn::option_names::AUDIT_ENABLED));
-
-            status = std::make_shared<bzn::status>(node, bzn::status::status_provider_list_t{pbft}, true);
+            pbft->set_batching(options->get_simple_options().get<size_t>(bzn::option_names::PBFT_BATCH_SIZE),
+                std::chrono::milliseconds(options->get_simple_options().get<uint64_t>(bzn::option_names::PBFT_BATCH_TIMEOUT)));
+            pbft->set_checkpoint_interval(options->get_simple_options().get<uint64_t>(bzn::option_names::PBFT_CHECKPOINT_INTERVAL),
+                options->get_simple_options().get<double>(bzn::option_names::PBFT_HIGH_WATER_INTERVAL));
+            pbft->set_max_in_flight(options->get_simple_options().get<size_t>(bzn::option_names::PBFT_MAX_IN_FLIGHT));
+            pbft->set_digest_preprepares(options->get_simple_options().get<bool>(bzn::option_names::PBFT_DIGEST_PREPREPARES));
+            pbft->set_message_authentication(options->get_simple_options().get<bool>(bzn::option_names::CRYPTO_ENABLED_OUTGOING),
+                options->get_simple_options().get<bool>(bzn::option_names::PBFT_MAC_AUTHENTICATORS));
+
+            status_providers.insert(status_providers.begin(), pbft);
+            status = std::make_shared<bzn::status>(node, std::move(status_providers), true);
 
             crud->start();
             pbft->start();
@@ -268,23 +351,13 @@ main(int argc, const char* argv[])
                     options->get_uuid(), options->get_state_dir(), options->get_max_storage(),
                     options->peer_validation_enabled(), options->get_signed_key());
 
-            // which type of storage?
-            std::shared_ptr<bzn::storage_base> storage;
+            bzn::status::status_provider_list_t status_providers{raft};
 
-            if (options->get_mem_storage())
-            {
-                LOG(info) << "Using in-memory testing storage";
-                storage = std::make_shared<bzn::mem_storage>();
-            }
-            else
-            {
-                LOG(info) << "Using RocksDB storage";
-                storage = std::make_shared<bzn::rocksdb_storage>(options->get_state_dir(), options->get_uuid());
-            }
+            auto storage = create_storage(*options, status_providers);
 
             auto crud = std::make_shared<bzn::raft_crud>(node, raft, storage, std::make_shared<bzn::subscription_manager>(io_context));
             auto http_server = std::make_shared<bzn::http::server>(io_context, crud, ep);
-            status = std::make_shared<bzn::status>(node, bzn::status::status_provider_list_t{raft}, false);
+            status = std::make_shared<bzn::status>(node, std::move(status_providers), false);
 
             raft->set_audit_enabled(options->get_simple_options().get<bool>(bzn::option_names::AUDIT_ENABLED));
 